@@ -4,6 +4,7 @@
 
 
 from ctypes import wstring_at
+import os
 import sys
 import argparse
 import m5
@@ -13,9 +14,21 @@ parser = argparse.ArgumentParser()
 parser.add_argument('--skip', type=int, default=0, help='number of instructions to skip through fast-forwarding')
 parser.add_argument('--lim', type=int, default=0, help='max number of instructions to simulate (0 for no limit)')
 parser.add_argument('--atomic', action='store_true', help='use atomic model instead of timing model for simulation')
+parser.add_argument('--cpu', choices=['simple', 'o3', 'minor'], default='simple', help='timing CPU model for simulation (o3 and minor track the capabilities with a CapstoneCapTracker)')
+parser.add_argument('--num-cpus', type=int, default=1, help='number of cores')
 parser.add_argument('--ncache-size', type=str, default='8kB', help='size of the node cache')
-parser.add_argument('--checkpoint-period', type=int, default=0, help='interval between checkpoints')
+parser.add_argument('--node-cache-entries', type=int, default=0, help='number of nodes cached in the node controller (0 to disable)')
+parser.add_argument('--node-cache-prefetch', action='store_true', help='prefetch neighbour nodes into the node controller cache')
+parser.add_argument('--functional-ff', action='store_true', help='keep the revocation nodes in a host-side array while fast-forwarding (only with --skip and a timing main CPU)')
+parser.add_argument('--alloc-policy', choices=['lifo', 'slab'], default='lifo', help='placement of new revocation nodes (slab keeps children near their parents)')
+parser.add_argument('--node-trace', type=str, default='', help='record the node controller commands to this file (in the output directory) for replay-node-trace.py')
+parser.add_argument('--overlap-ncache', action='store_true', help='overlap the node controller commands with the dcache access in the timing model')
+parser.add_argument('--ncache-stalls', action='store_true', help='count the node controller latency as stall cycles in the atomic model')
+parser.add_argument('--predecode-blocks', type=int, default=0, help='number of decoded basic blocks kept by the atomic CPUs (0 to disable; the blocks skip the icache)')
+parser.add_argument('--checkpoint-period', type=int, default=0, help='interval between checkpoints (in ticks, 0 for no periodic checkpoints)')
+parser.add_argument('--checkpoint-after-skip', action='store_true', help='take a checkpoint at the end of fast-forwarding')
 parser.add_argument('--checkpoint-folder', type=str, default='./checkpoints', help='where to store the checkpoints')
+parser.add_argument('--restore', type=str, default=None, help='checkpoint directory to restore from')
 
 if '--' not in sys.argv:
     sys.stderr.write('Usage: fast-forward.py [flags] -- <commands>')
@@ -26,12 +39,24 @@ arg_delimiter_idx = sys.argv.index('--')
 args = parser.parse_args(sys.argv[1:arg_delimiter_idx])
 commands = sys.argv[arg_delimiter_idx + 1:]
 
+if args.restore is not None and args.skip > 0:
+    sys.stderr.write('--restore cannot be combined with --skip')
+    sys.exit(1)
+
+if args.cpu != 'simple' and args.atomic:
+    sys.stderr.write('--cpu {} cannot be combined with --atomic'.format(args.cpu))
+    sys.exit(1)
+
 start_with_atomic = args.skip > 0 or args.atomic
 
 binary = commands[0]
 arguments = commands[1:]
 
-MainCPU, main_timing = (AtomicSimpleCPU, 'atomic') if args.atomic else (TimingSimpleCPU, 'timing')
+if args.atomic:
+    MainCPU, main_timing = AtomicSimpleCPU, 'atomic'
+else:
+    MainCPU = {'simple': TimingSimpleCPU, 'o3': O3CPU, 'minor': MinorCPU}[args.cpu]
+    main_timing = 'timing'
 InitCPU, init_timing = (AtomicSimpleCPU, 'atomic') if args.skip > 0 else (MainCPU, main_timing)
 
 is_capstone = 'NodeController' in globals()
@@ -80,7 +105,7 @@ system.mem_ranges = [AddrRange(0x0, size='32GiB')]
 
 
 
-system.cpu = InitCPU()
+system.cpu = [InitCPU(cpu_id = i) for i in range(args.num_cpus)]
 
 system.l2cache = L2Cache()
 system.l2bus = L2XBar()
@@ -88,21 +113,23 @@ system.l2bus = L2XBar()
 
 system.membus = SystemXBar()
 
-system.cpu.icache = L1ICache()
-system.cpu.dcache = L1DCache()
-
 system.l2bus.mem_side_ports = system.l2cache.cpu_side
 system.l2cache.mem_side = system.membus.cpu_side_ports
-system.cpu.icache.mem_side = system.l2bus.cpu_side_ports
-system.cpu.dcache.mem_side = system.l2bus.cpu_side_ports
 
-system.cpu.icache_port = system.cpu.icache.cpu_side
-system.cpu.dcache_port = system.cpu.dcache.cpu_side
+for cpu in system.cpu:
+    cpu.icache = L1ICache()
+    cpu.dcache = L1DCache()
+
+    cpu.icache.mem_side = system.l2bus.cpu_side_ports
+    cpu.dcache.mem_side = system.l2bus.cpu_side_ports
 
-system.cpu.mmu.itb.walker.port = system.membus.cpu_side_ports
-system.cpu.mmu.dtb.walker.port = system.membus.cpu_side_ports
+    cpu.icache_port = cpu.icache.cpu_side
+    cpu.dcache_port = cpu.dcache.cpu_side
 
-system.cpu.createInterruptController()
+    cpu.mmu.itb.walker.port = system.membus.cpu_side_ports
+    cpu.mmu.dtb.walker.port = system.membus.cpu_side_ports
+
+    cpu.createInterruptController()
 
 system.mem_ctrl = MemCtrl()
 system.mem_ctrl.dram = DDR3_1600_8x8()
@@ -112,45 +139,88 @@ system.mem_ctrl.port = system.membus.mem_side_ports
 
 if is_capstone:
     system.ncache = NCache()
-    system.node_controller = NodeController()
-    system.cpu.node_controller = system.node_controller
-    system.cpu.ncache_port = system.node_controller.cpu_side
+    system.node_controller = NodeController(
+            node_cache_entries=args.node_cache_entries,
+            node_cache_prefetch=args.node_cache_prefetch,
+            alloc_policy=args.alloc_policy,
+            trace_file=args.node_trace,
+            # the main CPU would lose its node access latency in atomic mode
+            functional_atomic=args.functional_ff and args.skip > 0 and not args.atomic)
+    # one node controller port per core
+    for cpu in system.cpu:
+        if MainCPU is InitCPU and args.cpu != 'simple':
+            cpu.cap_tracker = CapstoneCapTracker(
+                    node_controller=system.node_controller)
+            cpu.cap_tracker.port = system.node_controller.cpu_side
+        else:
+            cpu.node_controller = system.node_controller
+            cpu.ncache_port = system.node_controller.cpu_side
     system.node_controller.mem_side = system.ncache.cpu_side
     system.ncache.mem_side = system.membus.cpu_side_ports
 
 
 system.workload = SEWorkload.init_compatible(binary)
 
+# all the cores share the process, the other threads are started by clone
 process = Process()
 process.cmd = [binary] + arguments
-system.cpu.workload = process
-
-system.cpu.cpu_id = 0
-system.cpu.createThreads()
+for cpu in system.cpu:
+    cpu.workload = process
+    cpu.createThreads()
 
 
 if args.skip > 0:
-    system.cpu.max_insts_any_thread = args.skip
+    for cpu in system.cpu:
+        cpu.max_insts_any_thread = args.skip
 
 root = Root(full_system = False, system = system)
 
 if args.skip > 0:
-    switchedout_cpu = MainCPU(switched_out=True)
-    switchedout_cpu.system = system
-    switchedout_cpu.clk_domain = system.cpu.clk_domain
-    switchedout_cpu.isa = system.cpu.isa
-    switchedout_cpu.workload = system.cpu.workload
-    if args.lim > 0:
-        switchedout_cpu.max_insts_any_thread = args.lim
-    switchedout_cpu.progress_interval = system.cpu.progress_interval
-    if is_capstone:
-        switchedout_cpu.node_controller = system.node_controller
-    switchedout_cpu.cpu_id = system.cpu.cpu_id
-    switchedout_cpu.createThreads()
-    system.switch_cpus = [switchedout_cpu]
-    switch_list = [(system.cpu, switchedout_cpu)]
-
-m5.instantiate()
+    system.switch_cpus = [MainCPU(switched_out=True, cpu_id=i)
+            for i in range(args.num_cpus)]
+    switch_list = []
+    for cpu, switchedout_cpu in zip(system.cpu, system.switch_cpus):
+        switchedout_cpu.system = system
+        switchedout_cpu.clk_domain = cpu.clk_domain
+        switchedout_cpu.isa = cpu.isa
+        switchedout_cpu.workload = cpu.workload
+        if args.lim > 0:
+            switchedout_cpu.max_insts_any_thread = args.lim
+        switchedout_cpu.progress_interval = cpu.progress_interval
+        if is_capstone and args.cpu != 'simple':
+            # the tracker takes over the capabilities tracked so far
+            switchedout_cpu.cap_tracker = CapstoneCapTracker(
+                    node_controller=system.node_controller)
+            switchedout_cpu.cap_tracker.port = system.node_controller.cpu_side
+        elif is_capstone:
+            switchedout_cpu.node_controller = system.node_controller
+        switchedout_cpu.createThreads()
+        switch_list.append((cpu, switchedout_cpu))
+
+if is_capstone and args.atomic:
+    # only the CPUs that run after fast-forwarding
+    for cpu in (system.switch_cpus if args.skip > 0 else system.cpu):
+        cpu.simulate_ncache_stalls = args.ncache_stalls
+elif is_capstone and args.cpu == 'simple':
+    for cpu in (system.switch_cpus if args.skip > 0 else system.cpu):
+        cpu.overlap_ncache_commands = args.overlap_ncache
+
+if is_capstone:
+    atomic_cpus = list(system.cpu) if InitCPU is AtomicSimpleCPU else []
+    if args.skip > 0 and args.atomic:
+        atomic_cpus += system.switch_cpus
+    for cpu in atomic_cpus:
+        cpu.predecode_blocks = args.predecode_blocks
+
+def take_checkpoint():
+    path = os.path.join(args.checkpoint_folder, 'cpt.{}'.format(m5.curTick()))
+    print('Writing checkpoint {}'.format(path))
+    m5.checkpoint(path)
+
+m5.instantiate(args.restore)
+if args.restore is not None:
+    print('Restored from checkpoint {} @ tick {}'.format(args.restore, m5.curTick()))
+
 if args.skip > 0:
     print("Beginning simulation (fast-forward)!")
 
@@ -162,15 +232,23 @@ if args.skip > 0:
         print('Cannot proceed to switch CPUs')
         sys.exit(0)
         
+    if args.checkpoint_after_skip:
+        take_checkpoint()
+
     m5.stats.reset()
 
     m5.switchCpus(system, switch_list) # switch core
 else:
     print("Beginning simulation!")
 
-exit_event = m5.simulate()
+if args.checkpoint_period > 0:
+    while True:
+        exit_event = m5.simulate(args.checkpoint_period)
+        if exit_event.getCause() != 'simulate() limit reached':
+            break
+        take_checkpoint()
+else:
+    exit_event = m5.simulate()
 print('Simulation exiting @ tick {} because {}'
         .format(m5.curTick(), exit_event.getCause()))
 
-# m5.checkpoint('m5out/ckp')
-
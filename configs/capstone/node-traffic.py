@@ -0,0 +1,92 @@
+# NOTE: this only works with the RISC-V Capstone arch
+# usage: gem5 node-traffic.py [flags]
+# drives a node controller with synthetic capability traffic, without the
+# CPUs, e.g., to find the command rate it saturates at (sweep
+# --cmd-interval and compare the throughput stat of the generator)
+
+
+import argparse
+import m5
+from m5.objects import *
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--ncache-size', type=str, default='8kB', help='size of the node cache')
+parser.add_argument('--node-cache-entries', type=int, default=0, help='number of nodes cached in the node controller (0 to disable)')
+parser.add_argument('--node-cache-prefetch', action='store_true', help='prefetch neighbour nodes into the node controller cache')
+parser.add_argument('--alloc-policy', choices=['lifo', 'slab'], default='lifo', help='placement of new revocation nodes (slab keeps children near their parents)')
+parser.add_argument('--async-revoke', action='store_true', help='sweep revoked subtrees in the background')
+parser.add_argument('--seed', type=int, default=1, help='seed of the generator')
+parser.add_argument('--num-commands', type=int, default=100000, help='number of commands to generate')
+parser.add_argument('--cmd-interval', type=int, default=1, help='cycles between two commands')
+parser.add_argument('--max-outstanding', type=int, default=4, help='maximum number of commands in flight')
+parser.add_argument('--mix', type=str, default='2:4:4', help='relative frequencies of allocations, queries and rc updates')
+parser.add_argument('--lifetime', type=int, default=1000, help='mean lifetime of a node, in commands')
+parser.add_argument('--lifetime-dist', choices=['fixed', 'uniform', 'exponential'], default='exponential', help='distribution of the lifetimes of nodes')
+parser.add_argument('--derive-fraction', type=float, default=0.5, help='probability that an allocation derives from a live node')
+parser.add_argument('--fan-out', type=int, default=4, help='maximum number of children of a node')
+parser.add_argument('--max-depth', type=int, default=4, help='maximum depth of the derivation trees')
+
+args = parser.parse_args()
+alloc_weight, query_weight, rc_update_weight = \
+        [int(w) for w in args.mix.split(':')]
+
+
+class NCache(Cache):
+    size = args.ncache_size
+    assoc = 2
+    tag_latency = 2
+    data_latency = 2
+    response_latency = 2
+    mshrs = 4
+    tgts_per_mshr = 20
+
+system = System()
+
+system.clk_domain = SrcClockDomain()
+system.clk_domain.clock = '1GHz'
+system.clk_domain.voltage_domain = VoltageDomain()
+
+system.mem_mode = 'timing'
+system.mem_ranges = [AddrRange(0x0, size='32GiB')]
+
+system.membus = SystemXBar()
+
+system.mem_ctrl = MemCtrl()
+system.mem_ctrl.dram = DDR3_1600_8x8()
+system.mem_ctrl.dram.range = system.mem_ranges[0]
+system.mem_ctrl.dram.device_size = '2048MiB'
+system.mem_ctrl.port = system.membus.mem_side_ports
+
+system.ncache = NCache()
+system.node_controller = NodeController(
+        node_cache_entries=args.node_cache_entries,
+        node_cache_prefetch=args.node_cache_prefetch,
+        alloc_policy=args.alloc_policy,
+        async_revoke=args.async_revoke)
+system.node_controller.mem_side = system.ncache.cpu_side
+system.ncache.mem_side = system.membus.cpu_side_ports
+
+system.generator = NodeControllerTrafficGen(
+        node_controller=system.node_controller,
+        seed=args.seed,
+        num_commands=args.num_commands,
+        cmd_interval=args.cmd_interval,
+        max_outstanding=args.max_outstanding,
+        alloc_weight=alloc_weight,
+        query_weight=query_weight,
+        rc_update_weight=rc_update_weight,
+        lifetime=args.lifetime,
+        lifetime_dist=args.lifetime_dist,
+        derive_fraction=args.derive_fraction,
+        fan_out=args.fan_out,
+        max_depth=args.max_depth)
+system.generator.port = system.node_controller.cpu_side
+
+root = Root(full_system = False, system = system)
+
+m5.instantiate()
+
+print("Beginning traffic generation!")
+exit_event = m5.simulate()
+print('Exiting @ tick {} because {}'
+      .format(m5.curTick(), exit_event.getCause()))
@@ -0,0 +1,73 @@
+# NOTE: this only works with the RISC-V Capstone arch
+# usage: gem5 replay-node-trace.py [flags] trace
+# replays a node controller command trace (recorded with
+# fast-forward.py --node-trace) without the CPUs
+
+
+import argparse
+import m5
+from m5.objects import *
+
+parser = argparse.ArgumentParser()
+parser.add_argument('trace', type=str, help='node controller command trace')
+parser.add_argument('--ncache-size', type=str, default='8kB', help='size of the node cache')
+parser.add_argument('--node-cache-entries', type=int, default=0, help='number of nodes cached in the node controller (0 to disable)')
+parser.add_argument('--node-cache-prefetch', action='store_true', help='prefetch neighbour nodes into the node controller cache')
+parser.add_argument('--alloc-policy', choices=['lifo', 'slab'], default='lifo', help='placement of new revocation nodes (slab keeps children near their parents)')
+parser.add_argument('--async-revoke', action='store_true', help='sweep revoked subtrees in the background')
+parser.add_argument('--max-outstanding', type=int, default=1, help='maximum number of commands in flight')
+parser.add_argument('--back-to-back', action='store_true', help='ignore the recorded ticks and issue the commands back to back')
+
+args = parser.parse_args()
+
+
+class NCache(Cache):
+    size = args.ncache_size
+    assoc = 2
+    tag_latency = 2
+    data_latency = 2
+    response_latency = 2
+    mshrs = 4
+    tgts_per_mshr = 20
+
+system = System()
+
+system.clk_domain = SrcClockDomain()
+system.clk_domain.clock = '1GHz'
+system.clk_domain.voltage_domain = VoltageDomain()
+
+system.mem_mode = 'timing'
+system.mem_ranges = [AddrRange(0x0, size='32GiB')]
+
+system.membus = SystemXBar()
+
+system.mem_ctrl = MemCtrl()
+system.mem_ctrl.dram = DDR3_1600_8x8()
+system.mem_ctrl.dram.range = system.mem_ranges[0]
+system.mem_ctrl.dram.device_size = '2048MiB'
+system.mem_ctrl.port = system.membus.mem_side_ports
+
+system.ncache = NCache()
+system.node_controller = NodeController(
+        node_cache_entries=args.node_cache_entries,
+        node_cache_prefetch=args.node_cache_prefetch,
+        alloc_policy=args.alloc_policy,
+        async_revoke=args.async_revoke)
+system.node_controller.mem_side = system.ncache.cpu_side
+system.ncache.mem_side = system.membus.cpu_side_ports
+
+system.replayer = NodeControllerTraceReplayer(
+        node_controller=system.node_controller,
+        trace_file=args.trace,
+        max_outstanding=args.max_outstanding,
+        respect_ticks=not args.back_to_back)
+system.replayer.port = system.node_controller.cpu_side
+
+root = Root(full_system = False, system = system)
+
+m5.instantiate()
+
+print("Beginning replay!")
+exit_event = m5.simulate()
+print('Exiting @ tick {} because {}'
+      .format(m5.curTick(), exit_event.getCause()))
@@ -12,6 +12,14 @@ class BaseAtomicSimpleNCacheCPU(BaseSimpleCPU):
     width = Param.Int(1, "CPU width")
     simulate_data_stalls = Param.Bool(False, "Simulate dcache stall cycles")
     simulate_inst_stalls = Param.Bool(False, "Simulate icache stall cycles")
+    simulate_ncache_stalls = Param.Bool(False,
+            "Simulate node controller stall cycles")
+    predecode_blocks = Param.Unsigned(0,
+            "Number of decoded basic blocks kept by physical PC (0 to "
+            "disable). Instructions run from a block skip the icache and "
+            "are not translated again after the first one of the block")
+    predecode_block_insts = Param.Unsigned(64,
+            "Maximum number of instructions in a decoded basic block")
 
 
     ncache_port = RequestPort('node cache port')
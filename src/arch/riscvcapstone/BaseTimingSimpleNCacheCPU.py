@@ -37,6 +37,14 @@ class BaseTimingSimpleNCacheCPU(BaseSimpleCPU):
 
     ncache_port = RequestPort('node cache port')
     node_controller = Param.NodeController('node controller for revocation nodes')
+    coalesce_rc_updates = Param.Bool(False,
+        'merge the rc updates of each instruction to the same node and '
+        'drop the ones that cancel out')
+    overlap_ncache_commands = Param.Bool(False,
+        'send the capability check of a memory access along with it, and '
+        'retire rc updates without waiting for their responses')
+    rc_update_buffer_size = Param.Unsigned(4,
+        'maximum number of unacknowledged rc updates in overlap mode')
 
     @classmethod
     def memory_mode(cls):
@@ -0,0 +1,19 @@
+from m5.params import *
+from m5.proxy import *
+from m5.objects.CapTracker import BaseCapTracker
+
+from .NodeController import NodeController
+
+class CapstoneCapTracker(BaseCapTracker):
+    type = 'CapstoneCapTracker'
+    cxx_header = 'arch/riscvcapstone/spec_cap_tracker.hh'
+    cxx_class = 'gem5::RiscvcapstoneISA::CapstoneCapTracker'
+
+    port = RequestPort('port connected to a cpu_side port of the node '
+            'controller')
+
+    system = Param.System(Parent.any, 'the system this tracker belongs to')
+    node_controller = Param.NodeController('node controller for revocation '
+            'nodes')
+    rc_update_buffer_size = Param.Unsigned(4,
+        'maximum number of unacknowledged rc updates before commit stalls')
@@ -4,14 +4,47 @@ from m5.params import *
 from m5.objects.ClockedObject import ClockedObject
 
 
+class NodeAllocPolicy(Enum):
+    vals = ['lifo', 'slab']
+
+
 class NodeController(ClockedObject):
     type = 'NodeController'
     cxx_header = 'arch/riscvcapstone/node_controller.hh'
     cxx_class = 'gem5::RiscvcapstoneISA::NodeController'
 
-    # TODO: switching to vector port to allow multicores
-    cpu_side = ResponsePort('port typically connected to the CPU dcache port')
+    cpu_side = VectorResponsePort('ports connected to the ncache ports '
+            'of the CPUs, one per core')
     mem_side = RequestPort('memory-side port')
 
     system = Param.System(Parent.any, 'the system this node controller belongs to')
 
+    node_count = Param.Unsigned(1 << 24, 'number of revocation nodes')
+    cmd_queue_depth = Param.Unsigned(16, 'maximum number of commands the '
+            'controller keeps at a time (in flight or waiting for a hazard)')
+    port_queue_depth = Param.Unsigned(4, 'maximum number of requests waiting '
+            'for arbitration in each CPU port')
+    async_revoke = Param.Bool(False, 'respond to a revocation once its root '
+            'node is invalidated and sweep the subtree in the background')
+
+    node_cache_entries = Param.Unsigned(0, 'number of nodes in the node '
+            'cache (0 to disable it)')
+    node_cache_assoc = Param.Unsigned(4, 'associativity of the node cache')
+    node_cache_latency = Param.Cycles(1, 'latency of node cache hits')
+    node_cache_prefetch = Param.Bool(False, 'prefetch the next and previous '
+            'nodes during allocations and revocations')
+
+    functional_atomic = Param.Bool(False, 'in atomic mode, keep the nodes '
+            'in a host-side array (synchronized with memory on drain) and '
+            'do not account any node access latency')
+
+    alloc_policy = Param.NodeAllocPolicy('lifo', 'where new nodes are '
+            'placed: lifo reuses the most recently freed node, slab places '
+            'a child in the slab of its parent so that subtrees stay on '
+            'few cache lines')
+    alloc_slab_size = Param.Unsigned(16, 'number of consecutive nodes in '
+            'each slab of the slab allocation policy')
+
+    trace_file = Param.String('', 'protobuf trace of the commands for '
+            'NodeControllerTraceReplayer, relative to the output directory '
+            '(empty to disable, .gz to compress)')
@@ -0,0 +1,25 @@
+from m5.params import *
+from m5.proxy import *
+from m5.objects.ClockedObject import ClockedObject
+
+
+class NodeControllerTraceReplayer(ClockedObject):
+    type = 'NodeControllerTraceReplayer'
+    cxx_header = 'arch/riscvcapstone/node_trace_replayer.hh'
+    cxx_class = 'gem5::RiscvcapstoneISA::NodeControllerTraceReplayer'
+
+    port = RequestPort('port connected to a cpu_side port of the node '
+            'controller')
+
+    system = Param.System(Parent.any, 'the system this replayer belongs to')
+    node_controller = Param.NodeController('the node controller to replay '
+            'the commands into')
+
+    trace_file = Param.String('command trace recorded by a node controller '
+            '(trace_file of NodeController)')
+    max_outstanding = Param.Unsigned(1, 'maximum number of commands in '
+            'flight')
+    respect_ticks = Param.Bool(True, 'issue each command no earlier than '
+            'its recorded tick, otherwise back to back')
+    exit_on_end = Param.Bool(True, 'exit the simulation loop once the whole '
+            'trace is replayed')
@@ -0,0 +1,47 @@
+from m5.params import *
+from m5.proxy import *
+from m5.objects.ClockedObject import ClockedObject
+
+
+class NodeGenLifetime(Enum):
+    vals = ['fixed', 'uniform', 'exponential']
+
+class NodeControllerTrafficGen(ClockedObject):
+    type = 'NodeControllerTrafficGen'
+    cxx_header = 'arch/riscvcapstone/node_traffic_gen.hh'
+    cxx_class = 'gem5::RiscvcapstoneISA::NodeControllerTrafficGen'
+
+    port = RequestPort('port connected to a cpu_side port of the node '
+            'controller')
+
+    system = Param.System(Parent.any, 'the system this generator belongs to')
+    node_controller = Param.NodeController('the node controller to send '
+            'the commands to')
+
+    seed = Param.UInt64(1, 'seed of the random choices')
+    cmd_interval = Param.Cycles(1, 'cycles between two commands (the '
+            'intensity of the traffic)')
+    max_outstanding = Param.Unsigned(4, 'maximum number of commands in '
+            'flight')
+    num_commands = Param.UInt64(100000, 'number of commands to generate '
+            '(0 for no limit)')
+
+    alloc_weight = Param.Unsigned(2, 'relative frequency of allocations')
+    query_weight = Param.Unsigned(4, 'relative frequency of queries')
+    rc_update_weight = Param.Unsigned(4, 'relative frequency of rc '
+            'updates')
+
+    lifetime = Param.UInt64(1000, 'mean lifetime of a node, in generated '
+            'commands, before it is revoked')
+    lifetime_dist = Param.NodeGenLifetime('exponential', 'distribution of '
+            'the lifetimes of nodes')
+
+    derive_fraction = Param.Float(0.5, 'probability that an allocation '
+            'derives from a live node instead of making a new root')
+    fan_out = Param.Unsigned(4, 'maximum number of children of a node')
+    max_depth = Param.Unsigned(4, 'maximum depth of the derivation trees')
+    max_live = Param.Unsigned(65536, 'maximum number of live nodes, '
+            'allocations are replaced by other commands above it')
+
+    exit_on_end = Param.Bool(True, 'exit the simulation loop once '
+            'num_commands commands are complete')
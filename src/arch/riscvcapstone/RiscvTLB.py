@@ -33,6 +33,7 @@ from m5.proxy import *
 
 from m5.objects.BaseTLB import BaseTLB
 from m5.objects.ClockedObject import ClockedObject
+from m5.objects.ReplacementPolicies import LRURP
 
 class RiscvPagetableWalker(ClockedObject):
     type = 'RiscvPagetableWalker'
@@ -43,6 +44,10 @@ class RiscvPagetableWalker(ClockedObject):
     system = Param.System(Parent.any, "system object")
     num_squash_per_cycle = Param.Unsigned(4,
             "Number of outstanding walks that can be squashed per cycle")
+    coalesce_walks = Param.Bool(True, "Let walks to a page that is already "
+            "being walked wait for that walk instead of walking again")
+    pwc_entries = Param.Unsigned(0, "Number of non-leaf PTEs in the page "
+            "walk cache (0 to disable)")
 
 class RiscvTLB(BaseTLB):
     type = 'RiscvTLB'
@@ -50,5 +55,12 @@ class RiscvTLB(BaseTLB):
     cxx_header = 'arch/riscvcapstone/tlb.hh'
 
     size = Param.Int(64, "TLB size")
+    assoc = Param.Int(0, "TLB associativity (0 for fully associative)")
+    replacement_policy = Param.BaseReplacementPolicy(LRURP(),
+            "Replacement policy within a set")
+    # A second-level TLB (next_level) may be shared by several TLBs; give
+    # it walker=NULL, its misses are walked by the first level.
     walker = Param.RiscvPagetableWalker(\
             RiscvPagetableWalker(), "page table walker")
+    hit_latency = Param.Latency('0ns', "Latency of a hit when this TLB "
+            "is the next level of another one")
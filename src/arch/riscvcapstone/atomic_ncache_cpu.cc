@@ -42,11 +42,13 @@
 #include "arch/riscvcapstone/atomic_ncache_cpu.hh"
 #include "arch/riscvcapstone/faults.hh"
 #include "arch/riscvcapstone/insts/static_inst.hh"
+#include "arch/riscvcapstone/page_size.hh"
 #include "arch/riscvcapstone/regs/int.hh"
 #include "arch/generic/decoder.hh"
 #include "base/output.hh"
 #include "config/the_isa.hh"
 #include "cpu/exetrace.hh"
+#include "cpu/pred/bpred_unit.hh"
 #include "cpu/utils.hh"
 #include "debug/Drain.hh"
 #include "debug/ExecFaulting.hh"
@@ -83,13 +85,23 @@ AtomicSimpleNCacheCPU::AtomicSimpleNCacheCPU(const BaseAtomicSimpleNCacheCPUPara
       width(p.width), locked(false),
       simulate_data_stalls(p.simulate_data_stalls),
       simulate_inst_stalls(p.simulate_inst_stalls),
+      simulate_ncache_stalls(p.simulate_ncache_stalls),
       icachePort(name() + ".icache_port", this),
       dcachePort(name() + ".dcache_port", this),
       ncache_port(name() + ".ncache_port", this),
       node_controller(p.node_controller),
       dcache_access(false), dcache_latency(0),
-      ppCommit(nullptr)
+      ncache_latency(0),
+      ppCommit(nullptr),
+      predecodeCache(p.predecode_blocks, p.predecode_block_insts, PageBytes),
+      predecodeBlock(nullptr), predecodeIndex(0), predecodeNextPC(0),
+      predecodeGen(0), recordBlock(nullptr), recordGen(0),
+      predecodeStats(this)
 {
+    fatal_if(predecodeCache.enabled() && numThreads > 1,
+            "predecode_blocks is only supported with a single thread");
+    fatal_if(predecodeCache.enabled() && p.predecode_block_insts == 0,
+            "predecode_block_insts must not be 0");
     _status = Idle;
     ifetch_req = std::make_shared<Request>();
     data_read_req = std::make_shared<Request>();
@@ -155,6 +167,11 @@ AtomicSimpleNCacheCPU::drainResume()
     DPRINTF(SimpleCPU, "Resume\n");
     verifyMemoryMode();
 
+    // memory may have been written behind our back (e.g., by another
+    // CPU or a checkpoint restore) while drained
+    if (predecodeCache.enabled())
+        predecodeCache.clear();
+
     assert(!threadContexts.empty());
 
     _status = BaseSimpleCPU::Idle;
@@ -315,6 +332,7 @@ AtomicSimpleNCacheCPU::AtomicCPUDPort::recvAtomicSnoop(PacketPtr pkt)
             t_info->thread->getIsaPtr()->handleLockedSnoop(pkt,
                     cacheBlockMask);
         }
+        cpu->invalidatePredecoded(pkt->getAddr(), pkt->getSize());
     }
 
     return 0;
@@ -460,6 +478,7 @@ AtomicSimpleNCacheCPU::writeMem(uint8_t *data, unsigned size, Addr addr,
     SimpleThread *thread = t_info.thread;
     static uint8_t zero_array[64] = {};
 
+    storeSize = size;
     if (data == NULL) {
         assert(size <= 64);
         assert(flags & Request::STORE_NO_DATA);
@@ -522,6 +541,7 @@ AtomicSimpleNCacheCPU::writeMem(uint8_t *data, unsigned size, Addr addr,
                     // Notify other threads on this CPU of write
                     threadSnoop(&pkt, curThread);
                 }
+                invalidatePredecoded(req->getPaddr(), frag_size);
                 dcache_access = true;
                 panic_if(pkt.isError(), "Data write (%s) failed: %s",
                         pkt.getAddrRange().to_string(), pkt.print());
@@ -609,6 +629,7 @@ AtomicSimpleNCacheCPU::amoMem(Addr addr, uint8_t* data, unsigned size,
         } else {
             dcache_latency += sendPacket(dcachePort, &pkt);
         }
+        invalidatePredecoded(req->getPaddr(), size);
 
         dcache_access = true;
 
@@ -670,7 +691,10 @@ AtomicSimpleNCacheCPU::tick()
         const PCStateBase &pc = thread->pcState();
 
         bool needToFetch = !isRomMicroPC(pc.microPC()) && !curMacroStaticInst;
-        if (needToFetch) {
+        const PredecodedInst *predecoded = nullptr;
+        if (needToFetch && predecodeCache.enabled())
+            predecoded = nextPredecoded(pc.instAddr());
+        if (needToFetch && !predecoded) {
             ifetch_req->taskId(taskId());
             setupFetchRequest(ifetch_req);
             fault = thread->mmu->translateAtomic(ifetch_req, thread->getTC(),
@@ -682,7 +706,16 @@ AtomicSimpleNCacheCPU::tick()
             bool icache_access = false;
             dcache_access = false; // assume no dcache access
 
-            if (needToFetch) {
+            // where the instruction is, if it can be in a decoded block
+            Addr inst_paddr = MaxAddr;
+            if (needToFetch && !predecoded && predecodeCache.enabled() &&
+                    t_info.fetchOffset == 0) {
+                inst_paddr = ifetch_req->getPaddr() +
+                    (pc.instAddr() - ifetch_req->getVaddr());
+                predecoded = lookupPredecoded(inst_paddr, pc.instAddr());
+            }
+
+            if (needToFetch && !predecoded) {
                 // This is commented out because the decoder would act like
                 // a tiny cache otherwise. It wouldn't be flushed when needed
                 // like the I cache. It should be flushed, and when that works
@@ -695,13 +728,20 @@ AtomicSimpleNCacheCPU::tick()
                 //}
             }
 
-            preExecute();
+            if (predecoded) {
+                preExecutePredecoded(*predecoded);
+            } else {
+                preExecute();
+                if (inst_paddr != MaxAddr)
+                    recordPredecoded(inst_paddr);
+            }
 
             Tick stall_ticks = 0;
+            ncache_latency = 0;
             if (curStaticInst) {
+                // the decoder only makes RISC-V instructions
                 RiscvStaticInst* rv_inst =
-                    dynamic_cast<RiscvStaticInst*>(curStaticInst.get());
-                panic_if(rv_inst == NULL, "non-RISC-V instructions unsupported!");
+                    static_cast<RiscvStaticInst*>(curStaticInst.get());
 
                 int num_src = curStaticInst->numSrcRegs();
                 int num_dest = curStaticInst->numDestRegs();
@@ -721,37 +761,40 @@ AtomicSimpleNCacheCPU::tick()
                             // TODO: strictly this should be done during wb
                             panic_if(rv_inst->numDestRegs() != 1, "load instruction should have exactly 1 destination register");
                             node_controller->addCapTrack(
-                                    CapLoc::makeReg(t_info.thread->threadId(),
+                                    CapLoc::makeReg(t_info.thread->contextId(),
                                         rv_inst->destRegIdx(0).index()),
                                     node_id);
-                            delete sendNCacheCommandAtomic(new NodeControllerRcUpdate(node_id, 1));
-                        }
-                    } else if(curStaticInst->isStore()) {
-                        // check for overwriting in-memory capability
-                        DPRINTF(CapstoneNodeOps, "store to %llx\n", rv_inst->getAddr(&t_info, traceData));
-                        CapLoc mem_loc = CapLoc::makeMem(rv_inst->getAddr(&t_info, traceData));
-                        NodeID mem_node = node_controller->queryCapTrack(mem_loc);
-                        if(mem_node != NODE_ID_INVALID) {
-                            // the capability at the memory location will be overwritten
-                            node_controller->removeCapTrack(mem_loc);
-                            delete sendNCacheCommandAtomic(new NodeControllerRcUpdate(mem_node, -1));
+                            issueNCacheCommandAtomic(node_controller->newCommand<NodeControllerRcUpdate>(node_id, 1));
                         }
+                    }
+                    
+                    storeSize = 0; // set by writeMem
+                    fault = curStaticInst->execute(&t_info, traceData);
+
+                    // after the store, which gives its size
+                    if(!curStaticInst->isLoad() && curStaticInst->isStore() &&
+                            fault == NoFault && storeSize != 0) {
+                        // check for overwriting in-memory capabilities,
+                        // including the ones the store only partially overlaps
+                        Addr addr = rv_inst->getAddr(&t_info, traceData);
+                        DPRINTF(CapstoneNodeOps, "store to %llx\n", addr);
+                        CapLoc mem_loc = CapLoc::makeMem(addr);
+                        clearMemCaps(addr, storeSize);
 
                         // check for writing capability to memory
                         panic_if(rv_inst->numSrcRegs() != 2, "store instructions should have exactly 2 source registers"); 
                         RegId reg_id = rv_inst->srcRegIdx(1);
-                        if(reg_id.classValue() == RegClassType::IntRegClass){
+                        if(reg_id.classValue() == RegClassType::IntRegClass &&
+                                storeSize == CapTrackTable::CAP_SIZE){
                             RegIndex reg_idx = reg_id.index();
-                            CapLoc reg_loc = CapLoc::makeReg(t_info.thread->threadId(), reg_idx);
+                            CapLoc reg_loc = CapLoc::makeReg(t_info.thread->contextId(), reg_idx);
                             NodeID reg_node = node_controller->queryCapTrack(reg_loc);
                             if(reg_node != NODE_ID_INVALID) {
                                 node_controller->addCapTrack(mem_loc, reg_node);
-                                delete sendNCacheCommandAtomic(new NodeControllerRcUpdate(reg_node, 1));
+                                issueNCacheCommandAtomic(node_controller->newCommand<NodeControllerRcUpdate>(reg_node, 1));
                             }
                         }
                     }
-                    
-                    fault = curStaticInst->execute(&t_info, traceData);
                 } else{
 
                     NodeID source_nodes[32];
@@ -759,13 +802,19 @@ AtomicSimpleNCacheCPU::tick()
                     if(curStaticInst->isSyscall()){
                         overwriteIntReg(source_nodes, &source_n, t_info.tcBase(),
                                 RiscvcapstoneISA::ReturnValueReg);
-                    } else {
+                    } else if(rv_inst->capTrackClass() ==
+                            RiscvStaticInst::CapTrackMayPropagate) {
                         preOverwriteDest(source_nodes, &source_n, t_info, curStaticInst.get());
                     }
 
                     fault = curStaticInst->execute(&t_info, traceData);
 
-                    if(!curStaticInst->isSyscall()) {
+                    // nothing to do if no source and no destination
+                    // holds a capability
+                    if(!curStaticInst->isSyscall() &&
+                            (source_n != 0 || (rv_inst->intDestMask() &
+                                node_controller->capTrackRegMask(
+                                    t_info.thread->contextId())) != 0)) {
                         for(int j = 0; j < num_dest; j ++){
                             const RegId& dest_id = curStaticInst->destRegIdx(j);
                             if(dest_id.classValue() != RegClassType::IntRegClass)
@@ -776,18 +825,18 @@ AtomicSimpleNCacheCPU::tick()
                             DPRINTF(CapstoneNodeOps, "Consider dest reg %d (%d)\n", j, dest_idx);
                             int i;
                             for(i = 0; i < source_n; i ++){
-                                if(node_controller->node2Obj[source_nodes[i]].contains((Addr)dest_val))
+                                if(node_controller->node2Obj.get(source_nodes[i]).contains((Addr)dest_val))
                                     break;
                             }
-                            CapLoc dest_loc = CapLoc::makeReg(t_info.thread->threadId(), dest_idx);
+                            CapLoc dest_loc = CapLoc::makeReg(t_info.thread->contextId(), dest_idx);
                             NodeID dest_node = node_controller->queryCapTrack(dest_loc);
                             if(dest_node != NODE_ID_INVALID && (i >= source_n || dest_node != source_nodes[i])){
                                 node_controller->removeCapTrack(dest_loc);
-                                delete sendNCacheCommandAtomic(new NodeControllerRcUpdate(dest_node, -1));
+                                issueNCacheCommandAtomic(node_controller->newCommand<NodeControllerRcUpdate>(dest_node, -1));
                             }
                             if(i < source_n && dest_node != source_nodes[i]) {
                                 node_controller->addCapTrack(dest_loc, source_nodes[i]);
-                                delete sendNCacheCommandAtomic(new NodeControllerRcUpdate(source_nodes[i], 1));
+                                issueNCacheCommandAtomic(node_controller->newCommand<NodeControllerRcUpdate>(source_nodes[i], 1));
                             }
                             //for(int i = 0; i < num_src; i ++){
                                 //const RegId& src_id = curStaticInst->srcRegIdx(i);
@@ -798,7 +847,7 @@ AtomicSimpleNCacheCPU::tick()
                                 //CapLoc src_loc = CapLoc::makeReg(t_info.thread->threadId(), src_idx);
                                 //NodeID src_node = node_controller->queryCapTrack(src_loc);
                                 //if(src_node == NODE_ID_INVALID ||
-                                        //!node_controller->node2Obj[src_node].contains((Addr)dest_val))
+                                        //!node_controller->node2Obj.get(src_node).contains((Addr)dest_val))
                                     //continue;
                                 //DPRINTF(CapstoneNodeOps, "Consider src reg %d (%d)\n", i, src_idx);
                                 //// src and dest are in the same region and the source is a capability
@@ -825,6 +874,7 @@ AtomicSimpleNCacheCPU::tick()
 
                 InstStateMachinePtr sm = rv_inst->getStateMachine(&t_info);
                 sm->atomicExec(&t_info);
+                sm->release();
 
                 // keep an instruction count
                 if (fault == NoFault) {
@@ -857,6 +907,9 @@ AtomicSimpleNCacheCPU::tick()
             if (simulate_data_stalls && dcache_access)
                 stall_ticks += dcache_latency;
 
+            if (simulate_ncache_stalls)
+                stall_ticks += ncache_latency;
+
             if (stall_ticks) {
                 // the atomic cpu does its accounting in ticks, so
                 // keep counting in ticks but round to the clock
@@ -866,6 +919,11 @@ AtomicSimpleNCacheCPU::tick()
             }
 
         }
+        if (fault != NoFault) {
+            // the next instruction is the handler's
+            predecodeBlock = nullptr;
+            recordBlock = nullptr;
+        }
         if (fault != NoFault || !t_info.stayAtPC)
             advancePC(fault);
     }
@@ -922,20 +980,29 @@ Port& AtomicSimpleNCacheCPU::getPort(const std::string& name, PortID idx) {
 
 PacketPtr
 AtomicSimpleNCacheCPU::sendNCacheCommandAtomic(NodeControllerCommand* cmd) {
-    RequestPtr ncache_req = std::make_shared<Request>();
-    PacketPtr ncache_pkt = Packet::createRead(ncache_req);
-    ncache_pkt->dataStatic<NodeControllerCommand>(cmd);
+    PacketPtr ncache_pkt = ncachePacketPool.acquire(MemCmd::ReadReq,
+            dataRequestorId());
+    ncache_pkt->setRaw<NodeControllerCommandPtr>(cmd);
 
-    // TODO: count the ticks
-    ncache_port.sendAtomic(ncache_pkt);
+    ncache_latency += ncache_port.sendAtomic(ncache_pkt);
 
     return ncache_pkt;
 }
 
+void
+AtomicSimpleNCacheCPU::issueNCacheCommandAtomic(NodeControllerCommand* cmd) {
+    ncachePacketPool.release(sendNCacheCommandAtomic(cmd));
+}
+
 
 void
 AtomicSimpleNCacheCPU::preOverwriteDest(NodeID* nodes, 
         int* node_n, SimpleExecContext& t_info, StaticInst* inst) {
+    // the sources holding capabilities
+    uint64_t cap_regs = static_cast<RiscvStaticInst*>(inst)->intSrcMask() &
+        node_controller->capTrackRegMask(t_info.thread->contextId());
+    if(cap_regs == 0)
+        return;
     int num_src = curStaticInst->numSrcRegs();
     DPRINTF(CapstoneNodeOps, "num_src = %d\n", num_src);
     // before execution
@@ -945,8 +1012,10 @@ AtomicSimpleNCacheCPU::preOverwriteDest(NodeID* nodes,
         if(src_id.classValue() != RegClassType::IntRegClass)
             continue;
         RegIndex src_idx = src_id.index();
+        if(!(cap_regs & ((uint64_t)1 << src_idx)))
+            continue;
         DPRINTF(CapstoneNodeOps, "Source %d = %d\n", i, src_idx);
-        CapLoc loc = CapLoc::makeReg(t_info.thread->threadId(), src_idx);
+        CapLoc loc = CapLoc::makeReg(t_info.thread->contextId(), src_idx);
         NodeID node_id = node_controller->queryCapTrack(loc);
         if(node_id == NODE_ID_INVALID)
             continue;
@@ -961,7 +1030,7 @@ AtomicSimpleNCacheCPU::preOverwriteDest(NodeID* nodes,
 
 void
 AtomicSimpleNCacheCPU::overwriteIntReg(NodeID* nodes, int* node_n, ThreadContext* tc, int reg_idx) {
-    CapLoc loc = CapLoc::makeReg(tc->threadId(), reg_idx);
+    CapLoc loc = CapLoc::makeReg(tc->contextId(), reg_idx);
     NodeID node_id = node_controller->queryCapTrack(loc);
     if(node_id != NODE_ID_INVALID) {
         nodes[(*node_n) ++] = node_id;
@@ -974,6 +1043,10 @@ void
 AtomicSimpleNCacheCPU::capCheckAtomic(SimpleExecContext& t_info,
         StaticInst* inst, Addr addr) {
     DPRINTF(CapstoneNodeOps, "To issue cap check 0x%llx\n", addr);
+    if((static_cast<RiscvStaticInst*>(inst)->intSrcMask() &
+                node_controller->capTrackRegMask(
+                    t_info.tcBase()->contextId())) == 0)
+        return;
     int num_src = inst->numSrcRegs();
     for(int i = 0; i < num_src; i ++){
         const RegId& src_id = inst->srcRegIdx(i);
@@ -982,18 +1055,42 @@ AtomicSimpleNCacheCPU::capCheckAtomic(SimpleExecContext& t_info,
         RegIndex src_idx = src_id.index();
         RegVal src_val = t_info.getRegOperand(inst, i);
         NodeID node_id = node_controller->queryCapTrack(
-                CapLoc::makeReg(t_info.tcBase()->threadId(), src_idx));
+                CapLoc::makeReg(t_info.tcBase()->contextId(), src_idx));
         if(node_id == NODE_ID_INVALID ||
-                !node_controller->node2Obj[node_id].contains(addr))
+                !node_controller->node2Obj.get(node_id).contains(addr))
             continue;
         DPRINTF(CapstoneNodeOps, "Issued cap check %u\n", node_id);
-        delete sendNCacheCommandAtomic(new NodeControllerQuery(node_id));
+        issueNCacheCommandAtomic(node_controller->newCommand<NodeControllerQuery>(node_id));
         break;
     }
 }
 
+void
+AtomicSimpleNCacheCPU::clearMemCaps(Addr addr, Addr size) {
+    node_controller->removeCapTrackRange(addr, size, [this](NodeID node_id) {
+        DPRINTF(CapstoneNodeOps, "capability of node %u overwritten\n", node_id);
+        issueNCacheCommandAtomic(
+                node_controller->newCommand<NodeControllerRcUpdate>(node_id, -1));
+    });
+}
+
+void
+AtomicSimpleNCacheCPU::copyMemCaps(Addr dst, Addr src, Addr size) {
+    DPRINTF(CapstoneNodeOps, "bulk copy %llx -> %llx (%llu bytes)\n",
+            src, dst, size);
+    node_controller->copyCapTrackRange(dst, src, size,
+            [this](NodeID node_id, int delta) {
+        issueNCacheCommandAtomic(
+                node_controller->newCommand<NodeControllerRcUpdate>(node_id, delta));
+    });
+}
+
 void
 AtomicSimpleNCacheCPU::cleanupDest(SimpleExecContext& t_info, StaticInst* inst) {
+    if((static_cast<RiscvStaticInst*>(inst)->intDestMask() &
+                node_controller->capTrackRegMask(
+                    t_info.thread->contextId())) == 0)
+        return;
     int num_dest = curStaticInst->numDestRegs();
     // before execution
     // check which destinations will be overwritten
@@ -1002,17 +1099,127 @@ AtomicSimpleNCacheCPU::cleanupDest(SimpleExecContext& t_info, StaticInst* inst)
         if(dest_id.classValue() != RegClassType::IntRegClass)
             continue;
         RegIndex dest_idx = dest_id.index();
-        CapLoc loc = CapLoc::makeReg(t_info.thread->threadId(), dest_idx);
+        CapLoc loc = CapLoc::makeReg(t_info.thread->contextId(), dest_idx);
         NodeID node_id = node_controller->queryCapTrack(loc);
         if(node_id == NODE_ID_INVALID)
             continue;
         node_controller->removeCapTrack(loc);
-        delete sendNCacheCommandAtomic(new NodeControllerRcUpdate(node_id, -1));
+        issueNCacheCommandAtomic(node_controller->newCommand<NodeControllerRcUpdate>(node_id, -1));
         //node_id = node_controller->queryCapTrack(loc);
         //panic_if(node_id != NODE_ID_INVALID, "erase failed");
     }
 }
 
+const AtomicSimpleNCacheCPU::PredecodedInst*
+AtomicSimpleNCacheCPU::nextPredecoded(Addr pc) {
+    // a block never leaves its page and ends with anything that could
+    // change the translation, so the rest of it needs no translation
+    if(predecodeBlock == nullptr ||
+            predecodeGen != predecodeCache.generation() ||
+            pc != predecodeNextPC ||
+            predecodeIndex >= predecodeBlock->entries.size()) {
+        predecodeBlock = nullptr;
+        return nullptr;
+    }
+    const PredecodedInst& inst =
+        predecodeBlock->entries[predecodeIndex ++].value;
+    predecodeNextPC += inst.compressed ? 2 : 4;
+    return &inst;
+}
+
+const AtomicSimpleNCacheCPU::PredecodedInst*
+AtomicSimpleNCacheCPU::lookupPredecoded(Addr paddr, Addr pc) {
+    InstBlockCache::Block* block = predecodeCache.lookup(paddr);
+    if(block == nullptr) {
+        return nullptr;
+    }
+    // stop recording, the rest is decoded already
+    recordBlock = nullptr;
+    predecodeBlock = block;
+    predecodeGen = predecodeCache.generation();
+    predecodeIndex = 0;
+    predecodeNextPC = pc;
+    return nextPredecoded(pc);
+}
 
+void
+AtomicSimpleNCacheCPU::recordPredecoded(Addr paddr) {
+    SimpleExecContext& t_info = *threadInfo[curThread];
+    // instructions that took more than one fetch are left out
+    if(!curStaticInst || curMacroStaticInst || t_info.stayAtPC) {
+        recordBlock = nullptr;
+        return;
+    }
+    if(recordBlock == nullptr || recordGen != predecodeCache.generation() ||
+            recordBlock->closed || recordBlock->end != paddr) {
+        recordBlock = predecodeCache.open(paddr);
+        recordGen = predecodeCache.generation();
+        ++ predecodeStats.blocks;
+    }
+
+    PredecodedInst inst;
+    inst.inst = curStaticInst;
+    inst.compressed = t_info.thread->pcState().as<PCState>().compressed();
+
+    // the block ends where the next PC or the translation may change
+    bool last = curStaticInst->isControl() ||
+        curStaticInst->isSyscall() ||
+        curStaticInst->isSerializing() ||
+        curStaticInst->isNonSpeculative() ||
+        curStaticInst->isSquashAfter();
+    if(predecodeCache.append(recordBlock, inst.compressed ? 2 : 4, inst,
+                last)) {
+        recordBlock = nullptr;
+    }
+}
+
+void
+AtomicSimpleNCacheCPU::preExecutePredecoded(const PredecodedInst& inst) {
+    SimpleExecContext& t_info = *threadInfo[curThread];
+    SimpleThread* thread = t_info.thread;
+
+    t_info.setPredicate(true);
+    t_info.setMemAccPredicate(true);
+
+    // what the decoder does to the PC
+    set(preExecuteTempPC, thread->pcState());
+    auto& pc_state = preExecuteTempPC->as<PCState>();
+    pc_state.npc(pc_state.instAddr() + (inst.compressed ? 2 : 4));
+    pc_state.compressed(inst.compressed);
+    thread->pcState(pc_state);
+
+    t_info.stayAtPC = false;
+    curStaticInst = inst.inst;
+    ++ predecodeStats.insts;
+
+#if TRACING_ON
+    traceData = tracer->getInstRecord(curTick(), thread->getTC(),
+            curStaticInst, thread->pcState(), curMacroStaticInst);
+#endif // TRACING_ON
+
+    if(branchPred && curStaticInst->isControl()) {
+        // Use a fake sequence number since we only have one
+        // instruction in flight at the same time.
+        const InstSeqNum cur_sn(0);
+        set(t_info.predPC, thread->pcState());
+        if(branchPred->predict(curStaticInst, cur_sn, *t_info.predPC,
+                    curThread)) {
+            ++ t_info.execContextStats.numPredictedBranches;
+        }
+    }
+}
+
+void
+AtomicSimpleNCacheCPU::invalidatePredecoded(Addr paddr, Addr size) {
+    if(!predecodeCache.enabled()) {
+        return;
+    }
+    size_t dropped = predecodeCache.invalidate(paddr, size);
+    if(dropped != 0) {
+        DPRINTF(SimpleCPU, "write to %#x dropped %d decoded blocks\n",
+                paddr, dropped);
+        predecodeStats.invalidations += dropped;
+    }
+}
 
 } // namespace gem5
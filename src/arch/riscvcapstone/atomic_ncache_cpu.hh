@@ -42,7 +42,9 @@
 #define __CPU_SIMPLE_ATOMIC_NCACHE_HH__
 
 #include "cpu/simple/base.hh"
+#include "arch/riscvcapstone/insts/static_inst.hh"
 #include "arch/riscvcapstone/node_controller.hh"
+#include "arch/riscvcapstone/predecode_cache.hh"
 #include "arch/riscvcapstone/typing.hh"
 #include "cpu/simple/exec_context.hh"
 #include "mem/request.hh"
@@ -68,6 +70,7 @@ class AtomicSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
     bool locked;
     const bool simulate_data_stalls;
     const bool simulate_inst_stalls;
+    const bool simulate_ncache_stalls;
 
     // main simulation loop (one cycle)
     void tick();
@@ -173,6 +176,9 @@ class AtomicSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
     bool dcache_access;
     Tick dcache_latency;
 
+    // node controller latency of the current instruction
+    Tick ncache_latency;
+
     /** Probe Points. */
     ProbePointArg<std::pair<SimpleThread *, const StaticInstPtr>> *ppCommit;
     void preOverwriteDest(NodeID* nodes, int* node_n, 
@@ -184,6 +190,50 @@ class AtomicSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
     void capCheckAtomic(SimpleExecContext& t_info,
                 StaticInst* inst, Addr addr);
 
+    // an instruction of a decoded basic block
+    struct PredecodedInst
+    {
+        StaticInstPtr inst;
+        bool compressed;
+    };
+    typedef PredecodeCache<PredecodedInst> InstBlockCache;
+
+    InstBlockCache predecodeCache;
+    // the next instruction of the block being run from predecodeCache
+    InstBlockCache::Block* predecodeBlock;
+    size_t predecodeIndex;
+    Addr predecodeNextPC; // virtual
+    uint64_t predecodeGen;
+    // the block newly decoded instructions are appended to
+    InstBlockCache::Block* recordBlock;
+    uint64_t recordGen;
+
+    struct PredecodeStats : public statistics::Group {
+        PredecodeStats(statistics::Group* parent) :
+            statistics::Group(parent, "predecode"),
+            ADD_STAT(insts, "Number of instructions run from decoded "
+                    "blocks"),
+            ADD_STAT(blocks, "Number of blocks decoded"),
+            ADD_STAT(invalidations, "Number of blocks dropped by writes to "
+                    "their pages")
+        {}
+
+        statistics::Scalar insts;
+        statistics::Scalar blocks;
+        statistics::Scalar invalidations;
+    } predecodeStats;
+
+    // the instruction at pc if it follows the previous one in its block
+    const PredecodedInst* nextPredecoded(Addr pc);
+    // the first instruction of the block at paddr (pc is its virtual
+    // address), if there is one
+    const PredecodedInst* lookupPredecoded(Addr paddr, Addr pc);
+    // appends the instruction preExecute just decoded at paddr
+    void recordPredecoded(Addr paddr);
+    // same as preExecute, without fetching and decoding
+    void preExecutePredecoded(const PredecodedInst& inst);
+    void invalidatePredecoded(Addr paddr, Addr size);
+
   protected:
 
     /** Return a reference to the data port. */
@@ -271,8 +321,12 @@ class AtomicSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
 
     Port &getNodePort() override { return ncache_port; }
     NodeController* getNodeController() override { return node_controller; }
+    void clearMemCaps(Addr addr, Addr size) override;
+    void copyMemCaps(Addr dst, Addr src, Addr size) override;
 
     PacketPtr sendNCacheCommandAtomic(NodeControllerCommand* cmd);
+    // for commands whose response carries nothing of interest
+    void issueNCacheCommandAtomic(NodeControllerCommand* cmd);
 };
 
 } // namespace gem5::RiscvcapstoneISA
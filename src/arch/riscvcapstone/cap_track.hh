@@ -1,10 +1,22 @@
 #ifndef CAP_TRACK_H
 #define CAP_TRACK_H
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "arch/riscvcapstone/regs/int.hh"
 #include "arch/riscvcapstone/types.hh"
+#include "base/bitfield.hh"
+#include "base/types.hh"
 
 namespace gem5::RiscvcapstoneISA {
 
+const NodeID NODE_ID_INVALID = (NodeID)(-1ULL & ((1ULL << 31) - 1));
+
 struct CapLocMem {
     Addr addr;
 };
@@ -14,7 +26,7 @@ inline bool operator < (const CapLocMem& a, const CapLocMem& b) {
 }
 
 struct CapLocReg {
-    int threadId;
+    int threadId; // context ID, unique across the CPUs of the system
     RegIndex regId;
 };
 
@@ -73,7 +85,503 @@ inline bool operator < (const CapLoc& a, const CapLoc& b) {
     return a.pos.reg < b.pos.reg;
 }
 
-typedef std::map<CapLoc, NodeID> CapTrackMap;
+/**
+ * Shadow tags of memory: one bit per 8-byte granule, set if a capability
+ * in memory overlaps the granule. Tags are kept in page-granular chunks
+ * that are only allocated for pages holding capabilities, and dropped
+ * once their last tag is cleared.
+ *
+ * Answers "does this access touch any capability?" in O(1) for the
+ * accesses of loads and stores, without a lookup in the tracking table.
+ * */
+class CapTagBitmap {
+    public:
+        static const unsigned int GRANULE_BITS = 3;
+        static const unsigned int PAGE_BITS = 12;
+        static const Addr GRANULES_PER_PAGE = 1ULL << (PAGE_BITS - GRANULE_BITS);
+
+    private:
+        struct Page {
+            std::array<uint64_t, GRANULES_PER_PAGE / 64> bits;
+            unsigned int count; // number of tags set
+        };
+
+        std::unordered_map<Addr, Page> pages; // by page number
+        // the last page looked up, pages do not move in the map
+        mutable Addr lastPageNum;
+        mutable Page* lastPage;
+
+        Page*
+        findPage(Addr page_num) const {
+            if(lastPage != nullptr && lastPageNum == page_num) {
+                return lastPage;
+            }
+            auto it = pages.find(page_num);
+            if(it == pages.end()) {
+                return nullptr;
+            }
+            lastPageNum = page_num;
+            lastPage = const_cast<Page*>(&it->second);
+            return lastPage;
+        }
+
+        // calls f(page, first, last) for the granules in [first, last)
+        // of each allocated page, stops when f returns true
+        template<typename F>
+        bool
+        forPages(Addr first, Addr last, F f) const {
+            Addr g = first;
+            while(g < last) {
+                Addr page_num = g / GRANULES_PER_PAGE;
+                Addr page_end = std::min(last, (page_num + 1) * GRANULES_PER_PAGE);
+                const Page* page = findPage(page_num);
+                if(page != nullptr && f(*page, g, page_end)) {
+                    return true;
+                }
+                g = page_end;
+            }
+            return false;
+        }
+
+        // the bits for granules [g, end) in the word holding g
+        static uint64_t
+        wordMask(Addr g, Addr end) {
+            unsigned int bit = g % 64;
+            Addr n = std::min<Addr>(64 - bit, end - g);
+            return (n == 64 ? ~0ULL : ((1ULL << n) - 1)) << bit;
+        }
+
+    public:
+        CapTagBitmap() : lastPageNum(0), lastPage(nullptr) {}
+
+        static Addr
+        granule(Addr addr) {
+            return addr >> GRANULE_BITS;
+        }
+
+        void
+        set(Addr g) {
+            Page& page = pages[g / GRANULES_PER_PAGE];
+            uint64_t& word = page.bits[(g % GRANULES_PER_PAGE) / 64];
+            uint64_t bit = 1ULL << (g % 64);
+            if(!(word & bit)) {
+                word |= bit;
+                ++ page.count;
+            }
+        }
+
+        void
+        clear(Addr g) {
+            Page* page = findPage(g / GRANULES_PER_PAGE);
+            if(page == nullptr) {
+                return;
+            }
+            uint64_t& word = page->bits[(g % GRANULES_PER_PAGE) / 64];
+            uint64_t bit = 1ULL << (g % 64);
+            if(word & bit) {
+                word &= ~bit;
+                if(-- page->count == 0) {
+                    pages.erase(g / GRANULES_PER_PAGE);
+                    lastPage = nullptr;
+                }
+            }
+        }
+
+        bool
+        test(Addr g) const {
+            const Page* page = findPage(g / GRANULES_PER_PAGE);
+            return page != nullptr &&
+                (page->bits[(g % GRANULES_PER_PAGE) / 64] >> (g % 64) & 1);
+        }
+
+        // whether any byte of [addr, addr + size) is tagged
+        bool
+        any(Addr addr, Addr size) const {
+            if(size == 0 || pages.empty()) {
+                return false;
+            }
+            return forPages(granule(addr), granule(addr + size - 1) + 1,
+                    [](const Page& page, Addr g, Addr end) {
+                while(g < end) {
+                    Addr next = std::min<Addr>(end, (g / 64 + 1) * 64);
+                    if(page.bits[(g % GRANULES_PER_PAGE) / 64] &
+                            wordMask(g, next)) {
+                        return true;
+                    }
+                    g = next;
+                }
+                return false;
+            });
+        }
+
+        // calls f(g) for each tagged granule overlapping [addr, addr + size)
+        template<typename F>
+        void
+        forEach(Addr addr, Addr size, F f) const {
+            if(size == 0 || pages.empty()) {
+                return;
+            }
+            forPages(granule(addr), granule(addr + size - 1) + 1,
+                    [&f](const Page& page, Addr g, Addr end) {
+                while(g < end) {
+                    Addr next = std::min<Addr>(end, (g / 64 + 1) * 64);
+                    uint64_t word = page.bits[(g % GRANULES_PER_PAGE) / 64] &
+                        wordMask(g, next);
+                    while(word != 0) {
+                        int bit = findLsbSet(word);
+                        word &= word - 1;
+                        f(g / 64 * 64 + bit);
+                    }
+                    g = next;
+                }
+                return false;
+            });
+        }
+
+        // number of pages with tags
+        size_t
+        pageCount() const {
+            return pages.size();
+        }
+
+        void
+        clearAll() {
+            pages.clear();
+            lastPage = nullptr;
+        }
+};
+
+/**
+ * Records the revocation node associated with each location (register or
+ * memory) that holds a capability.
+ *
+ * Registers are kept in a flat array per thread, along with a mask of the
+ * registers holding capabilities. Memory locations are kept
+ * in an open-addressing hash table (linear probing, backward-shift
+ * deletion), so that adding or removing a location does not allocate.
+ * The table only reallocates when it grows past half occupancy.
+ *
+ * Memory capabilities are CAP_SIZE bytes long and tagged in a CapTagBitmap,
+ * which filters out memory queries and lets writes of any size and
+ * alignment find the capabilities they overwrite.
+ * */
+class CapTrackTable {
+    public:
+        static const Addr CAP_SIZE = sizeof(RegVal);
+
+    private:
+        struct MemEntry {
+            Addr addr;
+            NodeID node; // NODE_ID_INVALID for an empty slot
+        };
+
+        typedef std::array<NodeID, NumIntRegs> RegFile;
+        static_assert(NumIntRegs <= 64, "register masks are 64-bit");
+
+        std::vector<RegFile> regs; // indexed by thread ID
+        std::vector<uint64_t> regMasks; // same, one bit per register
+        std::vector<MemEntry> mem; // capacity is always a power of two
+        size_t memCount;
+        unsigned int memShift; // 64 - log2(capacity)
+        CapTagBitmap tags;
+        size_t memUnaligned; // capabilities spanning two granules
+
+        size_t
+        memHome(Addr addr) const {
+            // Fibonacci hashing, take the high bits of the product
+            return (size_t)(((uint64_t)addr * 0x9e3779b97f4a7c15ULL) >> memShift);
+        }
+
+        size_t
+        memMask() const {
+            return mem.size() - 1;
+        }
+
+        // returns the slot holding addr, or the empty slot where it belongs
+        size_t
+        memFind(Addr addr) const {
+            size_t i = memHome(addr);
+            while(mem[i].node != NODE_ID_INVALID && mem[i].addr != addr) {
+                i = (i + 1) & memMask();
+            }
+            return i;
+        }
+
+        void
+        memResize(size_t capacity) {
+            std::vector<MemEntry> old(capacity, MemEntry{0, NODE_ID_INVALID});
+            old.swap(mem);
+            memShift = 64;
+            for(size_t c = capacity; c > 1; c >>= 1) {
+                -- memShift;
+            }
+            for(const MemEntry& e : old) {
+                if(e.node != NODE_ID_INVALID) {
+                    mem[memFind(e.addr)] = e;
+                }
+            }
+        }
+
+        NodeID&
+        regSlot(int thread_id, RegIndex reg_id) {
+            assert(thread_id >= 0 && reg_id < NumIntRegs);
+            if((size_t)thread_id >= regs.size()) {
+                RegFile empty;
+                empty.fill(NODE_ID_INVALID);
+                regs.resize(thread_id + 1, empty);
+                regMasks.resize(thread_id + 1, 0);
+            }
+            return regs[thread_id][reg_id];
+        }
+
+        static bool
+        aligned(Addr addr) {
+            return addr % CAP_SIZE == 0;
+        }
+
+        // whether a capability still overlaps the granule
+        bool
+        memCovers(Addr g) const {
+            Addr start = g << CapTagBitmap::GRANULE_BITS;
+            Addr from = start < CAP_SIZE - 1 ? 0 : start - (CAP_SIZE - 1);
+            for(Addr a = from; a < start + CAP_SIZE; ++ a) {
+                if(mem[memFind(a)].node != NODE_ID_INVALID) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void
+        memAdd(Addr addr, NodeID node_id) {
+            if((memCount + 1) * 2 > mem.size()) {
+                memResize(mem.size() * 2);
+            }
+            size_t i = memFind(addr);
+            if(mem[i].node == NODE_ID_INVALID) {
+                ++ memCount;
+                tags.set(CapTagBitmap::granule(addr));
+                if(!aligned(addr)) {
+                    tags.set(CapTagBitmap::granule(addr + CAP_SIZE - 1));
+                    ++ memUnaligned;
+                }
+            }
+            mem[i].addr = addr;
+            mem[i].node = node_id;
+        }
+
+        void
+        memRemove(Addr addr) {
+            size_t i = memFind(addr);
+            if(mem[i].node == NODE_ID_INVALID) {
+                return;
+            }
+            memErase(i);
+            if(!aligned(addr)) {
+                -- memUnaligned;
+            }
+            // with aligned capabilities only, no other one shares the granule
+            Addr first = CapTagBitmap::granule(addr);
+            Addr last = CapTagBitmap::granule(addr + CAP_SIZE - 1);
+            for(Addr g = first; g <= last; ++ g) {
+                if(memUnaligned == 0 || !memCovers(g)) {
+                    tags.clear(g);
+                }
+            }
+        }
+
+        // appends the capabilities overlapping [addr, addr + size) to caps,
+        // or only the ones entirely inside if inside is set
+        void
+        memCollect(Addr addr, Addr size, bool inside,
+                std::vector<MemEntry>& caps) const {
+            // a capability overlapping the range starts in a tagged granule
+            Addr from = addr < CAP_SIZE - 1 ? 0 : addr - (CAP_SIZE - 1);
+            Addr step = memUnaligned == 0 ? CAP_SIZE : 1;
+            tags.forEach(from, addr + size - from, [&](Addr g) {
+                Addr start = g << CapTagBitmap::GRANULE_BITS;
+                for(Addr a = start; a < start + CAP_SIZE; a += step) {
+                    if(inside ? (a < addr || a + CAP_SIZE > addr + size) :
+                            (a + CAP_SIZE <= addr || a >= addr + size)) {
+                        continue;
+                    }
+                    NodeID node_id = mem[memFind(a)].node;
+                    if(node_id != NODE_ID_INVALID) {
+                        caps.push_back(MemEntry{a, node_id});
+                    }
+                }
+            });
+        }
+
+        void
+        memErase(size_t i) {
+            -- memCount;
+            // shift back the entries that probed past the removed slot
+            size_t j = i;
+            while(true) {
+                j = (j + 1) & memMask();
+                if(mem[j].node == NODE_ID_INVALID) {
+                    break;
+                }
+                size_t k = memHome(mem[j].addr);
+                bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+                if(!stays) {
+                    mem[i] = mem[j];
+                    i = j;
+                }
+            }
+            mem[i].node = NODE_ID_INVALID;
+        }
+
+    public:
+        CapTrackTable(size_t mem_capacity = 1024) :
+            memCount(0), memUnaligned(0) {
+            size_t capacity = 2;
+            while(capacity < mem_capacity) {
+                capacity <<= 1;
+            }
+            memResize(capacity);
+        }
+
+        NodeID
+        query(const CapLoc& loc) const {
+            if(loc.type == CapLoc::CAP_TRACK_REG) {
+                if((size_t)loc.pos.reg.threadId >= regs.size()) {
+                    return NODE_ID_INVALID;
+                }
+                return regs[loc.pos.reg.threadId][loc.pos.reg.regId];
+            }
+            if(!tags.test(CapTagBitmap::granule(loc.pos.mem.addr))) {
+                return NODE_ID_INVALID;
+            }
+            return mem[memFind(loc.pos.mem.addr)].node;
+        }
+
+        // whether [addr, addr + size) might overlap a capability, i.e.,
+        // shares a granule with one; O(1) for the accesses of loads and stores
+        bool
+        memTouches(Addr addr, Addr size) const {
+            return tags.any(addr, size);
+        }
+
+        /**
+         * Removes all memory capabilities overlapping [addr, addr + size),
+         * e.g., those partially or fully overwritten by a write, and
+         * calls f(addr, node_id) for each of them.
+         * */
+        template<typename F>
+        void
+        removeMemRange(Addr addr, Addr size, F f) {
+            if(!memTouches(addr, size)) {
+                return;
+            }
+            std::vector<MemEntry> removed;
+            memCollect(addr, size, false, removed);
+            for(const MemEntry& e : removed) {
+                memRemove(e.addr);
+                f(e.addr, e.node);
+            }
+        }
+
+        /**
+         * Copies the capabilities that lie entirely in [src, src + size)
+         * to the same offsets in [dst, dst + size), like memmove does with
+         * the data. The capabilities overlapping the destination are
+         * removed first, and reported through removed(addr, node_id).
+         * copied(addr, node_id) is called for each new copy.
+         * */
+        template<typename R, typename C>
+        void
+        copyMemRange(Addr dst, Addr src, Addr size, R removed, C copied) {
+            std::vector<MemEntry> caps;
+            if(memTouches(src, size)) {
+                memCollect(src, size, true, caps);
+            }
+            // the ranges may overlap, so the sources are read first
+            removeMemRange(dst, size, removed);
+            for(const MemEntry& e : caps) {
+                Addr addr = dst + (e.addr - src);
+                memAdd(addr, e.node);
+                copied(addr, e.node);
+            }
+        }
+
+        void
+        add(const CapLoc& loc, NodeID node_id) {
+            assert(node_id != NODE_ID_INVALID);
+            if(loc.type == CapLoc::CAP_TRACK_REG) {
+                regSlot(loc.pos.reg.threadId, loc.pos.reg.regId) = node_id;
+                regMasks[loc.pos.reg.threadId] |=
+                    (uint64_t)1 << loc.pos.reg.regId;
+            } else {
+                memAdd(loc.pos.mem.addr, node_id);
+            }
+        }
+
+        void
+        remove(const CapLoc& loc) {
+            if(loc.type == CapLoc::CAP_TRACK_REG) {
+                if((size_t)loc.pos.reg.threadId < regs.size()) {
+                    regs[loc.pos.reg.threadId][loc.pos.reg.regId] =
+                        NODE_ID_INVALID;
+                    regMasks[loc.pos.reg.threadId] &=
+                        ~((uint64_t)1 << loc.pos.reg.regId);
+                }
+            } else {
+                memRemove(loc.pos.mem.addr);
+            }
+        }
+
+        // registers of the thread holding capabilities, one bit per
+        // register index, so that instructions can skip the queries
+        uint64_t
+        regMask(int thread_id) const {
+            return (size_t)thread_id < regMasks.size() ?
+                regMasks[thread_id] : 0;
+        }
+
+        // number of memory locations holding capabilities
+        size_t
+        memSize() const {
+            return memCount;
+        }
+
+        // calls f(loc, node_id) for every tracked location
+        template<typename F>
+        void
+        forEach(F f) const {
+            for(size_t t = 0; t < regs.size(); ++ t) {
+                for(RegIndex r = 0; r < NumIntRegs; ++ r) {
+                    if(regs[t][r] != NODE_ID_INVALID) {
+                        f(CapLoc::makeReg((int)t, r), regs[t][r]);
+                    }
+                }
+            }
+            for(const MemEntry& e : mem) {
+                if(e.node != NODE_ID_INVALID) {
+                    f(CapLoc::makeMem(e.addr), e.node);
+                }
+            }
+        }
+
+        // number of pages holding capabilities
+        size_t
+        memPageCount() const {
+            return tags.pageCount();
+        }
+
+        void
+        clear() {
+            regs.clear();
+            regMasks.clear();
+            tags.clearAll();
+            memUnaligned = 0;
+            memCount = 0;
+            for(MemEntry& e : mem) {
+                e.node = NODE_ID_INVALID;
+            }
+        }
+};
 
 }
 
@@ -0,0 +1,361 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+
+#include "arch/riscvcapstone/cap_track.hh"
+
+using namespace gem5;
+using namespace gem5::RiscvcapstoneISA;
+
+namespace {
+
+// the map-based tracking used before CapTrackTable, kept as a reference
+typedef std::map<CapLoc, NodeID> RefCapTrackMap;
+
+NodeID
+refQuery(const RefCapTrackMap& map, const CapLoc& loc) {
+    try {
+        return map.at(loc);
+    } catch(const std::out_of_range& e) {
+        return NODE_ID_INVALID;
+    }
+}
+
+} // anonymous namespace
+
+TEST(CapTrackTableTest, Empty)
+{
+    CapTrackTable table;
+    EXPECT_EQ(table.query(CapLoc::makeReg(0, 10)), NODE_ID_INVALID);
+    EXPECT_EQ(table.query(CapLoc::makeReg(3, 10)), NODE_ID_INVALID);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), NODE_ID_INVALID);
+    EXPECT_EQ(table.memSize(), 0);
+    EXPECT_EQ(table.regMask(0), 0);
+}
+
+TEST(CapTrackTableTest, Registers)
+{
+    CapTrackTable table;
+    table.add(CapLoc::makeReg(0, 10), 5);
+    table.add(CapLoc::makeReg(1, 10), 6);
+    EXPECT_EQ(table.query(CapLoc::makeReg(0, 10)), 5);
+    EXPECT_EQ(table.query(CapLoc::makeReg(1, 10)), 6);
+    EXPECT_EQ(table.query(CapLoc::makeReg(0, 11)), NODE_ID_INVALID);
+
+    table.add(CapLoc::makeReg(0, 10), 7);
+    table.add(CapLoc::makeReg(0, NumIntRegs - 1), 8);
+    EXPECT_EQ(table.query(CapLoc::makeReg(0, 10)), 7);
+    EXPECT_EQ(table.regMask(0),
+            (1ULL << 10) | (1ULL << (NumIntRegs - 1)));
+    EXPECT_EQ(table.regMask(1), 1ULL << 10);
+
+    table.remove(CapLoc::makeReg(0, 10));
+    EXPECT_EQ(table.query(CapLoc::makeReg(0, 10)), NODE_ID_INVALID);
+    EXPECT_EQ(table.query(CapLoc::makeReg(1, 10)), 6);
+    EXPECT_EQ(table.regMask(0), 1ULL << (NumIntRegs - 1));
+
+    // removing an untracked register of an unknown thread is a no-op
+    table.remove(CapLoc::makeReg(8, 1));
+    EXPECT_EQ(table.memSize(), 0);
+}
+
+TEST(CapTrackTableTest, Memory)
+{
+    CapTrackTable table;
+    table.add(CapLoc::makeMem(0x1000), 1);
+    table.add(CapLoc::makeMem(0x1008), 2);
+    EXPECT_EQ(table.memSize(), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), 1);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1008)), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1010)), NODE_ID_INVALID);
+
+    table.add(CapLoc::makeMem(0x1000), 3);
+    EXPECT_EQ(table.memSize(), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), 3);
+
+    table.remove(CapLoc::makeMem(0x1000));
+    table.remove(CapLoc::makeMem(0x2000));
+    EXPECT_EQ(table.memSize(), 1);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), NODE_ID_INVALID);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1008)), 2);
+
+    // registers and memory do not alias
+    EXPECT_EQ(table.query(CapLoc::makeReg(0, 8)), NODE_ID_INVALID);
+}
+
+TEST(CapTrackTableTest, ForEachAndClear)
+{
+    CapTrackTable table;
+    table.add(CapLoc::makeReg(1, 10), 5);
+    table.add(CapLoc::makeMem(0x1000), 6);
+    table.add(CapLoc::makeMem(0x2000), 7);
+
+    RefCapTrackMap seen;
+    table.forEach([&](const CapLoc& loc, NodeID node_id) {
+        seen[loc] = node_id;
+    });
+    EXPECT_EQ(seen.size(), 3);
+    EXPECT_EQ(refQuery(seen, CapLoc::makeReg(1, 10)), 5);
+    EXPECT_EQ(refQuery(seen, CapLoc::makeMem(0x2000)), 7);
+
+    table.clear();
+    EXPECT_EQ(table.memSize(), 0);
+    EXPECT_EQ(table.query(CapLoc::makeReg(1, 10)), NODE_ID_INVALID);
+    EXPECT_EQ(table.regMask(1), 0);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), NODE_ID_INVALID);
+    table.add(CapLoc::makeMem(0x1000), 8);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), 8);
+}
+
+/** Random operations checked against the map-based implementation,
+ * with enough entries to force the hash table to grow several times
+ * and with deletions in the middle of probe chains */
+TEST(CapTrackTableTest, MatchesMap)
+{
+    CapTrackTable table(4);
+    RefCapTrackMap ref;
+    std::mt19937_64 rng(1234);
+
+    for (int i = 0; i < 200000; i++) {
+        CapLoc loc;
+        if (rng() % 4 == 0) {
+            loc = CapLoc::makeReg(rng() % 4, rng() % NumIntArchRegs);
+        } else {
+            loc = CapLoc::makeMem(0x10000 + (rng() % 8192) * 8);
+        }
+        switch (rng() % 3) {
+          case 0:
+          {
+            NodeID node_id = rng() % 1000;
+            table.add(loc, node_id);
+            ref[loc] = node_id;
+            break;
+          }
+          case 1:
+            table.remove(loc);
+            ref.erase(loc);
+            break;
+          default:
+            ASSERT_EQ(table.query(loc), refQuery(ref, loc));
+        }
+    }
+
+    size_t ref_mem = 0;
+    for (const auto& entry : ref) {
+        ASSERT_EQ(table.query(entry.first), entry.second);
+        if (entry.first.type == CapLoc::CAP_TRACK_MEM)
+            ref_mem++;
+    }
+    EXPECT_EQ(table.memSize(), ref_mem);
+}
+
+TEST(CapTagBitmapTest, AnyAndForEach)
+{
+    CapTagBitmap tags;
+    EXPECT_FALSE(tags.any(0, 1 << 20));
+
+    // granules on both sides of a word and of a page boundary
+    tags.set(CapTagBitmap::granule(0x1000 + 63 * 8));
+    tags.set(CapTagBitmap::granule(0x1000 + 64 * 8));
+    tags.set(CapTagBitmap::granule(0x2000));
+    EXPECT_EQ(tags.pageCount(), 2);
+
+    EXPECT_TRUE(tags.test(CapTagBitmap::granule(0x1000 + 63 * 8 + 5)));
+    EXPECT_FALSE(tags.test(CapTagBitmap::granule(0x1000)));
+    EXPECT_FALSE(tags.any(0x1000, 63 * 8));
+    EXPECT_TRUE(tags.any(0x1000, 63 * 8 + 1));
+    EXPECT_TRUE(tags.any(0x1fff, 2));
+    EXPECT_FALSE(tags.any(0x1000 + 65 * 8, 0x2000 - 0x1000 - 65 * 8));
+    EXPECT_FALSE(tags.any(0x2000, 0));
+
+    std::vector<Addr> seen;
+    tags.forEach(0, 0x10000, [&](Addr g) { seen.push_back(g); });
+    ASSERT_EQ(seen.size(), 3);
+    EXPECT_EQ(seen[0], CapTagBitmap::granule(0x1000 + 63 * 8));
+    EXPECT_EQ(seen[1], CapTagBitmap::granule(0x1000 + 64 * 8));
+    EXPECT_EQ(seen[2], CapTagBitmap::granule(0x2000));
+
+    // pages go away with their last tag
+    tags.clear(CapTagBitmap::granule(0x2000));
+    EXPECT_EQ(tags.pageCount(), 1);
+    EXPECT_FALSE(tags.any(0x2000, 8));
+}
+
+TEST(CapTrackTableTest, RemoveMemRange)
+{
+    CapTrackTable table;
+    table.add(CapLoc::makeMem(0x1000), 1);
+    table.add(CapLoc::makeMem(0x1008), 2);
+    table.add(CapLoc::makeMem(0x1014), 3); // misaligned, spans two granules
+    table.add(CapLoc::makeMem(0x3000), 4);
+
+    EXPECT_TRUE(table.memTouches(0x1004, 1));
+    EXPECT_TRUE(table.memTouches(0x101b, 1));
+    EXPECT_FALSE(table.memTouches(0x1020, 8));
+    EXPECT_FALSE(table.memTouches(0x2000, 0x1000));
+
+    // a byte store into the middle of a capability destroys it
+    RefCapTrackMap removed;
+    auto record = [&](Addr addr, NodeID node_id) {
+        removed[CapLoc::makeMem(addr)] = node_id;
+    };
+    table.removeMemRange(0x100c, 1, record);
+    EXPECT_EQ(removed.size(), 1);
+    EXPECT_EQ(refQuery(removed, CapLoc::makeMem(0x1008)), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1008)), NODE_ID_INVALID);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), 1);
+
+    // the tail of the misaligned capability
+    table.removeMemRange(0x1018, 4, record);
+    EXPECT_EQ(refQuery(removed, CapLoc::makeMem(0x1014)), 3);
+    EXPECT_FALSE(table.memTouches(0x1010, 0x10));
+
+    // a bulk write, e.g., read() into a buffer
+    table.removeMemRange(0x800, 0x10000, record);
+    EXPECT_EQ(removed.size(), 4);
+    EXPECT_EQ(table.memSize(), 0);
+    EXPECT_EQ(table.memPageCount(), 0);
+}
+
+TEST(CapTrackTableTest, CopyMemRange)
+{
+    CapTrackTable table;
+    table.add(CapLoc::makeMem(0x1000), 1);
+    table.add(CapLoc::makeMem(0x1008), 2);
+    table.add(CapLoc::makeMem(0x101c), 3); // sticks out of the source
+    table.add(CapLoc::makeMem(0x2008), 4); // overwritten by the copy
+
+    RefCapTrackMap removed, copied;
+    auto record = [](RefCapTrackMap& map) {
+        return [&map](Addr addr, NodeID node_id) {
+            map[CapLoc::makeMem(addr)] = node_id;
+        };
+    };
+    table.copyMemRange(0x2000, 0x1000, 0x20, record(removed), record(copied));
+    EXPECT_EQ(removed.size(), 1);
+    EXPECT_EQ(refQuery(removed, CapLoc::makeMem(0x2008)), 4);
+    EXPECT_EQ(copied.size(), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x2000)), 1);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x2008)), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x201c)), NODE_ID_INVALID);
+    // the source is left alone
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1008)), 2);
+    EXPECT_EQ(table.memSize(), 5);
+
+    // overlapping ranges behave like memmove
+    removed.clear();
+    copied.clear();
+    table.copyMemRange(0x1008, 0x1000, 0x10, record(removed), record(copied));
+    EXPECT_EQ(refQuery(removed, CapLoc::makeMem(0x1008)), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1008)), 1);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1010)), 2);
+    EXPECT_EQ(table.query(CapLoc::makeMem(0x1000)), 1);
+}
+
+/** Random capabilities and writes of any alignment, checked against a
+ * byte-by-byte scan of the map-based implementation */
+TEST(CapTrackTableTest, RemoveMemRangeMatchesMap)
+{
+    CapTrackTable table;
+    RefCapTrackMap ref;
+    std::mt19937_64 rng(4321);
+    const Addr base = 0x10000;
+    const Addr span = 0x4000;
+
+    for (int i = 0; i < 20000; i++) {
+        Addr addr = base + rng() % span;
+        if (rng() % 4 != 0)
+            addr &= ~(Addr)7;
+        if (rng() % 2 == 0) {
+            // a capability store replaces what it overlaps
+            table.removeMemRange(addr, 8, [](Addr, NodeID) {});
+            for (Addr a = addr - 7; a < addr + 8; a++)
+                ref.erase(CapLoc::makeMem(a));
+            NodeID node_id = rng() % 1000;
+            table.add(CapLoc::makeMem(addr), node_id);
+            ref[CapLoc::makeMem(addr)] = node_id;
+        } else {
+            Addr size = 1 + rng() % (rng() % 8 == 0 ? 256 : 8);
+            bool touches = false;
+            for (Addr a = addr - 7; a < addr + size; a++)
+                touches = touches || refQuery(ref, CapLoc::makeMem(a)) != NODE_ID_INVALID;
+            // granule-grained, so it may only err on the safe side
+            if (touches) {
+                ASSERT_TRUE(table.memTouches(addr, size));
+            }
+
+            size_t count = 0;
+            table.removeMemRange(addr, size, [&](Addr a, NodeID node_id) {
+                ASSERT_EQ(refQuery(ref, CapLoc::makeMem(a)), node_id);
+                ASSERT_TRUE(a + 8 > addr && a < addr + size);
+                ref.erase(CapLoc::makeMem(a));
+                count++;
+            });
+            if (!touches) {
+                ASSERT_EQ(count, 0u);
+            }
+        }
+    }
+
+    EXPECT_EQ(table.memSize(), ref.size());
+    for (const auto& entry : ref)
+        ASSERT_EQ(table.query(entry.first), entry.second);
+}
+
+/** Microbenchmark: a load/store-like mix of mostly missing queries, with
+ * adds and removes, against the map-based implementation. Reports the
+ * host time of both; only the results are checked. */
+TEST(CapTrackTableTest, Microbenchmark)
+{
+    const int ops = 2000000;
+    const int live_words = 1 << 14;
+
+    auto run = [&](auto query, auto add, auto remove) {
+        std::mt19937_64 rng(42);
+        NodeID sum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ops; i++) {
+            uint64_t r = rng();
+            CapLoc mem = CapLoc::makeMem(0x80000000 + (r % live_words) * 8);
+            CapLoc reg = CapLoc::makeReg(0, (r >> 32) % NumIntArchRegs);
+            switch ((r >> 48) % 16) {
+              case 0:
+                add(mem, (NodeID)(r % 4096));
+                break;
+              case 1:
+                remove(mem);
+                break;
+              case 2:
+                add(reg, (NodeID)(r % 4096));
+                break;
+              default:
+                sum += query(mem) + query(reg);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::make_pair(sum,
+            std::chrono::duration<double, std::milli>(end - start).count());
+    };
+
+    CapTrackTable table;
+    auto table_res = run(
+        [&](const CapLoc& l) { return table.query(l); },
+        [&](const CapLoc& l, NodeID n) { table.add(l, n); },
+        [&](const CapLoc& l) { table.remove(l); });
+
+    RefCapTrackMap map;
+    auto map_res = run(
+        [&](const CapLoc& l) { return refQuery(map, l); },
+        [&](const CapLoc& l, NodeID n) { map[l] = n; },
+        [&](const CapLoc& l) { map.erase(l); });
+
+    EXPECT_EQ(table_res.first, map_res.first);
+
+    std::cout << "CapTrackTable: " << table_res.second << " ms, "
+              << "std::map: " << map_res.second << " ms ("
+              << ops << " operations)" << std::endl;
+}
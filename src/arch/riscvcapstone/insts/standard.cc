@@ -102,17 +102,27 @@ EcallOp::generateDisassembly(Addr pc, const loader::SymbolTable *symtab) const
 InstStateMachinePtr
 EcallOp::getStateMachine(ExecContext* xc) const {
     RegVal num = xc->tcBase()->readIntReg(SyscallNumReg);
+    if(num != 3000 && num != 3001 && num != 3003) {
+        return DummyInstStateMachine::instance();
+    }
+    BaseSimpleCPUWithNodeController* cpu =
+        dynamic_cast<BaseSimpleCPUWithNodeController*>(xc->tcBase()->getCpuPtr());
+    panic_if(cpu == NULL, "non ncache-cpu unsupported.");
     switch(num) {
         case 3000: // malloc
-            return std::make_shared<MallocStateMachine>(
+            return cpu->mallocStateMachinePool.acquire(
+                    &cpu->mallocStateMachinePool,
                     (Addr)xc->tcBase()->getReg(RegId(IntRegClass, ReturnValueReg)),
                     (uint64_t)xc->tcBase()->getReg(RegId(IntRegClass, ReturnValueReg + 1)));
-        case 3001:
-            return std::make_shared<FreeStateMachine>(
-                    CapLoc::makeReg(xc->tcBase()->threadId(), ArgumentRegs[0]));
-        default:
-            return std::make_shared<DummyInstStateMachine>();
-
+        case 3003: // batched free
+            return cpu->freeBatchStateMachinePool.acquire(
+                    &cpu->freeBatchStateMachinePool,
+                    (Addr)xc->tcBase()->getReg(RegId(IntRegClass, ArgumentRegs[0])),
+                    (uint64_t)xc->tcBase()->getReg(RegId(IntRegClass, ArgumentRegs[1])));
+        default: // 3001, free
+            return cpu->freeStateMachinePool.acquire(
+                    &cpu->freeStateMachinePool,
+                    CapLoc::makeReg(xc->tcBase()->contextId(), ArgumentRegs[0]));
     }
 }
 
@@ -125,10 +135,11 @@ MallocStateMachine::setup(ExecContext* xc) {
     //SimpleExecContext* sxc = dynamic_cast<SimpleExecContext*>(xc);
     //panic_if(sxc == NULL, "non-SimpleExecContext unVksupported.");
     
-    NodeControllerAllocate* cmd = new NodeControllerAllocate(NODE_ID_INVALID);
-
     TimingSimpleNCacheCPU* cpu = dynamic_cast<TimingSimpleNCacheCPU*>(xc->tcBase()->getCpuPtr());
     panic_if(cpu == NULL, "non ncache-cpu unsupported.");
+
+    NodeControllerAllocate* cmd =
+        cpu->node_controller->newCommand<NodeControllerAllocate>(NODE_ID_INVALID);
     cpu->sendNCacheCommand(cmd);
 
     state = MALLOC_ALLOC_NODE;
@@ -148,12 +159,12 @@ MallocStateMachine::transit(ExecContext* xc, PacketPtr pkt) {
     TimingSimpleNCacheCPU* cpu = dynamic_cast<TimingSimpleNCacheCPU*>(xc->tcBase()->getCpuPtr());
     panic_if(cpu == NULL, "non ncache-cpu unsupported.");
 
-    cpu->node_controller->addCapTrack(CapLoc::makeReg(xc->tcBase()->threadId(), ReturnValueReg), 
+    cpu->node_controller->addCapTrack(CapLoc::makeReg(xc->tcBase()->contextId(), ReturnValueReg), 
             node_id);
     DPRINTF(CapstoneNodeOps, "Associated node %llu with addr range (0x%llx, 0x%llx)\n", 
             node_id,
             addr, (Addr)(addr + size));
-    cpu->node_controller->node2Obj[node_id] = SimpleAddrRange(addr, (Addr)(addr + size));
+    cpu->node_controller->node2Obj.set(node_id, SimpleAddrRange(addr, (Addr)(addr + size)));
     
     state = MALLOC_DONE;
 
@@ -175,7 +186,8 @@ FreeStateMachine::setup(ExecContext* xc) {
     DPRINTF(CapstoneNodeOps, "Free node %u\n", node_id);
     //panic_if(node_id == NODE_ID_INVALID, "attempted to revoke an invalid node id");
 
-    NodeControllerRevoke* cmd = new NodeControllerRevoke(node_id);
+    NodeControllerRevoke* cmd =
+        cpu->node_controller->newCommand<NodeControllerRevoke>(node_id);
     cpu->sendNCacheCommand(cmd);
 
     state = FREE_FREE_NODE;
@@ -193,6 +205,79 @@ FreeStateMachine::transit(ExecContext* xc, PacketPtr pkt) {
     return NoFault;
 }
 
+std::vector<NodeID>
+FreeBatchStateMachine::collectNodes(NodeController* controller,
+        Addr addr, uint64_t count) {
+    if(count > MAX_COUNT) {
+        warn("notifyfree_batch of %llu pointers, only the first %llu are "
+                "revoked\n", count, MAX_COUNT);
+        count = MAX_COUNT;
+    }
+    std::vector<NodeID> node_ids;
+    for(uint64_t i = 0; i < count; ++ i) {
+        NodeID node_id = controller->queryCapTrack(
+                CapLoc::makeMem(addr + i * CapTrackTable::CAP_SIZE));
+        if(node_id == NODE_ID_INVALID) {
+            DPRINTF(CapstoneNodeOps, "warning: no node associated with "
+                    "pointer %llu of the batch to free\n", i);
+            continue;
+        }
+        node_ids.push_back(node_id);
+    }
+    return node_ids;
+}
+
+void
+FreeBatchStateMachine::setup(ExecContext* xc) {
+    TimingSimpleNCacheCPU* cpu = dynamic_cast<TimingSimpleNCacheCPU*>(xc->tcBase()->getCpuPtr());
+    panic_if(cpu == NULL, "non ncache-cpu unsupported.");
+
+    std::vector<NodeID> node_ids = collectNodes(cpu->node_controller,
+            addr, count);
+    if(node_ids.empty()) {
+        state = FREE_BATCH_DONE;
+        return;
+    }
+    DPRINTF(CapstoneNodeOps, "Free %u nodes in a batch\n", node_ids.size());
+
+    NodeControllerRevokeBatch* cmd =
+        cpu->node_controller->newCommand<NodeControllerRevokeBatch>(
+                std::move(node_ids));
+    cpu->sendNCacheCommand(cmd);
+
+    state = FREE_BATCH_FREE_NODES;
+}
+
+bool
+FreeBatchStateMachine::finished(ExecContext* xc) const {
+    return state == FREE_BATCH_DONE;
+}
+
+Fault
+FreeBatchStateMachine::transit(ExecContext* xc, PacketPtr pkt) {
+    state = FREE_BATCH_DONE;
+    return NoFault;
+}
+
+Tick
+FreeBatchStateMachine::atomicExec(ExecContext* xc) {
+    AtomicSimpleNCacheCPU* cpu = 
+        dynamic_cast<AtomicSimpleNCacheCPU*>(xc->tcBase()->getCpuPtr());
+    panic_if(cpu == NULL, "only atomic ncache cpu supports atomic execution");
+
+    std::vector<NodeID> node_ids = collectNodes(cpu->node_controller,
+            addr, count);
+    if(node_ids.empty()) {
+        return 0;
+    }
+
+    cpu->issueNCacheCommandAtomic(
+            cpu->node_controller->newCommand<NodeControllerRevokeBatch>(
+                std::move(node_ids)));
+
+    return 0;
+}
+
 Tick
 MallocStateMachine::atomicExec(ExecContext* xc) {
     AtomicSimpleNCacheCPU* cpu = 
@@ -200,17 +285,17 @@ MallocStateMachine::atomicExec(ExecContext* xc) {
     panic_if(cpu == NULL, "only atomic ncache cpu supports atomic execution");
 
     PacketPtr pkt = cpu->sendNCacheCommandAtomic(
-            new NodeControllerAllocate(NODE_ID_INVALID));
+            cpu->node_controller->newCommand<NodeControllerAllocate>(NODE_ID_INVALID));
     NodeID node_id = pkt->getRaw<NodeID>();
     cpu->node_controller->addCapTrack(
-            CapLoc::makeReg(xc->tcBase()->threadId(), ReturnValueReg), 
+            CapLoc::makeReg(xc->tcBase()->contextId(), ReturnValueReg), 
             node_id);
     DPRINTF(CapstoneNodeOps, "Associated node %llu with addr range (0x%llx, 0x%llx)\n", 
             node_id,
             addr, (Addr)(addr + size));
-    cpu->node_controller->node2Obj[node_id] = SimpleAddrRange(addr, (Addr)(addr + size));
+    cpu->node_controller->node2Obj.set(node_id, SimpleAddrRange(addr, (Addr)(addr + size)));
 
-    delete pkt;
+    cpu->ncachePacketPool.release(pkt);
 
     return 0;
 }
@@ -228,9 +313,8 @@ FreeStateMachine::atomicExec(ExecContext* xc) {
         return 0;
     }
 
-    PacketPtr pkt = cpu->sendNCacheCommandAtomic(
-            new NodeControllerRevoke(node_id));
-    delete pkt;
+    cpu->issueNCacheCommandAtomic(
+            cpu->node_controller->newCommand<NodeControllerRevoke>(node_id));
 
     return 0;
 }
@@ -32,11 +32,13 @@
 #define __ARCH_RISCV_STANDARD_INST_HH__
 
 #include <string>
+#include <vector>
 
 #include "arch/riscvcapstone/insts/bitfields.hh"
 #include "arch/riscvcapstone/insts/static_inst.hh"
 #include "arch/riscvcapstone/regs/misc.hh"
 #include "arch/riscvcapstone/cap_track.hh"
+#include "arch/riscvcapstone/pool.hh"
 #include "cpu/exec_context.hh"
 #include "cpu/static_inst.hh"
 
@@ -45,6 +47,9 @@ namespace gem5
 
 namespace RiscvcapstoneISA
 {
+
+class NodeController;
+
 /**
  * Base class for operations that work only on registers
  */
@@ -83,6 +88,7 @@ class SystemOp : public RiscvStaticInst
         Addr pc, const loader::SymbolTable *symtab) const override;
 };
 
+// both come from the pools of the CPU executing the instruction
 struct MallocStateMachine : InstStateMachine {
     enum {
         MALLOC_ALLOC_NODE,
@@ -90,18 +96,22 @@ struct MallocStateMachine : InstStateMachine {
     } state;
     Addr addr;
     uint64_t size;
-    MallocStateMachine(Addr addr, uint64_t size): addr(addr), size(size) {}
+    ObjectPool<MallocStateMachine>* pool;
+    MallocStateMachine(ObjectPool<MallocStateMachine>* pool,
+            Addr addr, uint64_t size): addr(addr), size(size), pool(pool) {}
     void setup(ExecContext* xc) override;
     bool finished(ExecContext* xc) const override;
     Fault transit(ExecContext* xc, PacketPtr pkt) override;
     Tick atomicExec(ExecContext* xc) override;
+    void release() override { pool->release(this); }
 };
 
 struct FreeStateMachine : InstStateMachine {
     CapLoc loc;
+    ObjectPool<FreeStateMachine>* pool;
 
-    FreeStateMachine() {}
-    FreeStateMachine(const CapLoc& loc) : loc(loc) {}
+    FreeStateMachine(ObjectPool<FreeStateMachine>* pool, const CapLoc& loc) :
+        loc(loc), pool(pool) {}
 
     enum {
         FREE_FREE_NODE,
@@ -111,6 +121,35 @@ struct FreeStateMachine : InstStateMachine {
     bool finished(ExecContext* xc) const override;
     Fault transit(ExecContext* xc, PacketPtr pkt) override;
     Tick atomicExec(ExecContext* xc) override;
+    void release() override { pool->release(this); }
+};
+
+// revokes the capabilities in an array of freed pointers at once
+struct FreeBatchStateMachine : InstStateMachine {
+    Addr addr; // the array
+    uint64_t count;
+    ObjectPool<FreeBatchStateMachine>* pool;
+
+    FreeBatchStateMachine(ObjectPool<FreeBatchStateMachine>* pool,
+            Addr addr, uint64_t count) :
+        addr(addr), count(count), pool(pool) {}
+
+    enum {
+        FREE_BATCH_FREE_NODES,
+        FREE_BATCH_DONE,
+    } state;
+    void setup(ExecContext* xc) override;
+    bool finished(ExecContext* xc) const override;
+    Fault transit(ExecContext* xc, PacketPtr pkt) override;
+    Tick atomicExec(ExecContext* xc) override;
+    void release() override { pool->release(this); }
+
+    // the most pointers one batch revokes, as count comes from the guest
+    static const uint64_t MAX_COUNT = 1 << 16;
+
+    // the nodes of the capabilities in an array of count pointers
+    static std::vector<NodeID> collectNodes(NodeController* controller,
+            Addr addr, uint64_t count);
 };
 
 class EcallOp : public RiscvStaticInst {
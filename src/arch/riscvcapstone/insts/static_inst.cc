@@ -30,6 +30,7 @@
 #include "arch/riscvcapstone/insts/static_inst.hh"
 
 #include "arch/riscvcapstone/pcstate.hh"
+#include "arch/riscvcapstone/regs/int.hh"
 #include "arch/riscvcapstone/types.hh"
 #include "cpu/static_inst.hh"
 
@@ -39,6 +40,32 @@ namespace gem5
 namespace RiscvcapstoneISA
 {
 
+void
+RiscvStaticInst::setCapTrackInfo()
+{
+    static_assert(NumIntRegs <= 64, "integer register masks are 64-bit");
+
+    _intSrcMask = 0;
+    for (int i = 0; i < numSrcRegs(); i++) {
+        const RegId &reg = srcRegIdx(i);
+        if (reg.classValue() == IntRegClass)
+            _intSrcMask |= (uint64_t)1 << reg.index();
+    }
+    _intDestMask = 0;
+    for (int i = 0; i < numDestRegs(); i++) {
+        const RegId &reg = destRegIdx(i);
+        if (reg.classValue() == IntRegClass)
+            _intDestMask |= (uint64_t)1 << reg.index();
+    }
+
+    if (_intDestMask == 0)
+        _capTrackClass = CapTrackNoIntDest;
+    else if (_intSrcMask == 0)
+        _capTrackClass = CapTrackClears;
+    else
+        _capTrackClass = CapTrackMayPropagate;
+}
+
 void
 RiscvMicroInst::advancePC(PCStateBase &pcState) const
 {
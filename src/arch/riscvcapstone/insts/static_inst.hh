@@ -46,15 +46,31 @@ namespace gem5
 namespace RiscvcapstoneISA
 {
 
+/**
+ * Node cache work of an instruction. The CPU calls release() once the
+ * instruction is done with it, which returns it to wherever it came from.
+ * */
 struct InstStateMachine {
+    virtual ~InstStateMachine() {}
     virtual void setup(ExecContext* xc) = 0;
     virtual bool finished(ExecContext* xc) const = 0;
     virtual Fault transit(ExecContext* xc, PacketPtr pkt) = 0;
     virtual Tick atomicExec(ExecContext* xc) = 0;
+    virtual void release() {}
 };
 
 
+/**
+ * State machine of instructions that do not touch the node cache. It is
+ * stateless, so a single shared instance serves all of them.
+ * */
 struct DummyInstStateMachine : InstStateMachine {
+    static DummyInstStateMachine*
+    instance() {
+        static DummyInstStateMachine sm;
+        return &sm;
+    }
+
     void setup(ExecContext* xc) override {}
 
     bool finished(ExecContext* xc) const override {
@@ -70,7 +86,7 @@ struct DummyInstStateMachine : InstStateMachine {
     }
 };
 
-typedef std::shared_ptr<InstStateMachine> InstStateMachinePtr;
+typedef InstStateMachine* InstStateMachinePtr;
 
 
 
@@ -79,15 +95,50 @@ typedef std::shared_ptr<InstStateMachine> InstStateMachinePtr;
  */
 class RiscvStaticInst : public StaticInst
 {
+  public:
+    /**
+     * What the instruction can do to the capabilities tracked in integer
+     * registers.
+     */
+    enum CapTrackClass
+    {
+        // writes no integer register
+        CapTrackNoIntDest,
+        // writes integer registers from no integer register, so they
+        // never end up holding a capability
+        CapTrackClears,
+        // may copy a capability from a source to a destination
+        CapTrackMayPropagate
+    };
+
   protected:
     RiscvStaticInst(const char *_mnemonic, ExtMachInst _machInst,
             OpClass __opClass) :
         StaticInst(_mnemonic, __opClass), machInst(_machInst)
     {}
 
+    // instructions that do not call setCapTrackInfo() get the full
+    // tracking
+    CapTrackClass _capTrackClass = CapTrackMayPropagate;
+    uint64_t _intSrcMask = ~(uint64_t)0;
+    uint64_t _intDestMask = ~(uint64_t)0;
+
+    /**
+     * Works out the capability tracking class and the integer register
+     * masks from the register indices. The constructors generated by the
+     * ISA parser call it once the indices are set, so it runs once per
+     * decoded instruction.
+     */
+    void setCapTrackInfo();
+
   public:
     ExtMachInst machInst;
 
+    CapTrackClass capTrackClass() const { return _capTrackClass; }
+    // integer registers read and written, one bit per register index
+    uint64_t intSrcMask() const { return _intSrcMask; }
+    uint64_t intDestMask() const { return _intDestMask; }
+
     void
     advancePC(PCStateBase &pc) const override
     {
@@ -119,7 +170,7 @@ class RiscvStaticInst : public StaticInst
     }
 
     virtual InstStateMachinePtr getStateMachine(ExecContext* xc) const {
-        return std::make_shared<DummyInstStateMachine>();
+        return DummyInstStateMachine::instance();
     }
 
     // FIXME: here "mem" actually only includes the node cache
@@ -192,10 +192,10 @@ SyscallDescTable<SEWorkload::SyscallABI> EmuLinux::syscallDescs64 = {
     { 61,   "getdents64" },
 #endif
     { 62,   "lseek", lseekFunc },
-    { 63,   "read", readFunc<RiscvLinux64> },
+    { 63,   "read", gem5::RiscvcapstoneISA::capReadFunc<RiscvLinux64> },
     { 64,   "write", writeFunc<RiscvLinux64> },
     { 66,   "writev", writevFunc<RiscvLinux64> },
-    { 67,   "pread64", pread64Func<RiscvLinux64> },
+    { 67,   "pread64", gem5::RiscvcapstoneISA::capPread64Func<RiscvLinux64> },
     { 68,   "pwrite64", pwrite64Func<RiscvLinux64> },
     { 69,   "preadv" },
     { 70,   "pwritev" },
@@ -463,7 +463,9 @@ SyscallDescTable<SEWorkload::SyscallABI> EmuLinux::syscallDescs64 = {
     { 2011, "getmainvars" },
     // for Capstone benchmarking
     { 3000, "notifymalloc", gem5::RiscvcapstoneISA::notifymallocFunc },
-    { 3001, "notifyfree", gem5::RiscvcapstoneISA::notifyfreeFunc }
+    { 3001, "notifyfree", gem5::RiscvcapstoneISA::notifyfreeFunc },
+    { 3002, "capmemcpy", gem5::RiscvcapstoneISA::capmemcpyFunc },
+    { 3003, "notifyfree_batch", gem5::RiscvcapstoneISA::notifyfreebatchFunc }
 };
 
 SyscallDescTable<SEWorkload::SyscallABI> EmuLinux::syscallDescs32 = {
@@ -534,10 +536,10 @@ SyscallDescTable<SEWorkload::SyscallABI> EmuLinux::syscallDescs32 = {
     { 61,   "getdents64" },
 #endif
     { 62,   "lseek", lseekFunc },
-    { 63,   "read", readFunc<RiscvLinux32> },
+    { 63,   "read", gem5::RiscvcapstoneISA::capReadFunc<RiscvLinux32> },
     { 64,   "write", writeFunc<RiscvLinux32> },
     { 66,   "writev", writevFunc<RiscvLinux32> },
-    { 67,   "pread64", pread64Func<RiscvLinux32> },
+    { 67,   "pread64", gem5::RiscvcapstoneISA::capPread64Func<RiscvLinux32> },
     { 68,   "pwrite64", pwrite64Func<RiscvLinux32> },
     { 69,   "preadv" },
     { 70,   "pwritev" },
@@ -805,7 +807,9 @@ SyscallDescTable<SEWorkload::SyscallABI> EmuLinux::syscallDescs32 = {
     { 2011, "getmainvars" },
     // for Capstone benchmarking
     { 3000, "notifymalloc", gem5::RiscvcapstoneISA::notifymallocFunc },
-    { 3001, "notifyfree", gem5::RiscvcapstoneISA::notifyfreeFunc }
+    { 3001, "notifyfree", gem5::RiscvcapstoneISA::notifyfreeFunc },
+    { 3002, "capmemcpy", gem5::RiscvcapstoneISA::capmemcpyFunc },
+    { 3003, "notifyfree_batch", gem5::RiscvcapstoneISA::notifyfreebatchFunc }
 };
 
 } // namespace RiscvcapstoneISA
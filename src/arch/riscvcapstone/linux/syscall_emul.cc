@@ -1,10 +1,22 @@
+#include <algorithm>
+#include <vector>
+
 #include "arch/riscvcapstone/linux/syscall_emul.hh"
 #include "debug/CapstoneAlloc.hh"
 #include "arch/riscvcapstone/node_controller.hh"
+#include "arch/riscvcapstone/page_size.hh"
+#include "arch/riscvcapstone/spec_cap_tracker.hh"
 #include "arch/riscvcapstone/typing.hh"
+#include "mem/se_translating_port_proxy.hh"
 
 namespace gem5::RiscvcapstoneISA {
 
+// the capability tracker of an O3 or Minor CPU, if any
+static CapstoneCapTracker*
+capTracker(ThreadContext* tc) {
+    return dynamic_cast<CapstoneCapTracker*>(
+            tc->getCpuPtr()->getCapTracker());
+}
 
 SyscallReturn
 notifymallocFunc(SyscallDesc* desc, ThreadContext* tc,
@@ -38,6 +50,70 @@ notifyfreeFunc(SyscallDesc* desc, ThreadContext* tc,
     return SyscallReturn();
 }
 
+// the pointers are revoked by the state machine of the ecall, which
+// finds their nodes through the capability tracking of the array, so
+// there is nothing left to do here
+SyscallReturn
+notifyfreebatchFunc(SyscallDesc* desc, ThreadContext* tc,
+        uint64_t addr, uint64_t count) {
+    DPRINTF(CapstoneAlloc, "free batch: %llx, %llu\n", addr, count);
+    return SyscallReturn();
+}
+
+// memmove that carries the capabilities in the copied range along
+// stands in for copy loops recognized in the program
+SyscallReturn
+capmemcpyFunc(SyscallDesc* desc, ThreadContext* tc,
+        uint64_t dst, uint64_t src, uint64_t size) {
+    DPRINTF(CapstoneAlloc, "capmemcpy: %llx -> %llx, %llu\n", src, dst, size);
+
+    if(size == 0) {
+        return dst;
+    }
+    if(src + size < src || dst + size < dst) {
+        return -EINVAL;
+    }
+
+    // a page at a time, so that the guest does not pick the size of
+    // the buffer; back to front if dst overlaps the end of src
+    std::vector<uint8_t> buf(std::min<uint64_t>(size, PageBytes));
+    SETranslatingPortProxy proxy(tc);
+    bool backward = dst > src && dst < src + size;
+    for(uint64_t done = 0; done < size; ) {
+        uint64_t n = std::min<uint64_t>(size - done, buf.size());
+        uint64_t off = backward ? size - done - n : done;
+        if(!proxy.tryReadBlob(src + off, buf.data(), n) ||
+                !proxy.tryWriteBlob(dst + off, buf.data(), n)) {
+            return -EFAULT;
+        }
+        done += n;
+    }
+
+    BaseSimpleCPUWithNodeController* cpu = 
+        dynamic_cast<BaseSimpleCPUWithNodeController*>(tc->getCpuPtr());
+    CapstoneCapTracker* tracker = capTracker(tc);
+    if(cpu) {
+        cpu->copyMemCaps((Addr)dst, (Addr)src, (Addr)size);
+    } else if(tracker) {
+        tracker->copyMemCaps((Addr)dst, (Addr)src, (Addr)size);
+    } else {
+        DPRINTF(CapstoneAlloc, "capmemcpy: warning! cpu does not have a node controller!\n");
+    }
+    return dst;
+}
+
+void
+clearSyscallBuffer(ThreadContext* tc, Addr addr, Addr size) {
+    BaseSimpleCPUWithNodeController* cpu = 
+        dynamic_cast<BaseSimpleCPUWithNodeController*>(tc->getCpuPtr());
+    CapstoneCapTracker* tracker = capTracker(tc);
+    if(cpu) {
+        cpu->clearMemCaps(addr, size);
+    } else if(tracker) {
+        tracker->clearMemCaps(addr, size);
+    }
+}
+
 // FIXME: the return value ovewrites registers. Needs to clean up the capabilities inside
 
 }
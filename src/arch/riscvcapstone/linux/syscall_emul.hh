@@ -3,10 +3,39 @@
 
 #include "cpu/thread_context.hh"
 #include "sim/system.hh"
+#include "sim/syscall_emul.hh"
 #include "sim/syscall_return.hh"
 #include "sim/syscall_desc.hh"
 
 namespace gem5::RiscvcapstoneISA {
+    // drops the capabilities the syscall overwrote in [addr, addr + size)
+    void clearSyscallBuffer(ThreadContext* tc, Addr addr, Addr size);
+
+    template <class OS>
+    SyscallReturn
+        capReadFunc(SyscallDesc* desc, ThreadContext* tc,
+                int tgt_fd, VPtr<> buf_ptr, int nbytes) {
+            SyscallReturn ret = readFunc<OS>(desc, tc, tgt_fd, buf_ptr, nbytes);
+            if(!ret.suppressed() && !ret.needsRetry() && ret.successful() &&
+                    ret.returnValue() > 0) {
+                clearSyscallBuffer(tc, buf_ptr, ret.returnValue());
+            }
+            return ret;
+        }
+
+    template <class OS>
+    SyscallReturn
+        capPread64Func(SyscallDesc* desc, ThreadContext* tc,
+                int tgt_fd, VPtr<> buf_ptr, int nbytes, int offset) {
+            SyscallReturn ret = pread64Func<OS>(desc, tc, tgt_fd, buf_ptr,
+                    nbytes, offset);
+            if(!ret.suppressed() && !ret.needsRetry() && ret.successful() &&
+                    ret.returnValue() > 0) {
+                clearSyscallBuffer(tc, buf_ptr, ret.returnValue());
+            }
+            return ret;
+        }
+
     SyscallReturn
         notifymallocFunc(SyscallDesc* desc, ThreadContext* tc,
                 uint64_t addr, uint64_t size);
@@ -14,6 +43,14 @@ namespace gem5::RiscvcapstoneISA {
     SyscallReturn
         notifyfreeFunc(SyscallDesc* desc, ThreadContext* tc,
                 uint64_t addr);
+
+    SyscallReturn
+        capmemcpyFunc(SyscallDesc* desc, ThreadContext* tc,
+                uint64_t dst, uint64_t src, uint64_t size);
+
+    SyscallReturn
+        notifyfreebatchFunc(SyscallDesc* desc, ThreadContext* tc,
+                uint64_t addr, uint64_t count);
 }
 
 #endif
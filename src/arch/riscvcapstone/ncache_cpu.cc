@@ -39,6 +39,8 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+
 #include "arch/riscvcapstone/ncache_cpu.hh"
 #include "arch/riscvcapstone/faults.hh"
 #include "arch/riscvcapstone/regs/int.hh"
@@ -85,10 +87,20 @@ TimingSimpleNCacheCPU::TimingSimpleNCacheCPU(const BaseTimingSimpleNCacheCPUPara
       ncache_status(NCACHE_INSTR_EXECUTION),
       fetchTranslation(this), icachePort(this),
       dcachePort(this), ncache_port(this), 
-      ifetch_pkt(NULL), dcache_pkt(NULL), ncache_pkt(NULL), 
+      ifetch_pkt(NULL), dcache_pkt(NULL),
       previousCycle(0),
       fetchEvent([this]{ fetch(); }, name()),
-      instPendingMem(NULL)
+      instPendingMem(NULL),
+      statePendingMem(nullptr),
+      ncOutstanding(0),
+      coalesceRcUpdates(p.coalesce_rc_updates),
+      rcCoalescer(this),
+      overlapNCache(p.overlap_ncache_commands),
+      rcUpdateBufferSize(p.rc_update_buffer_size),
+      capCheckOutstanding(false),
+      capCheckResp(NULL),
+      accessPendingCheck(false),
+      overlapStats(this)
 {
     _status = Idle;
 }
@@ -119,7 +131,10 @@ TimingSimpleNCacheCPU::drain()
         // The fetch event can become descheduled if a drain didn't
         // succeed on the first attempt. We need to reschedule it if
         // the CPU is waiting for a microcode routine to complete.
-        if (_status == BaseSimpleCPU::Running && !fetchEvent.scheduled())
+        // Node controller commands still in flight finish the
+        // instruction themselves.
+        if (_status == BaseSimpleCPU::Running && !fetchEvent.scheduled() &&
+            ncache_status == NCACHE_INSTR_EXECUTION)
             schedule(fetchEvent, clockEdge());
 
         return DrainState::Draining;
@@ -368,22 +383,20 @@ TimingSimpleNCacheCPU::sendData(const RequestPtr &req, uint8_t *data, uint64_t *
     }
 }
 
-void
+PacketPtr
 TimingSimpleNCacheCPU::sendNCacheCommand(NodeControllerCommand* cmd) {
-    RequestPtr ncache_req = std::make_shared<Request>();
-    // pass the address
-    //ncache_req->setPaddr(addr);
-    //assert(ncache_req->hasPaddr() && !ncache_req->hasSize());
-    PacketPtr ncache_pkt = Packet::createRead(ncache_req);
-    ncache_pkt->dataStatic<NodeControllerCommand>(cmd);
-
-    if(ncache_port.sendTimingReq(ncache_pkt)) {
+    PacketPtr ncache_pkt = ncachePacketPool.acquire(MemCmd::ReadReq,
+            dataRequestorId());
+    ncache_pkt->setRaw<NodeControllerCommandPtr>(cmd);
+
+    // commands reach the node controller in order
+    if(ncRetryPkts.empty() && ncache_port.sendTimingReq(ncache_pkt)) {
         DPRINTF(CapstoneNCache, "NCache packet sent\n");
-        this->ncache_pkt = NULL;
     } else {
         DPRINTF(CapstoneNCache, "NCache packet to retry\n");
-        this->ncache_pkt = ncache_pkt;
+        ncRetryPkts.push_back(ncache_pkt);
     }
+    return ncache_pkt;
 }
 
 void
@@ -451,7 +464,7 @@ TimingSimpleNCacheCPU::translationFault(const Fault &fault)
         traceFault();
     }
 
-    if(!issueNCacheCommands()){
+    if(!issueNCacheCommands(fault)){
         postExecute();
 
         advanceInst(fault);
@@ -581,6 +594,7 @@ TimingSimpleNCacheCPU::writeMem(uint8_t *data, unsigned size,
     SimpleExecContext &t_info = *threadInfo[curThread];
     SimpleThread* thread = t_info.thread;
 
+    storeSize = size;
     uint8_t *newData = new uint8_t[size];
     const Addr pc = thread->pcState().instAddr();
     unsigned block_size = cacheLineSize();
@@ -907,73 +921,21 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
     if (curStaticInst && curStaticInst->isMemRef()) {
         // issue commands for checking capabilities
         panic_if(curStaticInst->isLoad() && curStaticInst->isStore(), "an instruction cannot be both store and load");
-        RiscvStaticInst* rv_inst = dynamic_cast<RiscvStaticInst*>(curStaticInst.get());
-        assert(rv_inst != NULL);
-        issueCapChecks(t_info, curStaticInst.get(), rv_inst->getAddr(&t_info, traceData));
-
-        // load or store: just send to dcache
-        Fault fault = curStaticInst->initiateAcc(&t_info, traceData);
-
-
-        // load
-        if(curStaticInst->isLoad()) { // probably better remove
-            cleanupDest(t_info, rv_inst);
-
-            // check if the value to be loaded in would be a capability
-            DPRINTF(CapstoneNodeOps, "load from %llx\n", rv_inst->getAddr(&t_info, traceData));
-            CapLoc mem_loc = CapLoc::makeMem(rv_inst->getAddr(&t_info, traceData));
-            NodeID node_id = node_controller->queryCapTrack(mem_loc);
-            if(node_id != NODE_ID_INVALID) {
-                // if yes, record the reg as a capability
-                // TODO: strictly this should be done during wb
-                panic_if(rv_inst->numDestRegs() != 1, "load instruction should have exactly 1 destination register");
-                node_controller->addCapTrack(
-                        CapLoc::makeReg(t_info.thread->threadId(),
-                            rv_inst->destRegIdx(0).index()),
-                        node_id);
-                ncToIssue.push(new NodeControllerRcUpdate(node_id, 1));
-            }
-        } else if(curStaticInst->isStore()) {
-            // check for overwriting in-memory capability
-            DPRINTF(CapstoneNodeOps, "store to %llx\n", rv_inst->getAddr(&t_info, traceData));
-            CapLoc mem_loc = CapLoc::makeMem(rv_inst->getAddr(&t_info, traceData));
-            NodeID mem_node = node_controller->queryCapTrack(mem_loc);
-            if(mem_node != NODE_ID_INVALID) {
-                // the capability at the memory location will be overwritten
-                node_controller->removeCapTrack(mem_loc);
-                ncToIssue.push(new NodeControllerRcUpdate(mem_node, -1));
-            }
-
-            // check for writing capability to memory
-            panic_if(rv_inst->numSrcRegs() != 2, "store instructions should have exactly 2 source registers"); 
-            RegId reg_id = rv_inst->srcRegIdx(1);
-            if(reg_id.classValue() == RegClassType::IntRegClass){
-                RegIndex reg_idx = reg_id.index();
-                CapLoc reg_loc = CapLoc::makeReg(t_info.thread->threadId(), reg_idx);
-                NodeID reg_node = node_controller->queryCapTrack(reg_loc);
-                if(reg_node != NODE_ID_INVALID) {
-                    node_controller->addCapTrack(mem_loc, reg_node);
-                    ncToIssue.push(new NodeControllerRcUpdate(reg_node, 1));
-                }
-            }
+        RiscvStaticInst* rv_inst =
+            static_cast<RiscvStaticInst*>(curStaticInst.get());
+        bool checking = issueCapChecks(t_info, curStaticInst.get(),
+                rv_inst->getAddr(&t_info, traceData));
+
+        if(overlapNCache || checking) {
+            // the check goes out before or along with the data access
+            capCheckOutstanding = checking;
+            sendPendingNCacheCommands();
         }
-
-        // If we're not running now the instruction will complete in a dcache
-        // response callback or the instruction faulted and has started an
-        // ifetch
-        if (_status == BaseSimpleCPU::Running) {
-            if (fault != NoFault && traceData) {
-                traceFault();
-            }
-
-            if(!issueNCacheCommands()){
-                postExecute();
-                // @todo remove me after debugging with legion done
-                if (curStaticInst && (!curStaticInst->isMicroop() ||
-                            curStaticInst->isFirstMicroop()))
-                    instCnt++;
-                advanceInst(fault);
-            }
+        if(checking && (!overlapNCache || curStaticInst->isStore())) {
+            // the access is sent to memory once the check passes
+            accessPendingCheck = true;
+        } else{
+            initiateMemRef(t_info, rv_inst);
         }
     } else if (curStaticInst) {
         // non-memory instruction: execute completely now
@@ -981,12 +943,16 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
         // track the capabilities
         int num_src = curStaticInst->numSrcRegs();
         int num_dest = curStaticInst->numDestRegs();
+        // the decoder only makes RISC-V instructions
+        RiscvStaticInst* rv_inst =
+            static_cast<RiscvStaticInst*>(curStaticInst.get());
 
         NodeID source_nodes[32];
         int source_n = 0;
         if(curStaticInst->isSyscall()){
             overwriteIntReg(source_nodes, &source_n, t_info.tcBase(), RiscvcapstoneISA::ReturnValueReg);
-        } else {
+        } else if(rv_inst->capTrackClass() ==
+                RiscvStaticInst::CapTrackMayPropagate) {
             preOverwriteDest(source_nodes, &source_n, t_info, curStaticInst.get());
         }
 
@@ -995,8 +961,12 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
         Fault fault = curStaticInst->execute(&t_info, traceData);
 
         // after execution
-        // check which destinations contain new capabilities
-        if(!curStaticInst->isSyscall()){
+        // check which destinations contain new capabilities, unless no
+        // source and no destination holds a capability
+        if(!curStaticInst->isSyscall() &&
+                (source_n != 0 || (rv_inst->intDestMask() &
+                    node_controller->capTrackRegMask(
+                        t_info.thread->contextId())) != 0)){
             for(int j = 0; j < num_dest; j ++){
                 const RegId& dest_id = curStaticInst->destRegIdx(j);
                 if(dest_id.classValue() != RegClassType::IntRegClass)
@@ -1007,18 +977,18 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
                 DPRINTF(CapstoneNodeOps, "Consider dest reg %d (%d)\n", j, dest_idx);
                 int i;
                 for(i = 0; i < source_n; i ++){
-                    if(node_controller->node2Obj[source_nodes[i]].contains((Addr)dest_val))
+                    if(node_controller->node2Obj.get(source_nodes[i]).contains((Addr)dest_val))
                         break;
                 }
-                CapLoc dest_loc = CapLoc::makeReg(t_info.thread->threadId(), dest_idx);
+                CapLoc dest_loc = CapLoc::makeReg(t_info.thread->contextId(), dest_idx);
                 NodeID dest_node = node_controller->queryCapTrack(dest_loc);
                 if(dest_node != NODE_ID_INVALID && (i >= source_n || dest_node != source_nodes[i])){
                     node_controller->removeCapTrack(dest_loc);
-                    ncToIssue.push(new NodeControllerRcUpdate(dest_node, -1));
+                    pushRcUpdate(dest_node, -1);
                 }
                 if(i < source_n && dest_node != source_nodes[i]) {
                     node_controller->addCapTrack(dest_loc, source_nodes[i]);
-                    ncToIssue.push(new NodeControllerRcUpdate(source_nodes[i], 1));
+                    pushRcUpdate(source_nodes[i], 1);
                 }
                 //for(int i = 0; i < num_src; i ++){
                     //const RegId& src_id = curStaticInst->srcRegIdx(i);
@@ -1029,7 +999,7 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
                     //CapLoc src_loc = CapLoc::makeReg(t_info.thread->threadId(), src_idx);
                     //NodeID src_node = node_controller->queryCapTrack(src_loc);
                     //if(src_node == NODE_ID_INVALID ||
-                            //!node_controller->node2Obj[src_node].contains((Addr)dest_val))
+                            //!node_controller->node2Obj.get(src_node).contains((Addr)dest_val))
                         //continue;
                     //DPRINTF(CapstoneNodeOps, "Consider src reg %d (%d)\n", i, src_idx);
                     //// src and dest are in the same region and the source is a capability
@@ -1053,8 +1023,6 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
         }
 
         // non-memory instructions might involve touching the node cache
-        RiscvStaticInst* rv_inst = dynamic_cast<RiscvStaticInst*>(curStaticInst.get());
-        panic_if(rv_inst == NULL, "non-RISC-V instructions unsupported!");
         InstStateMachinePtr sm = rv_inst->getStateMachine(&t_info);
         sm->setup(&t_info);
         if(rv_inst->pendingMem(sm, &t_info)){
@@ -1062,6 +1030,7 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
             statePendingMem = sm;
             faultPendingMem = fault;
         } else{
+            sm->release();
             completeInstExec(fault);
         }
     } else {
@@ -1073,6 +1042,103 @@ TimingSimpleNCacheCPU::completeIfetch(PacketPtr pkt)
     }
 }
 
+void
+TimingSimpleNCacheCPU::initiateMemRef(SimpleExecContext& t_info,
+        RiscvStaticInst* rv_inst) {
+    // load or store: just send to dcache
+    storeSize = 0; // set by writeMem
+    Fault fault = curStaticInst->initiateAcc(&t_info, traceData);
+
+    // a faulting access neither loads nor stores anything
+    if(fault == NoFault) {
+        if(curStaticInst->isLoad()) { // probably better remove
+            // in overlap mode, only once the check has passed
+            if(!overlapNCache) {
+                trackLoad(t_info, rv_inst);
+            }
+        } else if(curStaticInst->isStore()) {
+            trackStore(t_info, rv_inst);
+        }
+    }
+
+    // If we're not running now the instruction will complete in a dcache
+    // response callback or the instruction faulted and has started an
+    // ifetch
+    if (_status == BaseSimpleCPU::Running) {
+        if (fault != NoFault && traceData) {
+            traceFault();
+        }
+
+        if(!issueNCacheCommands(fault)){
+            postExecute();
+            // @todo remove me after debugging with legion done
+            if (curStaticInst && (!curStaticInst->isMicroop() ||
+                        curStaticInst->isFirstMicroop()))
+                instCnt++;
+            advanceInst(fault);
+        }
+    }
+}
+
+void
+TimingSimpleNCacheCPU::trackLoad(SimpleExecContext& t_info,
+        RiscvStaticInst* rv_inst) {
+    cleanupDest(t_info, rv_inst);
+
+    // check if the value to be loaded in would be a capability
+    DPRINTF(CapstoneNodeOps, "load from %llx\n", rv_inst->getAddr(&t_info, traceData));
+    CapLoc mem_loc = CapLoc::makeMem(rv_inst->getAddr(&t_info, traceData));
+    NodeID node_id = node_controller->queryCapTrack(mem_loc);
+    if(node_id != NODE_ID_INVALID) {
+        // if yes, record the reg as a capability
+        // TODO: strictly this should be done during wb
+        panic_if(rv_inst->numDestRegs() != 1, "load instruction should have exactly 1 destination register");
+        node_controller->addCapTrack(
+                CapLoc::makeReg(t_info.thread->contextId(),
+                    rv_inst->destRegIdx(0).index()),
+                node_id);
+        pushRcUpdate(node_id, 1);
+    }
+}
+
+void
+TimingSimpleNCacheCPU::trackStore(SimpleExecContext& t_info,
+        RiscvStaticInst* rv_inst) {
+    if(storeSize == 0) { // no data written
+        return;
+    }
+    // check for overwriting in-memory capabilities, including the ones
+    // the store only partially overlaps
+    Addr addr = rv_inst->getAddr(&t_info, traceData);
+    DPRINTF(CapstoneNodeOps, "store to %llx\n", addr);
+    CapLoc mem_loc = CapLoc::makeMem(addr);
+    clearMemCaps(addr, storeSize);
+
+    // check for writing capability to memory
+    panic_if(rv_inst->numSrcRegs() != 2, "store instructions should have exactly 2 source registers"); 
+    RegId reg_id = rv_inst->srcRegIdx(1);
+    if(reg_id.classValue() == RegClassType::IntRegClass &&
+            storeSize == CapTrackTable::CAP_SIZE){
+        RegIndex reg_idx = reg_id.index();
+        CapLoc reg_loc = CapLoc::makeReg(t_info.thread->contextId(), reg_idx);
+        NodeID reg_node = node_controller->queryCapTrack(reg_loc);
+        if(reg_node != NODE_ID_INVALID) {
+            node_controller->addCapTrack(mem_loc, reg_node);
+            pushRcUpdate(reg_node, 1);
+        }
+    }
+}
+
+Fault
+TimingSimpleNCacheCPU::capCheckFault(SimpleExecContext& t_info,
+        RiscvStaticInst* rv_inst, bool store) {
+    ++ overlapStats.checkFaults;
+    Addr addr = rv_inst->getAddr(&t_info, traceData);
+    DPRINTF(CapstoneNodeOps, "cap check failed for %llx\n", addr);
+    return std::make_shared<AddressFault>(addr,
+            store ? ExceptionCode::STORE_ACCESS : ExceptionCode::LOAD_ACCESS);
+}
+
 void
 TimingSimpleNCacheCPU::completeInstExec(Fault fault) {
     DPRINTF(CapstoneNodeOps, "complete inst exec\n");
@@ -1085,7 +1151,7 @@ TimingSimpleNCacheCPU::completeInstExec(Fault fault) {
         }
     }
 
-    if(!issueNCacheCommands()){
+    if(!issueNCacheCommands(fault)){
         postExecute();
         // @todo remove me after debugging with legion done
         if (curStaticInst && (!curStaticInst->isMicroop() ||
@@ -1274,7 +1340,7 @@ TimingSimpleNCacheCPU::endHandlingDCacheResp(PacketPtr pkt,
 
     delete pkt;
 
-    if(!issueNCacheCommands()){
+    if(!issueNCacheCommands(fault)){
         postExecute();
         advanceInst(fault);
     }
@@ -1544,6 +1610,21 @@ void TimingSimpleNCacheCPU::NCachePort::NCacheRespTickEvent::schedule(
 
 void
 TimingSimpleNCacheCPU::handleNCacheResp(PacketPtr pkt) {
+    auto async_it = std::find(asyncRcPkts.begin(), asyncRcPkts.end(), pkt);
+    if(async_it != asyncRcPkts.end()) {
+        // an rc update retiring in the background
+        asyncRcPkts.erase(async_it);
+        ncachePacketPool.release(pkt);
+        finishIssuingNCacheCommands();
+        return;
+    }
+    if(capCheckOutstanding) {
+        capCheckOutstanding = false;
+        -- ncOutstanding;
+        handleCapCheckResp(pkt);
+        return;
+    }
+
     switch(ncache_status){
         case NCACHE_INSTR_EXECUTION:
             if(instPendingMem == NULL) {
@@ -1552,8 +1633,9 @@ TimingSimpleNCacheCPU::handleNCacheResp(PacketPtr pkt) {
                 SimpleExecContext* xc = threadInfo[curThread];
                 Fault fault = instPendingMem->handleMemResp(statePendingMem, xc, pkt);
                 //Fault fault = instPendingMem->handleMemResp(statePendingMem, xc, pkt);
-                delete pkt;
+                ncachePacketPool.release(pkt);
                 if(!instPendingMem->pendingMem(statePendingMem, xc)){
+                    statePendingMem->release();
                     instPendingMem = NULL;
                     statePendingMem = nullptr;
                     completeInstExec(faultPendingMem);
@@ -1604,6 +1686,11 @@ void TimingSimpleNCacheCPU::completeNCacheLoad(PacketPtr pkt) {
         PacketPtr data_pkt = dataResps.front();
         dataResps.pop();
         completeDataAccess(data_pkt, pkt);
+    } else if(overlapNCache) {
+        // the data access is still in flight
+        capCheckResp = pkt;
+    } else{
+        ncachePacketPool.release(pkt);
     }
     //} else{
         //nodeResps.push(pkt);
@@ -1611,14 +1698,56 @@ void TimingSimpleNCacheCPU::completeNCacheLoad(PacketPtr pkt) {
 }
 
 
+// the capability check of the current instruction
+void
+TimingSimpleNCacheCPU::handleCapCheckResp(PacketPtr pkt) {
+    DPRINTF(CapstoneNCache, "NCache cap check response\n");
+    if(ncache_status == NCACHE_ISSUE_COMMANDS) {
+        // the instruction faulted before its data access completed
+        ncachePacketPool.release(pkt);
+        finishIssuingNCacheCommands();
+        return;
+    }
+
+    if(accessPendingCheck) {
+        accessPendingCheck = false;
+        bool valid = pkt->getRaw<Node>().state != 0;
+        ncachePacketPool.release(pkt);
+
+        SimpleExecContext& t_info = *threadInfo[curThread];
+        RiscvStaticInst* rv_inst =
+            static_cast<RiscvStaticInst*>(curStaticInst.get());
+        if(valid) {
+            initiateMemRef(t_info, rv_inst);
+        } else{
+            Fault fault = capCheckFault(t_info, rv_inst,
+                    curStaticInst->isStore());
+            if (traceData) {
+                traceFault();
+            }
+            if(!issueNCacheCommands(fault)){
+                postExecute();
+                advanceInst(fault);
+            }
+        }
+        return;
+    }
+
+    completeNCacheLoad(pkt);
+}
+
 void TimingSimpleNCacheCPU::completeDCacheLoad(PacketPtr pkt) {
     DPRINTF(CapstoneNCache, "NCache completeDCacheLoad read %llx\n", pkt->getAddr());
-    //if(ncache_status == NCACHE_INSTR_EXECUTION) {
-        // now we can finish
-    completeDataAccess(pkt, NULL); // TODO: skipping node check for now
-    //} else{
-        //dataResps.push(pkt); // TODO: query is unncessary
-    //}
+    if(capCheckOutstanding) {
+        // finishes when the check responds
+        ++ overlapStats.checkWaits;
+        dataResps.push(pkt);
+        return;
+    }
+    // the response of the check if it came first, NULL if there is no check
+    PacketPtr node_pkt = capCheckResp;
+    capCheckResp = NULL;
+    completeDataAccess(pkt, node_pkt);
 }
 
 void TimingSimpleNCacheCPU::completeDataAccess(
@@ -1626,21 +1755,32 @@ void TimingSimpleNCacheCPU::completeDataAccess(
         PacketPtr node_pkt) {
     DPRINTF(CapstoneNCache, "NCache completeDataAccess\n");
 
+    SimpleExecContext* t_info = threadInfo[curThread];
+    RiscvStaticInst* rv_inst =
+        static_cast<RiscvStaticInst*>(curStaticInst.get());
+
     // perform checks on the revocation node
+    Fault fault = NoFault;
     if(node_pkt == NULL) {
         DPRINTF(CapstoneNCache, "NCache node query skipped\n");
     } else{
-        char node_mdata = *node_pkt->getPtr<char>();
-        delete node_pkt;
+        Node node = node_pkt->getRaw<Node>();
+        ncachePacketPool.release(node_pkt);
 
-        DPRINTF(CapstoneNCache, "NCache node value: %u\n", node_mdata);
+        DPRINTF(CapstoneNCache, "NCache node state: %u\n", node.state);
+        if(node.state == 0) {
+            fault = capCheckFault(*t_info, rv_inst, data_pkt->isWrite());
+        }
     }
 
-    SimpleExecContext* t_info = threadInfo[curThread];
-    //if(node_mdata) {
-        Fault fault = curStaticInst->completeAcc(data_pkt, t_info,
-                traceData);
-        endHandlingDCacheResp(data_pkt, fault);
+    if(fault == NoFault) {
+        if(overlapNCache && curStaticInst->isLoad()) {
+            // before completeAcc overwrites the address registers
+            trackLoad(*t_info, rv_inst);
+        }
+        fault = curStaticInst->completeAcc(data_pkt, t_info, traceData);
+    }
+    endHandlingDCacheResp(data_pkt, fault);
     //} else{
         //endHandlingDCacheResp(data_pkt, 
                 //std::make_shared<AddressFault>(data_pkt->getAddr(),
@@ -1651,10 +1791,16 @@ void TimingSimpleNCacheCPU::completeDataAccess(
 }
 
 void TimingSimpleNCacheCPU::NCachePort::recvReqRetry() {
-    assert(cpu->ncache_pkt != NULL);
+    assert(!cpu->ncRetryPkts.empty());
     
-    if(sendTimingReq(cpu->ncache_pkt)) {
-        cpu->ncache_pkt = NULL;
+    while(!cpu->ncRetryPkts.empty()) {
+        if(!sendTimingReq(cpu->ncRetryPkts.front())) {
+            return;
+        }
+        cpu->ncRetryPkts.pop_front();
+    }
+    if(cpu->ncache_status == NCACHE_ISSUE_COMMANDS || cpu->overlapNCache) {
+        cpu->sendPendingNCacheCommands();
     }
 }
 
@@ -1662,6 +1808,11 @@ void TimingSimpleNCacheCPU::NCachePort::recvReqRetry() {
 void
 TimingSimpleNCacheCPU::preOverwriteDest(NodeID* nodes, 
         int* node_n, SimpleExecContext& t_info, StaticInst* inst) {
+    // the sources holding capabilities
+    uint64_t cap_regs = static_cast<RiscvStaticInst*>(inst)->intSrcMask() &
+        node_controller->capTrackRegMask(t_info.thread->contextId());
+    if(cap_regs == 0)
+        return;
     int num_src = curStaticInst->numSrcRegs();
     DPRINTF(CapstoneNodeOps, "num_src = %d\n", num_src);
     // before execution
@@ -1671,8 +1822,10 @@ TimingSimpleNCacheCPU::preOverwriteDest(NodeID* nodes,
         if(src_id.classValue() != RegClassType::IntRegClass)
             continue;
         RegIndex src_idx = src_id.index();
+        if(!(cap_regs & ((uint64_t)1 << src_idx)))
+            continue;
         DPRINTF(CapstoneNodeOps, "Source %d = %d\n", i, src_idx);
-        CapLoc loc = CapLoc::makeReg(t_info.thread->threadId(), src_idx);
+        CapLoc loc = CapLoc::makeReg(t_info.thread->contextId(), src_idx);
         NodeID node_id = node_controller->queryCapTrack(loc);
         if(node_id == NODE_ID_INVALID)
             continue;
@@ -1686,6 +1839,10 @@ TimingSimpleNCacheCPU::preOverwriteDest(NodeID* nodes,
 
 void
 TimingSimpleNCacheCPU::cleanupDest(SimpleExecContext& t_info, StaticInst* inst) {
+    if((static_cast<RiscvStaticInst*>(inst)->intDestMask() &
+                node_controller->capTrackRegMask(
+                    t_info.thread->contextId())) == 0)
+        return;
     int num_dest = curStaticInst->numDestRegs();
     // before execution
     // check which destinations will be overwritten
@@ -1694,58 +1851,140 @@ TimingSimpleNCacheCPU::cleanupDest(SimpleExecContext& t_info, StaticInst* inst)
         if(dest_id.classValue() != RegClassType::IntRegClass)
             continue;
         RegIndex dest_idx = dest_id.index();
-        CapLoc loc = CapLoc::makeReg(t_info.thread->threadId(), dest_idx);
+        CapLoc loc = CapLoc::makeReg(t_info.thread->contextId(), dest_idx);
         NodeID node_id = node_controller->queryCapTrack(loc);
         if(node_id == NODE_ID_INVALID)
             continue;
         node_controller->removeCapTrack(loc);
-        ncToIssue.push(new NodeControllerRcUpdate(node_id, -1));
+        pushRcUpdate(node_id, -1);
         //node_id = node_controller->queryCapTrack(loc);
         //panic_if(node_id != NODE_ID_INVALID, "erase failed");
     }
 }
 
+void
+TimingSimpleNCacheCPU::clearMemCaps(Addr addr, Addr size) {
+    node_controller->removeCapTrackRange(addr, size, [this](NodeID node_id) {
+        DPRINTF(CapstoneNodeOps, "capability of node %u overwritten\n", node_id);
+        pushRcUpdate(node_id, -1);
+    });
+}
+
+void
+TimingSimpleNCacheCPU::copyMemCaps(Addr dst, Addr src, Addr size) {
+    DPRINTF(CapstoneNodeOps, "bulk copy %llx -> %llx (%llu bytes)\n",
+            src, dst, size);
+    node_controller->copyCapTrackRange(dst, src, size,
+            [this](NodeID node_id, int delta) {
+        pushRcUpdate(node_id, delta);
+    });
+}
+
+void
+TimingSimpleNCacheCPU::pushRcUpdate(NodeID node_id, int delta) {
+    if(coalesceRcUpdates) {
+        rcCoalescer.add(node_id, delta);
+    } else{
+        ncToIssue.push(
+                node_controller->newCommand<NodeControllerRcUpdate>(node_id, delta));
+    }
+}
+
+// called at the end of each instruction, returns true if the instruction
+// has to wait for its node controller commands
 bool
-TimingSimpleNCacheCPU::issueNCacheCommands() {
-    if(!ncToIssue.empty()){
+TimingSimpleNCacheCPU::issueNCacheCommands(const Fault& fault) {
+    // the rc updates of the instruction go after its cap checks
+    rcCoalescer.flush([this](NodeID node_id, int delta) {
+        ncToIssue.push(
+                node_controller->newCommand<NodeControllerRcUpdate>(node_id, delta));
+    });
+    if(capCheckResp != NULL) {
+        // the instruction faulted before its data access completed
+        ncachePacketPool.release(capCheckResp);
+        capCheckResp = NULL;
+    }
+    accessPendingCheck = false;
+
+    sendPendingNCacheCommands();
+    if(ncCommandsRetired()) {
+        return false;
+    }
+    if(overlapNCache && ncOutstanding == 0 && !capCheckOutstanding) {
+        ++ overlapStats.rcBufferStalls;
+    }
+    ncache_status = NCACHE_ISSUE_COMMANDS;
+    faultPendingNCache = fault;
+    return true;
+}
+
+// whether the current instruction can finish
+bool
+TimingSimpleNCacheCPU::ncCommandsRetired() const {
+    if(ncOutstanding > 0 || capCheckOutstanding) {
+        return false;
+    }
+    if(!overlapNCache) {
+        return ncToIssue.empty();
+    }
+    // only rc updates are left, a drained CPU has none in flight
+    size_t limit = drainState() == DrainState::Draining ? 0 : rcUpdateBufferSize;
+    return ncToIssue.size() + asyncRcPkts.size() <= limit;
+}
+
+void
+TimingSimpleNCacheCPU::finishIssuingNCacheCommands() {
+    sendPendingNCacheCommands();
+    if(ncache_status != NCACHE_ISSUE_COMMANDS || !ncCommandsRetired()) {
+        return;
+    }
+    ncache_status = NCACHE_INSTR_EXECUTION;
+    Fault fault = faultPendingNCache;
+    faultPendingNCache = NoFault;
+    postExecute();
+    advanceInst(fault);
+}
+
+// send commands back to back so that the node controller can overlap them
+// stops when the node controller asks for a retry
+void
+TimingSimpleNCacheCPU::sendPendingNCacheCommands() {
+    while(!ncToIssue.empty() && ncRetryPkts.empty()){
         DPRINTF(CapstoneNodeOps, "issued command\n");
         NodeControllerCommandPtr cmd = ncToIssue.front();
         ncToIssue.pop();
 
-        sendNCacheCommand(cmd);
-        ncache_status = NCACHE_ISSUE_COMMANDS;
-        return true;
+        bool async = overlapNCache &&
+            cmd->getType() == NodeControllerCommand::Type::RC_UPDATE;
+        PacketPtr pkt = sendNCacheCommand(cmd);
+        if(async) {
+            asyncRcPkts.push_back(pkt);
+        } else{
+            ++ ncOutstanding;
+        }
     }
-    return false;
 }
 
 void
 TimingSimpleNCacheCPU::handleIssueNCacheCommandsResp(PacketPtr pkt) {
     DPRINTF(CapstoneNodeOps, "received resp for issued command\n");
     //assert(ncache_status == NCACHE_ISSUE_COMMANDS);
-    delete pkt;
-    if(ncToIssue.empty()) {
-        ncache_status = NCACHE_INSTR_EXECUTION;
-        //if(curStaticInst->isMemRef() && !dataResps.empty()){
-            //PacketPtr data_pkt = dataResps.front();
-            //dataResps.pop();
-            //completeDataAccess(pkt, NULL);
-        //} else{
-        // TODO: for now the ncache commands are issued after
-        // dcache responses are ready
-        postExecute();
-        advanceInst(NoFault);
-        //}
-    } else{
-        issueNCacheCommands();
-    }
+    ncachePacketPool.release(pkt);
+    assert(ncOutstanding > 0);
+    -- ncOutstanding;
+    finishIssuingNCacheCommands();
 }
 
 // issue node controller commands that check the validity of the involved capability
-void
+// returns true if a check was issued
+bool
 TimingSimpleNCacheCPU::issueCapChecks(SimpleExecContext& t_info, 
         StaticInst* inst, Addr addr) {
     DPRINTF(CapstoneNodeOps, "To issue cap check 0x%llx\n", addr);
+    if((static_cast<RiscvStaticInst*>(inst)->intSrcMask() &
+                node_controller->capTrackRegMask(
+                    t_info.tcBase()->contextId())) == 0)
+        return false;
     int num_src = inst->numSrcRegs();
     for(int i = 0; i < num_src; i ++){
         const RegId& src_id = inst->srcRegIdx(i);
@@ -1753,19 +1992,20 @@ TimingSimpleNCacheCPU::issueCapChecks(SimpleExecContext& t_info,
             continue;
         RegIndex src_idx = src_id.index();
         NodeID node_id = node_controller->queryCapTrack(
-            CapLoc::makeReg(t_info.tcBase()->threadId(), src_idx));
+            CapLoc::makeReg(t_info.tcBase()->contextId(), src_idx));
         if(node_id == NODE_ID_INVALID ||
-                !node_controller->node2Obj[node_id].contains(addr))
+                !node_controller->node2Obj.get(node_id).contains(addr))
             continue;
         DPRINTF(CapstoneNodeOps, "Issued cap check %u\n", node_id);
-        ncToIssue.push(new NodeControllerQuery(node_id));
-        break;
+        ncToIssue.push(node_controller->newCommand<NodeControllerQuery>(node_id));
+        return true;
     }
+    return false;
 }
 
 void
 TimingSimpleNCacheCPU::overwriteIntReg(NodeID* nodes, int* node_n, ThreadContext* tc, int reg_idx) {
-    CapLoc loc = CapLoc::makeReg(tc->threadId(), reg_idx);
+    CapLoc loc = CapLoc::makeReg(tc->contextId(), reg_idx);
     NodeID node_id = node_controller->queryCapTrack(loc);
     if(node_id != NODE_ID_INVALID) {
         nodes[(*node_n) ++] = node_id;
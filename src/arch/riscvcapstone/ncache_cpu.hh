@@ -41,11 +41,14 @@
 #ifndef __CPU_SIMPLE_TIMING_HH__
 #define __CPU_SIMPLE_TIMING_HH__
 
+#include <deque>
 #include <optional>
 #include <queue>
+#include <vector>
 #include "arch/generic/mmu.hh"
 #include "arch/riscvcapstone/node_controller.hh"
 #include "arch/riscvcapstone/insts/static_inst.hh"
+#include "arch/riscvcapstone/rc_coalescer.hh"
 #include "arch/riscvcapstone/typing.hh"
 #include "cpu/simple/base.hh"
 #include "cpu/simple/exec_context.hh"
@@ -305,7 +308,7 @@ class TimingSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
 
     PacketPtr ifetch_pkt;
     PacketPtr dcache_pkt;
-    PacketPtr ncache_pkt;
+    std::deque<PacketPtr> ncRetryPkts; // command packets to retry, in order
 
     Cycles previousCycle;
 
@@ -382,7 +385,7 @@ class TimingSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
 
     Port& getPort(const std::string& name, PortID idx) override;
 
-    void sendNCacheCommand(NodeControllerCommand* cmd);
+    PacketPtr sendNCacheCommand(NodeControllerCommand* cmd);
 
   private:
 
@@ -392,6 +395,51 @@ class TimingSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
     Fault faultPendingMem;
 
     NCCommandQueue ncToIssue;
+    int ncOutstanding; // commands from ncToIssue waiting for responses
+    Fault faultPendingNCache; // fault of the instruction issuing commands
+
+    // merge the rc updates of each instruction before issuing them
+    const bool coalesceRcUpdates;
+    RcUpdateCoalescer rcCoalescer;
+
+    /**
+     * A memory access through a tracked capability is checked against
+     * its revocation node, and a failed check raises an access fault
+     * before the instruction changes any register, memory or capability
+     * tracking state. Without overlap mode, every checked access waits
+     * for its check before going to memory.
+     *
+     * Overlap mode: the capability check of a load is sent to the node
+     * controller together with the data access, and the load completes
+     * once both have responded. A store is still only sent to memory
+     * after its check passes.
+     *
+     * Rc updates do not hold the instruction back: they retire in the
+     * background, and an instruction only waits for them if more than
+     * rc_update_buffer_size are still unacknowledged.
+     * */
+    const bool overlapNCache;
+    const unsigned int rcUpdateBufferSize;
+    std::vector<PacketPtr> asyncRcPkts; // rc updates sent, not acknowledged
+    bool capCheckOutstanding; // the check of the current instruction
+    PacketPtr capCheckResp; // check response waiting for the data
+    bool accessPendingCheck; // the access waits for its check
+
+    struct NCacheOverlapStats : public statistics::Group {
+        NCacheOverlapStats(statistics::Group* parent) :
+            statistics::Group(parent, "ncacheOverlap"),
+            ADD_STAT(checkWaits, "Number of data accesses that waited "
+                    "for their capability check"),
+            ADD_STAT(checkFaults, "Number of accesses faulting on a "
+                    "revoked capability"),
+            ADD_STAT(rcBufferStalls, "Number of instructions that waited "
+                    "for the rc update buffer")
+        {}
+
+        statistics::Scalar checkWaits;
+        statistics::Scalar checkFaults;
+        statistics::Scalar rcBufferStalls;
+    } overlapStats;
 
     struct IprEvent : Event
     {
@@ -416,6 +464,9 @@ class TimingSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
      * <li>A fetch event is scheduled. Normally this would never be the
      *     case with microPC() == 0, but right after a context is
      *     activated it can happen.
+     *
+     * <li>Node controller commands of the current instruction are still
+     *     being issued or waiting for their responses.
      * </ul>
      */
     bool isCpuDrained() const {
@@ -423,7 +474,9 @@ class TimingSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
         SimpleThread* thread = t_info.thread;
 
         return thread->pcState().microPC() == 0 && !t_info.stayAtPC &&
-               !fetchEvent.scheduled();
+               !fetchEvent.scheduled() &&
+               ncache_status == NCACHE_INSTR_EXECUTION &&
+               asyncRcPkts.empty();
     }
 
     /**
@@ -436,15 +489,27 @@ class TimingSimpleNCacheCPU : public BaseSimpleCPUWithNodeController
     void endHandlingDCacheResp(PacketPtr pkt, Fault fault);
     void completeInstExec(Fault fault);
     void preOverwriteDest(NodeID* nodes, int* node_n, SimpleExecContext& t_info, StaticInst* inst);
-    bool issueNCacheCommands();
+    void pushRcUpdate(NodeID node_id, int delta);
+    bool issueNCacheCommands(const Fault& fault = NoFault);
+    bool ncCommandsRetired() const;
+    void finishIssuingNCacheCommands();
+    void sendPendingNCacheCommands();
     void handleIssueNCacheCommandsResp(PacketPtr pkt);
-    void issueCapChecks(SimpleExecContext& t_info,
+    void handleCapCheckResp(PacketPtr pkt);
+    bool issueCapChecks(SimpleExecContext& t_info,
             StaticInst* inst, Addr addr);
+    void initiateMemRef(SimpleExecContext& t_info, RiscvStaticInst* rv_inst);
+    void trackLoad(SimpleExecContext& t_info, RiscvStaticInst* rv_inst);
+    void trackStore(SimpleExecContext& t_info, RiscvStaticInst* rv_inst);
+    Fault capCheckFault(SimpleExecContext& t_info, RiscvStaticInst* rv_inst,
+            bool store);
     void overwriteIntReg(NodeID* nodes, int* node_n, ThreadContext* tc, int reg_idx);
     void cleanupDest(SimpleExecContext& t_info, StaticInst* inst);
 
     Port &getNodePort() override { return ncache_port; }
     NodeController* getNodeController() override { return node_controller; }
+    void clearMemCaps(Addr addr, Addr size) override;
+    void copyMemCaps(Addr dst, Addr src, Addr size) override;
 
 };
 
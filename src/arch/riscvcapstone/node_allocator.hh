@@ -0,0 +1,222 @@
+#ifndef NODE_ALLOCATOR_H
+#define NODE_ALLOCATOR_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arch/riscvcapstone/cap_track.hh"
+#include "arch/riscvcapstone/sparse_table.hh"
+#include "arch/riscvcapstone/types.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * Locality-aware allocation of revocation nodes. Node IDs are split into
+ * slabs of consecutive nodes, and a child is placed in the slab of its
+ * parent while there is room. Once a slab is full, its children go to
+ * its overflow slab (a fresh one if possible), so a subtree, which the
+ * revocation walk visits in order, stays on few lines.
+ *
+ * Each slab has its own free list. Like the global free list, it is
+ * linked through the next field of the free nodes in memory, so taking
+ * a node off it still needs the node to be loaded first: pick() chooses
+ * the node, and take() commits the choice once the next free node is
+ * known. Only the heads and the fill levels of the slabs are kept here.
+ * */
+class SlabNodeAllocator {
+    public:
+        struct Choice {
+            NodeID nodeId;
+            bool fromFreeList;
+        };
+
+        struct Slab {
+            NodeID freeHead; // free list within the slab
+            NodeID used; // nodes handed out without the free list
+            NodeID overflow; // slab for the children when this one is full
+            bool listed; // in partialSlabs
+        };
+
+    private:
+        const NodeID nodeCount;
+        const NodeID slabSize;
+        NodeID slabsReserved; // slabs [0, slabsReserved) are in use
+        NodeID rootSlab; // the slab for nodes without a parent
+        SparseTable<Slab> slabs;
+        std::vector<NodeID> partialSlabs; // slabs that got free nodes
+
+        static Slab
+        emptySlab() {
+            Slab s;
+            s.freeHead = NODE_ID_INVALID;
+            s.used = 0;
+            s.overflow = NODE_ID_INVALID;
+            s.listed = false;
+            return s;
+        }
+
+        NodeID
+        capacity(NodeID slab) const {
+            NodeID start = slab * slabSize;
+            return nodeCount - start < slabSize ? nodeCount - start : slabSize;
+        }
+
+        bool
+        hasRoom(NodeID slab) const {
+            if(slab == NODE_ID_INVALID || slab >= slabsReserved) {
+                return false;
+            }
+            const Slab& s = slabs.get(slab);
+            return s.freeHead != NODE_ID_INVALID || s.used < capacity(slab);
+        }
+
+        // a slab with room for the overflow of a full one
+        NodeID
+        spareSlab() {
+            if(slabsReserved < slabs.size()) {
+                return slabsReserved ++;
+            }
+            while(!partialSlabs.empty()) {
+                NodeID slab = partialSlabs.back();
+                partialSlabs.pop_back();
+                slabs.getMutable(slab).listed = false;
+                if(hasRoom(slab)) {
+                    return slab;
+                }
+            }
+            return NODE_ID_INVALID;
+        }
+
+        Choice
+        pickIn(NodeID slab) const {
+            const Slab& s = slabs.get(slab);
+            if(s.freeHead != NODE_ID_INVALID) {
+                return Choice{s.freeHead, true};
+            }
+            return Choice{slab * slabSize + s.used, false};
+        }
+
+    public:
+        SlabNodeAllocator(NodeID node_count, NodeID slab_size) :
+            nodeCount(node_count), slabSize(slab_size), slabsReserved(0),
+            rootSlab(NODE_ID_INVALID),
+            slabs((node_count + slab_size - 1) / slab_size, emptySlab()) {
+            assert(slab_size > 0);
+        }
+
+        /**
+         * Chooses the node for a new child of parent_id (NODE_ID_INVALID
+         * for a root). Returns NODE_ID_INVALID in nodeId if all nodes are
+         * in use.
+         * */
+        Choice
+        pick(NodeID parent_id) {
+            NodeID home = parent_id == NODE_ID_INVALID ?
+                rootSlab : parent_id / slabSize;
+            if(hasRoom(home)) {
+                return pickIn(home);
+            }
+            NodeID overflow = home == NODE_ID_INVALID ?
+                NODE_ID_INVALID : slabs.get(home).overflow;
+            if(!hasRoom(overflow)) {
+                overflow = spareSlab();
+                if(overflow == NODE_ID_INVALID) {
+                    return Choice{NODE_ID_INVALID, false};
+                }
+                if(home == NODE_ID_INVALID) {
+                    rootSlab = overflow;
+                } else{
+                    slabs.getMutable(home).overflow = overflow;
+                }
+            }
+            return pickIn(overflow);
+        }
+
+        // commits a choice, next_free is the next field of the free node
+        void
+        take(const Choice& choice, NodeID next_free) {
+            Slab& s = slabs.getMutable(choice.nodeId / slabSize);
+            if(choice.fromFreeList) {
+                assert(s.freeHead == choice.nodeId);
+                s.freeHead = next_free;
+            } else{
+                assert(choice.nodeId % slabSize == s.used);
+                ++ s.used;
+            }
+        }
+
+        // returns the free node to link after node_id
+        NodeID
+        release(NodeID node_id) {
+            NodeID slab = node_id / slabSize;
+            Slab& s = slabs.getMutable(slab);
+            NodeID next = s.freeHead;
+            s.freeHead = node_id;
+            // so that the node is found even if no parent lives in the slab
+            if(!s.listed) {
+                s.listed = true;
+                partialSlabs.push_back(slab);
+            }
+            return next;
+        }
+
+        NodeID
+        slabNodes() const {
+            return slabSize;
+        }
+
+        NodeID
+        slabOf(NodeID node_id) const {
+            return node_id / slabSize;
+        }
+
+        // calls f(slab index, slab) for each slab in use
+        template<typename F>
+        void
+        forEachSlab(F f) const {
+            for(NodeID i = 0; i < slabsReserved; ++ i) {
+                f(i, slabs.get(i));
+            }
+        }
+
+        NodeID
+        reservedSlabs() const {
+            return slabsReserved;
+        }
+
+        NodeID
+        rootSlabIndex() const {
+            return rootSlab;
+        }
+
+        const std::vector<NodeID>&
+        partialSlabList() const {
+            return partialSlabs;
+        }
+
+        // for checkpoint restore
+        void
+        restore(NodeID root_slab, const std::vector<Slab>& used_slabs,
+                const std::vector<NodeID>& partial_slabs) {
+            clear();
+            rootSlab = root_slab;
+            for(const Slab& s : used_slabs) {
+                slabs.set(slabsReserved ++, s);
+            }
+            partialSlabs = partial_slabs;
+        }
+
+        void
+        clear() {
+            slabs.clear();
+            partialSlabs.clear();
+            slabsReserved = 0;
+            rootSlab = NODE_ID_INVALID;
+        }
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
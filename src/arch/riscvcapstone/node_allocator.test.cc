@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "arch/riscvcapstone/node_allocator.hh"
+
+using namespace gem5::RiscvcapstoneISA;
+
+namespace {
+
+// keeps the next fields of the free nodes, like the node memory
+struct Nodes {
+    SlabNodeAllocator allocator;
+    std::vector<NodeID> next;
+
+    Nodes(NodeID node_count, NodeID slab_size) :
+        allocator(node_count, slab_size), next(node_count, NODE_ID_INVALID) {}
+
+    NodeID
+    allocate(NodeID parent_id) {
+        SlabNodeAllocator::Choice choice = allocator.pick(parent_id);
+        if(choice.nodeId != NODE_ID_INVALID) {
+            allocator.take(choice, next[choice.nodeId]);
+        }
+        return choice.nodeId;
+    }
+
+    void
+    free(NodeID node_id) {
+        next[node_id] = allocator.release(node_id);
+    }
+};
+
+} // anonymous namespace
+
+TEST(SlabNodeAllocatorTest, ChildrenNearParent)
+{
+    Nodes nodes(64, 4);
+    NodeID root = nodes.allocate(NODE_ID_INVALID);
+    NodeID other_root = nodes.allocate(NODE_ID_INVALID);
+    EXPECT_EQ(nodes.allocator.slabOf(root), nodes.allocator.slabOf(other_root));
+
+    NodeID child = nodes.allocate(root);
+    EXPECT_EQ(nodes.allocator.slabOf(child), nodes.allocator.slabOf(root));
+    NodeID grandchild = nodes.allocate(child);
+    EXPECT_EQ(nodes.allocator.slabOf(grandchild), nodes.allocator.slabOf(root));
+
+    // the slab of the roots is full, so the children of root overflow
+    // into one fresh slab together
+    NodeID a = nodes.allocate(root);
+    NodeID b = nodes.allocate(child);
+    EXPECT_NE(nodes.allocator.slabOf(a), nodes.allocator.slabOf(root));
+    EXPECT_EQ(nodes.allocator.slabOf(a), nodes.allocator.slabOf(b));
+    // and the children of a stay with a
+    EXPECT_EQ(nodes.allocator.slabOf(nodes.allocate(a)),
+            nodes.allocator.slabOf(a));
+    EXPECT_EQ(nodes.allocator.reservedSlabs(), 2);
+}
+
+TEST(SlabNodeAllocatorTest, ReusesFreedNodes)
+{
+    Nodes nodes(8, 4);
+    std::vector<NodeID> ids;
+    for(int i = 0; i < 8; ++ i) {
+        ids.push_back(nodes.allocate(NODE_ID_INVALID));
+        ASSERT_NE(ids.back(), NODE_ID_INVALID);
+    }
+    EXPECT_EQ(nodes.allocate(NODE_ID_INVALID), NODE_ID_INVALID);
+
+    // freed nodes come back in the slab of their parent first
+    nodes.free(1);
+    nodes.free(2);
+    EXPECT_EQ(nodes.allocate(0), 2);
+    EXPECT_EQ(nodes.allocate(3), 1);
+    EXPECT_EQ(nodes.allocate(0), NODE_ID_INVALID);
+
+    // a parent in a full slab finds free nodes in other slabs
+    nodes.free(6);
+    EXPECT_EQ(nodes.allocate(0), 6);
+}
+
+TEST(SlabNodeAllocatorTest, Restore)
+{
+    Nodes nodes(32, 8);
+    NodeID root = nodes.allocate(NODE_ID_INVALID);
+    for(int i = 0; i < 10; ++ i) {
+        nodes.allocate(root);
+    }
+    nodes.free(3);
+
+    std::vector<SlabNodeAllocator::Slab> slabs;
+    nodes.allocator.forEachSlab(
+            [&slabs](NodeID slab, const SlabNodeAllocator::Slab& s) {
+        slabs.push_back(s);
+    });
+    SlabNodeAllocator restored(32, 8);
+    restored.restore(nodes.allocator.rootSlabIndex(), slabs,
+            nodes.allocator.partialSlabList());
+
+    for(int i = 0; i < 4; ++ i) {
+        SlabNodeAllocator::Choice expected = nodes.allocator.pick(root);
+        SlabNodeAllocator::Choice choice = restored.pick(root);
+        EXPECT_EQ(choice.nodeId, expected.nodeId);
+        EXPECT_EQ(choice.fromFreeList, expected.fromFreeList);
+        nodes.allocator.take(expected, nodes.next[expected.nodeId]);
+        restored.take(choice, nodes.next[choice.nodeId]);
+    }
+}
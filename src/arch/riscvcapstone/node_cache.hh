@@ -0,0 +1,168 @@
+#ifndef NODE_CACHE_H
+#define NODE_CACHE_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arch/riscvcapstone/cap_track.hh"
+#include "arch/riscvcapstone/types.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * Storage of the node cache in the node controller: a set-associative
+ * cache with one revocation node per entry, LRU replacement and
+ * write-back of dirty nodes. It only keeps the contents, the controller
+ * does the memory accesses.
+ *
+ * Nodes are mapped to sets by their IDs, so the neighbours of a node in
+ * the tree (which are usually allocated around the same time) do not
+ * conflict with each other.
+ * */
+template<typename T>
+class NodeCache {
+    public:
+        struct Entry {
+            NodeID id; // NODE_ID_INVALID for an empty entry
+            bool dirty;
+            bool prefetched; // filled by a prefetch and not used yet
+            uint64_t lastUse;
+            T value;
+        };
+
+    private:
+        std::vector<Entry> entries; // set after set
+        size_t setCount;
+        unsigned int assoc;
+        uint64_t useCount; // for LRU
+        size_t dirtyEntries;
+
+        Entry*
+        set(NodeID node_id) {
+            return &entries[(node_id % setCount) * assoc];
+        }
+
+        const Entry*
+        set(NodeID node_id) const {
+            return &entries[(node_id % setCount) * assoc];
+        }
+
+    public:
+        NodeCache(size_t entry_count, unsigned int assoc) :
+            setCount(assoc == 0 ? 0 : entry_count / assoc),
+            assoc(assoc), useCount(0), dirtyEntries(0) {
+            Entry empty = Entry();
+            empty.id = NODE_ID_INVALID;
+            entries.resize(setCount * assoc, empty);
+        }
+
+        bool
+        enabled() const {
+            return !entries.empty();
+        }
+
+        // the entry holding the node, or nullptr on a miss
+        Entry*
+        lookup(NodeID node_id) {
+            Entry* s = set(node_id);
+            for(unsigned int i = 0; i < assoc; ++ i) {
+                if(s[i].id == node_id) {
+                    s[i].lastUse = ++ useCount;
+                    return &s[i];
+                }
+            }
+            return nullptr;
+        }
+
+        // same as lookup, without touching the replacement state
+        bool
+        contains(NodeID node_id) const {
+            const Entry* s = set(node_id);
+            for(unsigned int i = 0; i < assoc; ++ i) {
+                if(s[i].id == node_id) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Puts the node in the cache, replacing the LRU entry of its set
+         * if it is not there yet. Returns true if a dirty node was
+         * evicted, in which case it is copied to victim and has to be
+         * written back.
+         * */
+        bool
+        insert(NodeID node_id, const T& value, bool dirty,
+                Entry* victim, bool prefetched = false) {
+            assert(node_id != NODE_ID_INVALID);
+            Entry* s = set(node_id);
+            Entry* e = nullptr;
+            for(unsigned int i = 0; i < assoc; ++ i) {
+                if(s[i].id == node_id) {
+                    e = &s[i];
+                    break;
+                }
+                if(e == nullptr || s[i].id == NODE_ID_INVALID ||
+                        (e->id != NODE_ID_INVALID &&
+                         s[i].lastUse < e->lastUse)) {
+                    e = &s[i];
+                }
+            }
+            bool evicted = false;
+            if(e->id != node_id) {
+                if(e->id != NODE_ID_INVALID && e->dirty) {
+                    *victim = *e;
+                    evicted = true;
+                }
+                if(e->dirty) {
+                    -- dirtyEntries;
+                }
+                e->id = node_id;
+                e->dirty = false;
+                e->prefetched = prefetched;
+            }
+            if(dirty && !e->dirty) {
+                ++ dirtyEntries;
+            }
+            e->dirty = e->dirty || dirty;
+            e->value = value;
+            e->lastUse = ++ useCount;
+            return evicted;
+        }
+
+        size_t
+        dirtyCount() const {
+            return dirtyEntries;
+        }
+
+        // calls f(node_id, value) for each dirty node and marks it clean
+        template<typename F>
+        void
+        cleanAll(F f) {
+            for(Entry& e : entries) {
+                if(e.id != NODE_ID_INVALID && e.dirty) {
+                    f(e.id, e.value);
+                    e.dirty = false;
+                }
+            }
+            dirtyEntries = 0;
+        }
+
+        // drops all nodes, including the dirty ones
+        void
+        clear() {
+            for(Entry& e : entries) {
+                e.id = NODE_ID_INVALID;
+                e.dirty = false;
+                e.prefetched = false;
+            }
+            dirtyEntries = 0;
+        }
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
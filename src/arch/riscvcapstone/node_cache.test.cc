@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "arch/riscvcapstone/node_cache.hh"
+
+using namespace gem5::RiscvcapstoneISA;
+
+typedef NodeCache<int> IntNodeCache;
+
+TEST(NodeCacheTest, Disabled)
+{
+    IntNodeCache cache(0, 0);
+    EXPECT_FALSE(cache.enabled());
+}
+
+TEST(NodeCacheTest, HitAndMiss)
+{
+    IntNodeCache cache(8, 2);
+    IntNodeCache::Entry victim;
+    EXPECT_TRUE(cache.enabled());
+    EXPECT_EQ(cache.lookup(3), nullptr);
+
+    EXPECT_FALSE(cache.insert(3, 30, false, &victim));
+    IntNodeCache::Entry* e = cache.lookup(3);
+    ASSERT_NE(e, nullptr);
+    EXPECT_EQ(e->value, 30);
+    EXPECT_FALSE(e->dirty);
+    EXPECT_TRUE(cache.contains(3));
+    EXPECT_FALSE(cache.contains(7)); // same set
+}
+
+TEST(NodeCacheTest, EvictsLeastRecentlyUsed)
+{
+    IntNodeCache cache(8, 2); // 4 sets
+    IntNodeCache::Entry victim;
+    cache.insert(1, 10, true, &victim);
+    cache.insert(5, 50, false, &victim);
+    cache.lookup(1);
+
+    // 9 maps to the same set as 1 and 5, and 5 is the LRU one
+    EXPECT_FALSE(cache.insert(9, 90, false, &victim));
+    EXPECT_FALSE(cache.contains(5));
+    EXPECT_TRUE(cache.contains(1));
+
+    // now 1 is the LRU one, and it is dirty
+    EXPECT_TRUE(cache.insert(13, 130, false, &victim));
+    EXPECT_EQ(victim.id, 1);
+    EXPECT_EQ(victim.value, 10);
+    EXPECT_EQ(cache.dirtyCount(), 0);
+}
+
+TEST(NodeCacheTest, CleanAll)
+{
+    IntNodeCache cache(8, 2);
+    IntNodeCache::Entry victim;
+    cache.insert(0, 1, true, &victim);
+    cache.insert(1, 2, false, &victim);
+    cache.insert(2, 3, true, &victim);
+    cache.insert(2, 4, false, &victim); // stays dirty
+    EXPECT_EQ(cache.dirtyCount(), 2);
+
+    std::vector<int> written;
+    cache.cleanAll([&](NodeID node_id, int value) {
+        written.push_back(value);
+    });
+    EXPECT_EQ(written, (std::vector<int>{1, 4}));
+    EXPECT_EQ(cache.dirtyCount(), 0);
+    EXPECT_TRUE(cache.contains(2));
+
+    cache.clear();
+    EXPECT_FALSE(cache.contains(0));
+}
+
+TEST(NodeCacheTest, Prefetched)
+{
+    IntNodeCache cache(4, 4);
+    IntNodeCache::Entry victim;
+    cache.insert(6, 60, false, &victim, true);
+    EXPECT_TRUE(cache.lookup(6)->prefetched);
+    // a later write does not reset the flag, the user clears it
+    cache.insert(6, 61, true, &victim);
+    EXPECT_TRUE(cache.lookup(6)->prefetched);
+}
@@ -1,5 +1,9 @@
+#include<algorithm>
 #include<stdexcept>
 #include<cstring>
+#include<iterator>
+#include<zlib.h>
+#include "base/cast.hh"
 #include "mem/packet_access.hh"
 #include "arch/riscvcapstone/node_controller.hh"
 #include "base/trace.hh"
@@ -7,16 +11,30 @@
 #include "debug/CapstoneCapTrack.hh"
 #include "debug/CapstoneNodeOps.hh"
 #include "debug/CapstoneNodeOpsAtomic.hh"
+#include "debug/Checkpoint.hh"
+#include "debug/Drain.hh"
 #include "node_controller.hh"
+#include "base/output.hh"
+#include "config/have_protobuf.hh"
+#include "sim/core.hh"
+
+#if HAVE_PROTOBUF
+#include "arch/riscvcapstone/node_cmd.pb.h"
+#include "proto/protoio.hh"
+#endif
 
 
 /*
  *
- * Note: current implementation is not very performant.
- * The whole revocation node subsystem will be blocked for every
- * request.
+ * Note: the controller keeps up to cmd_queue_depth commands at a time.
+ * Commands that only touch a single node (queries and rc updates) are
+ * overlapped unless they target the same node. Allocations and
+ * revocations touch arbitrary nodes and the free list, so they wait for
+ * all older commands and block all younger ones.
  *
- * Might consider optimising this in the future.
+ * With async_revoke, a revocation only blocks younger commands until its
+ * root node is invalidated. It then responds and sweeps the subtree in the
+ * background (see startSweep).
  * */
 
 
@@ -25,27 +43,130 @@ namespace gem5::RiscvcapstoneISA {
 NodeController::NodeController(const NodeControllerParams& p) :
     ClockedObject(p),
     stats(this),
-    currentPkt(NULL),
+    nodeCacheStats(this),
+    packetPool(this, "packetPool"),
+    cmdQueueDepth(p.cmd_queue_depth),
+    portQueueDepth(p.port_queue_depth),
     mem_side(this),
-    cpu_side(this),
+    arbitrateEvent([this]{ arbitrate(); }, name() + ".arbitrate"),
+    lastArbitratedPort(0),
     system(p.system),
+    sweep(nullptr),
+    sweepNode(NODE_ID_INVALID),
+    sweepBlockedOn(NODE_ID_INVALID),
+    sweepRootDepth(0),
+    sweepStart(0),
+    nodeCache(p.node_cache_entries, p.node_cache_assoc),
+    nodeCacheLatency(p.node_cache_latency),
+    nodeCachePrefetch(p.node_cache_prefetch),
+    nodeCacheRespEvent([this]{ sendNodeCacheResps(); },
+            name() + ".nodeCacheResp"),
+    writebacksInFlight(0),
+    atomicLatency(0),
+    functionalAtomic(p.functional_atomic),
+    hostNodes(p.node_count, HostNode()),
+    traceStream(nullptr),
+    asyncRevoke(p.async_revoke),
+    allocPolicy(p.alloc_policy),
+    slabAllocator(p.node_count, std::max(p.alloc_slab_size, 1U)),
     freeNodeInited(0),
     free_head(NODE_ID_INVALID),
-    tree_root(NODE_ID_INVALID) {
+    tree_root(NODE_ID_INVALID),
+    nodeCount(p.node_count),
+    node2Obj(p.node_count) {
+    fatal_if(nodeCount == 0 || nodeCount >= NODE_ID_INVALID,
+            "node_count must be between 1 and %u", NODE_ID_INVALID - 1);
+    fatal_if(p.node_cache_entries != 0 && (p.node_cache_assoc == 0 ||
+                p.node_cache_entries % p.node_cache_assoc != 0),
+            "node_cache_entries must be a multiple of node_cache_assoc");
+    fatal_if(p.alloc_slab_size == 0, "alloc_slab_size must not be 0");
+    if(p.trace_file != "") {
+#if HAVE_PROTOBUF
+        traceStream = new ProtoOutputStream(simout.resolve(p.trace_file));
+        ProtoMessage::NodeCmdHeader header_msg;
+        header_msg.set_obj_id(name());
+        header_msg.set_tick_freq(sim_clock::Frequency);
+        header_msg.set_node_count(nodeCount);
+        traceStream->write(header_msg);
+        // the destructor is not called at the end of the simulation
+        registerExitCallback([this]() { closeTrace(); });
+#else
+        fatal("%s: trace_file requires protobuf support\n", name());
+#endif
+    }
     DPRINTF(CapstoneNCache, "Size of node = %u\n", sizeof(Node));
+
+    for(PortID i = 0; i < (PortID)p.port_cpu_side_connection_count; ++ i) {
+        cpuSidePorts.push_back(new CPUSidePort(this, i));
+    }
+    stats.portReqCount.init(cpuSidePorts.size());
+}
+
+NodeController::~NodeController() {
+    for(CPUSidePort* port : cpuSidePorts) {
+        delete port;
+    }
+    closeTrace();
+}
+
+void
+NodeController::closeTrace() {
+#if HAVE_PROTOBUF
+    delete traceStream;
+#endif
+    traceStream = nullptr;
 }
 
-NodeController::CPUSidePort::CPUSidePort(NodeController* owner) :
-    ResponsePort(owner->name() + ".cpu_side", owner),
+void
+NodeController::traceCommand(NodeControllerCommandPtr cmd, Tick arrival,
+        PortID port, PacketPtr pkt) {
+#if HAVE_PROTOBUF
+    if(traceStream == nullptr) {
+        return;
+    }
+    ProtoMessage::NodeCmd cmd_msg;
+    cmd_msg.set_tick(arrival);
+    cmd_msg.set_type(cmd->getType());
+    if(port != InvalidPortID) {
+        cmd_msg.set_port(port);
+    }
+    switch(cmd->getType()) {
+        case NodeControllerCommand::Type::ALLOCATE:
+            cmd_msg.set_node_id(
+                    static_cast<NodeControllerAllocate*>(cmd)->parentId);
+            cmd_msg.set_result(pkt->getRaw<NodeID>());
+            break;
+        case NodeControllerCommand::Type::RC_UPDATE:
+            cmd_msg.set_node_id(cmd->getNodeId());
+            cmd_msg.set_delta(static_cast<NodeControllerRcUpdate*>(cmd)->delta);
+            break;
+        case NodeControllerCommand::Type::REVOKE:
+            cmd_msg.set_node_id(static_cast<NodeControllerRevoke*>(cmd)->nodeId);
+            break;
+        case NodeControllerCommand::Type::REVOKE_BATCH:
+            for(NodeID node_id : static_cast<NodeControllerRevokeBatch*>(cmd)->roots) {
+                cmd_msg.add_node_ids(node_id);
+            }
+            break;
+        default:
+            cmd_msg.set_node_id(cmd->getNodeId());
+    }
+    traceStream->write(cmd_msg);
+#endif
+}
+
+NodeController::CPUSidePort::CPUSidePort(NodeController* owner, PortID id) :
+    ResponsePort(owner->name() + ".cpu_side[" + std::to_string(id) + "]",
+            owner),
     owner(owner),
-    retryPkt(NULL),
-    toRetryReq(false) {
+    toRetryReq(false),
+    id(id) {
 }
 
 
 bool
 NodeController::MemSidePort::recvTimingResp(PacketPtr pkt) {
-    owner->handleResp(pkt); // always succeed
+    owner->handleMemResp(pkt); // always succeed
     // no need to send retry response because responses are
     // always successfully handled
     return true;
@@ -54,16 +175,19 @@ NodeController::MemSidePort::recvTimingResp(PacketPtr pkt) {
 
 void
 NodeController::MemSidePort::recvReqRetry() {
-    assert(retryPkt != NULL);
-    PacketPtr pkt = retryPkt;
-    retryPkt = NULL;
-    trySendReq(pkt);
+    assert(!retryPkts.empty());
+    while(!retryPkts.empty()) {
+        if(!sendTimingReq(retryPkts.front())) {
+            return;
+        }
+        retryPkts.pop_front();
+    }
 }
 
 void
 NodeController::sendPacketToMem(PacketPtr pkt, bool atomic) {
     if(atomic) {
-        mem_side.sendAtomic(pkt);
+        atomicLatency += mem_side.sendAtomic(pkt);
     } else {
         mem_side.trySendReq(pkt);
     }
@@ -76,6 +200,10 @@ NodeController::sendLoad(NodeControllerCommandPtr cmd, NodeID node_id, bool atom
             ++ stats.allocatePacketLoadCount;
             break;
         case NodeControllerCommand::Type::REVOKE:
+            ++ stats.revokePacketLoadCount;
+            touchRevokeLine(cmd, node_id);
+            break;
+        case NodeControllerCommand::Type::REVOKE_BATCH:
             ++ stats.revokePacketLoadCount;
             break;
         case NodeControllerCommand::Type::RC_UPDATE:
@@ -87,14 +215,16 @@ NodeController::sendLoad(NodeControllerCommandPtr cmd, NodeID node_id, bool atom
         default:;
     }
 
+    if(nodeCache.enabled()) {
+        return nodeCacheAccess(cmd, node_id, nullptr, atomic);
+    }
+
     Addr addr = nodeId2Addr(node_id);
     DPRINTF(CapstoneNodeOps, "send load %lx\n", addr);
-    RequestPtr req = std::make_shared<Request>();
-    req->requestorId(requestorId);
-    req->setPaddr(addr);
-    PacketPtr pkt = Packet::createRead(req);
-    pkt->setSize(sizeof(Node)); // FIXME: do we need to specify the size here?
-    pkt->allocate();
+    PacketPtr pkt = packetPool.acquire(MemCmd::ReadReq, requestorId, addr);
+    if(!atomic) {
+        pkt->pushSenderState(senderStatePool.acquire(cmd));
+    }
 
     sendPacketToMem(pkt, atomic);
     return pkt;
@@ -108,6 +238,7 @@ NodeController::sendStore(NodeControllerCommandPtr cmd, NodeID node_id, const No
             ++ stats.allocatePacketStoreCount;
             break;
         case NodeControllerCommand::Type::REVOKE:
+        case NodeControllerCommand::Type::REVOKE_BATCH:
             ++ stats.revokePacketStoreCount;
             break;
         case NodeControllerCommand::Type::RC_UPDATE:
@@ -119,27 +250,206 @@ NodeController::sendStore(NodeControllerCommandPtr cmd, NodeID node_id, const No
         default:;
     }
 
+    if(nodeCache.enabled()) {
+        return nodeCacheAccess(cmd, node_id, &node, atomic);
+    }
+
     Addr addr = nodeId2Addr(node_id);
     DPRINTF(CapstoneNodeOps, "send store %lx\n", addr);
-    RequestPtr req = std::make_shared<Request>();
-    req->requestorId(requestorId);
-    req->setPaddr(addr);
-    PacketPtr pkt = Packet::createWrite(req);
-    pkt->setSize(sizeof(Node));
-    pkt->allocate();
+    PacketPtr pkt = packetPool.acquire(MemCmd::WriteReq, requestorId, addr);
     memcpy(pkt->getPtr<void>(), &node, sizeof(Node));
+    if(!atomic) {
+        pkt->pushSenderState(senderStatePool.acquire(cmd));
+    }
 
     sendPacketToMem(pkt, atomic);
     return pkt;
 }
 
+/**
+ * Node accesses through the node cache. The returned packet holds the
+ * node for loads, in the same way as the packets sent to memory.
+ * In timing mode, hits and stores are answered through
+ * nodeCacheRespEvent, and misses go to memory as usual.
+ * */
+PacketPtr
+NodeController::nodeCacheAccess(NodeControllerCommandPtr cmd, NodeID node_id,
+        const Node* store_node, bool atomic) {
+    Addr addr = nodeId2Addr(node_id);
+    if(atomic) {
+        atomicLatency += cyclesToTicks(nodeCacheLatency);
+    }
+    NodeCache<Node>::Entry* entry = nodeCache.lookup(node_id);
+    if(entry != nullptr) {
+        ++ nodeCacheStats.hits;
+        if(entry->prefetched) {
+            ++ nodeCacheStats.usefulPrefetches;
+            entry->prefetched = false;
+        }
+    } else{
+        ++ nodeCacheStats.misses;
+    }
+
+    PacketPtr pkt;
+    if(store_node != nullptr) {
+        // nodes are always written as a whole, no need to fetch on a miss
+        DPRINTF(CapstoneNodeOps, "node cache store %lx\n", addr);
+        NodeCache<Node>::Entry victim;
+        if(nodeCache.insert(node_id, *store_node, true, &victim)) {
+            writeBackNode(victim.id, victim.value, atomic);
+        }
+        pkt = packetPool.acquire(MemCmd::WriteReq, requestorId, addr);
+        memcpy(pkt->getPtr<void>(), store_node, sizeof(Node));
+    } else if(entry != nullptr) {
+        DPRINTF(CapstoneNodeOps, "node cache load hit %lx\n", addr);
+        pkt = packetPool.acquire(MemCmd::ReadReq, requestorId, addr);
+        memcpy(pkt->getPtr<void>(), &entry->value, sizeof(Node));
+        if(!atomic) {
+            prefetchNeighbours(cmd, entry->value);
+        }
+    } else{
+        DPRINTF(CapstoneNodeOps, "node cache load miss %lx\n", addr);
+        pkt = packetPool.acquire(MemCmd::ReadReq, requestorId, addr);
+        if(atomic) {
+            sendPacketToMem(pkt, true);
+            fillNodeCache(node_id, pkt->getRaw<Node>(), false, true);
+        } else{
+            pkt->pushSenderState(senderStatePool.acquire(cmd, node_id));
+            sendPacketToMem(pkt, false);
+        }
+        return pkt;
+    }
+
+    if(!atomic) {
+        pkt->makeResponse();
+        pkt->pushSenderState(senderStatePool.acquire(cmd, node_id));
+        Tick when = clockEdge(nodeCacheLatency);
+        nodeCacheResps.emplace_back(when, pkt);
+        if(!nodeCacheRespEvent.scheduled()) {
+            schedule(nodeCacheRespEvent, when);
+        }
+    }
+    return pkt;
+}
+
+void
+NodeController::sendNodeCacheResps() {
+    while(!nodeCacheResps.empty() && nodeCacheResps.front().first <= curTick()) {
+        PacketPtr pkt = nodeCacheResps.front().second;
+        nodeCacheResps.pop_front();
+        handleResp(pkt);
+    }
+    if(!nodeCacheResps.empty() && !nodeCacheRespEvent.scheduled()) {
+        schedule(nodeCacheRespEvent, nodeCacheResps.front().first);
+    }
+}
+
+void
+NodeController::fillNodeCache(NodeID node_id, const Node& node,
+        bool prefetched, bool atomic) {
+    NodeCache<Node>::Entry victim;
+    if(nodeCache.insert(node_id, node, false, &victim, prefetched)) {
+        writeBackNode(victim.id, victim.value, atomic);
+    }
+}
+
+void
+NodeController::writeBackNode(NodeID node_id, const Node& node, bool atomic) {
+    ++ nodeCacheStats.writebacks;
+    PacketPtr pkt = packetPool.acquire(MemCmd::WriteReq, requestorId,
+            nodeId2Addr(node_id));
+    memcpy(pkt->getPtr<void>(), &node, sizeof(Node));
+    if(atomic) {
+        sendPacketToMem(pkt, true);
+        packetPool.release(pkt);
+    } else{
+        ++ writebacksInFlight;
+        pkt->pushSenderState(senderStatePool.acquire(nullptr, node_id));
+        sendPacketToMem(pkt, false);
+    }
+}
+
+// allocations and revocations walk the tree along next and prev
+void
+NodeController::prefetchNeighbours(NodeControllerCommandPtr cmd, const Node& node) {
+    if(!nodeCachePrefetch ||
+            (cmd->getType() != NodeControllerCommand::Type::REVOKE &&
+             cmd->getType() != NodeControllerCommand::Type::REVOKE_BATCH &&
+             cmd->getType() != NodeControllerCommand::Type::ALLOCATE)) {
+        return;
+    }
+    for(NodeID node_id : {(NodeID)node.next, (NodeID)node.prev}) {
+        if(node_id == NODE_ID_INVALID || node_id >= nodeCount ||
+                nodeCache.contains(node_id) ||
+                std::find(prefetchesInFlight.begin(), prefetchesInFlight.end(),
+                    node_id) != prefetchesInFlight.end()) {
+            continue;
+        }
+        ++ nodeCacheStats.prefetches;
+        prefetchesInFlight.push_back(node_id);
+        PacketPtr pkt = packetPool.acquire(MemCmd::ReadReq, requestorId,
+                nodeId2Addr(node_id));
+        pkt->pushSenderState(senderStatePool.acquire(nullptr, node_id));
+        sendPacketToMem(pkt, false);
+    }
+}
+
+void
+NodeController::flushNodeCache() {
+    bool atomic = !system->isTimingMode();
+    nodeCache.cleanAll([this, atomic](NodeID node_id, const Node& node) {
+        writeBackNode(node_id, node, atomic);
+    });
+}
+
+void
+NodeController::handleMemResp(PacketPtr pkt) {
+    if(!nodeCache.enabled()) {
+        handleResp(pkt);
+        return;
+    }
+
+    NodeSenderState* sender_state =
+        safe_cast<NodeSenderState*>(pkt->senderState);
+    NodeID node_id = sender_state->nodeId;
+    if(sender_state->cmd == nullptr) {
+        // write-back or prefetch
+        pkt->popSenderState();
+        senderStatePool.release(sender_state);
+        if(pkt->isRead()) {
+            prefetchesInFlight.erase(std::find(prefetchesInFlight.begin(),
+                        prefetchesInFlight.end(), node_id));
+            if(!nodeCache.contains(node_id)) {
+                fillNodeCache(node_id, pkt->getRaw<Node>(), true, false);
+            }
+        } else{
+            -- writebacksInFlight;
+        }
+        packetPool.release(pkt);
+        tryCompleteDrain();
+        return;
+    }
+
+    NodeCache<Node>::Entry* entry = nodeCache.lookup(node_id);
+    if(entry != nullptr) {
+        // filled by a prefetch or written while the load was in flight,
+        // the cached copy is at least as recent
+        memcpy(pkt->getPtr<void>(), &entry->value, sizeof(Node));
+    } else{
+        fillNodeCache(node_id, pkt->getRaw<Node>(), false, false);
+    }
+    prefetchNeighbours(sender_state->cmd, pkt->getRaw<Node>());
+    handleResp(pkt);
+}
+
 bool
 NodeControllerQuery::transit(NodeController& controller, PacketPtr current_pkt, PacketPtr pkt) {
+    if(controller.mustWaitForSweep(pkt->getRaw<Node>())) {
+        // the node might be invalidated by the sweep later on
+        controller.waitForSweep(this);
+        return false;
+    }
     current_pkt->makeResponse();
-    assert(current_pkt->getPtr<NodeControllerCommand>() != NULL);
-    current_pkt->deleteData();
-    current_pkt->setSize(sizeof(Node));
-    current_pkt->allocate(); // TODO: let the cpu allocate
     memcpy(current_pkt->getPtr<void>(), pkt->getPtr<void>(), sizeof(Node));
 
     return true;
@@ -194,16 +504,9 @@ NodeControllerAllocate::transit(NodeController& controller, PacketPtr current_pk
             
             return false;
         case NCAllocate_STORE:
-            if(fromFreeList) {
-                controller.free_head = nextFreeNodeId;
-            } else{
-                ++ controller.freeNodeInited;
-            }
+            controller.takeFreeNode(toAllocate, fromFreeList, nextFreeNodeId);
             current_pkt->makeResponse();
-            current_pkt->deleteData();
             // return a node ID
-            current_pkt->setSize(sizeof(NodeID));
-            current_pkt->allocate();
             *(current_pkt->getPtr<NodeID>()) = toAllocate;
             // TODO: consider returning status code
             return true;
@@ -215,20 +518,20 @@ NodeControllerAllocate::transit(NodeController& controller, PacketPtr current_pk
 
 Tick
 NodeControllerQuery::handleAtomic(NodeController& controller, PacketPtr pkt) {
-    pkt->deleteData();
-    pkt->setSize(sizeof(Node));
-    pkt->allocate();
     pkt->makeResponse();
-    controller.atomicLoadNode(this, nodeId, pkt->getPtr<Node>());
+    Tick latency = controller.atomicLoadNode(this, nodeId, pkt->getPtr<Node>());
     
-    return 0;
+    return latency;
 }
 
 
 Tick
 NodeControllerRevoke::handleAtomic(NodeController& controller, PacketPtr pkt) {
     Node node;
-    controller.atomicLoadNode(this, nodeId, &node);
+    Tick latency = 0;
+    lastLine = MaxAddr;
+    lineTouches = 0;
+    latency += controller.atomicLoadNode(this, nodeId, &node);
     rootDepth = node.depth;
     curNodeId = node.next;
     prevNodeId = node.prev;
@@ -236,35 +539,37 @@ NodeControllerRevoke::handleAtomic(NodeController& controller, PacketPtr pkt) {
     if(node.counter == 0) {
         controller.freeNode(node, nodeId);
     }
-    controller.atomicStoreNode(this, nodeId, &node);
+    latency += controller.atomicStoreNode(this, nodeId, &node);
+    walkLength = 1;
     while(curNodeId != NODE_ID_INVALID) {
-        controller.atomicLoadNode(this, curNodeId, &node);
+        latency += controller.atomicLoadNode(this, curNodeId, &node);
         if(node.depth > rootDepth) {
             node.state = 0;
+            ++ walkLength;
             NodeID next = node.next;
             if(node.counter == 0){
                 controller.freeNode(node, curNodeId);
             }
-            controller.atomicStoreNode(this, curNodeId, &node);
+            latency += controller.atomicStoreNode(this, curNodeId, &node);
             curNodeId = next;
         } else{
             node.prev = prevNodeId; 
-            controller.atomicStoreNode(this, curNodeId, &node);
+            latency += controller.atomicStoreNode(this, curNodeId, &node);
             break;
         }
     }
     if(prevNodeId == NODE_ID_INVALID) {
         controller.tree_root = curNodeId;
     } else {
-        controller.atomicLoadNode(this, prevNodeId, &node);
+        latency += controller.atomicLoadNode(this, prevNodeId, &node);
         node.next = curNodeId;
-        controller.atomicStoreNode(this, prevNodeId, &node);
+        latency += controller.atomicStoreNode(this, prevNodeId, &node);
     }
 
-    pkt->deleteData();
+    controller.recordRevokeWalk(walkLength, lineTouches);
     pkt->makeResponse();
 
-    return 0;
+    return latency;
 }
 
 
@@ -273,51 +578,45 @@ NodeControllerRcUpdate::handleAtomic(NodeController& controller, PacketPtr pkt)
     panic_if(delta == 0, "node controller does not allow rc updating with delta = 0 (atomic)");
 
     Node node;
-    controller.atomicLoadNode(this, nodeId, &node);
+    Tick latency = 0;
+    latency += controller.atomicLoadNode(this, nodeId, &node);
     DPRINTF(CapstoneNodeOpsAtomic, "rc update %llu %d %d %d\n", nodeId, node.counter, delta, node.state);
     node.counter += delta;
     if(node.counter == 0 && node.state == 0) { // now I can free this node
         controller.freeNode(node, nodeId);
     }
-    controller.atomicStoreNode(this, nodeId, &node);
+    latency += controller.atomicStoreNode(this, nodeId, &node);
     
-    pkt->deleteData();
     pkt->makeResponse();
 
-    return 0;
+    return latency;
 }
 
 Tick
 NodeControllerAllocate::handleAtomic(NodeController& controller, PacketPtr pkt) {
     Node node;
+    Tick latency = 0;
 
-    if(controller.free_head == NODE_ID_INVALID) {
-        panic_if(controller.freeNodeInited >= CAPSTONE_NODE_N, "no free node remaining (atomic).");
-        toAllocate = (NodeID)controller.freeNodeInited;
-        fromFreeList = false;
-    } else{
-        toAllocate = controller.free_head;
-        fromFreeList = true;
-    }
+    controller.pickFreeNode(parentId, &toAllocate, &fromFreeList);
 
     if(parentId == NODE_ID_INVALID) {
         nextNodeId = controller.tree_root;
         parentDepth = 0;
     } else{
-        controller.atomicLoadNode(this, parentId, &node);
+        latency += controller.atomicLoadNode(this, parentId, &node);
         nextNodeId = node.next;
         parentDepth = node.depth;
         node.next = toAllocate;
-        controller.atomicStoreNode(this, parentId, &node);
+        latency += controller.atomicStoreNode(this, parentId, &node);
     }
 
     if(nextNodeId != NODE_ID_INVALID) {
-        controller.atomicLoadNode(this, nextNodeId, &node);
+        latency += controller.atomicLoadNode(this, nextNodeId, &node);
         node.prev = toAllocate;
-        controller.atomicStoreNode(this, nextNodeId, &node);
+        latency += controller.atomicStoreNode(this, nextNodeId, &node);
     }
 
-    controller.atomicLoadNode(this, toAllocate, &node);
+    latency += controller.atomicLoadNode(this, toAllocate, &node);
     nextFreeNodeId = node.next;
     node.prev = parentId;
     node.next = nextNodeId;
@@ -327,21 +626,14 @@ NodeControllerAllocate::handleAtomic(NodeController& controller, PacketPtr pkt)
     if(parentId == NODE_ID_INVALID) {
         controller.tree_root = toAllocate;
     }
-    controller.atomicStoreNode(this, toAllocate, &node);
+    latency += controller.atomicStoreNode(this, toAllocate, &node);
     
-    if(fromFreeList) {
-        controller.free_head = nextFreeNodeId;
-    } else{
-        ++ controller.freeNodeInited;
-    }
+    controller.takeFreeNode(toAllocate, fromFreeList, nextFreeNodeId);
 
     pkt->makeResponse();
-    pkt->deleteData();
-    pkt->setSize(sizeof(NodeID));
-    pkt->allocate();
     *(pkt->getPtr<NodeID>()) = toAllocate;
 
-    return 0;
+    return latency;
 }
 
 bool
@@ -360,6 +652,7 @@ NodeControllerRevoke::transit(NodeController& controller, PacketPtr current_pkt,
                 controller.freeNode(node, nodeId);
             }
             controller.sendStore(this, nodeId, node);
+            walkLength = 1;
 
             state = NCRevoke_STORE;
 
@@ -369,6 +662,7 @@ NodeControllerRevoke::transit(NodeController& controller, PacketPtr current_pkt,
             if(node.depth > rootDepth) {
                 // still in the subtree
                 node.state = 0;
+                ++ walkLength;
                 old_node_id = curNodeId;
                 curNodeId = node.next;
                 if(node.counter == 0){
@@ -390,11 +684,9 @@ NodeControllerRevoke::transit(NodeController& controller, PacketPtr current_pkt,
         case NCRevoke_STORE_RIGHT:
             if(prevNodeId == NODE_ID_INVALID) {
                 controller.tree_root = curNodeId;
-                current_pkt->makeResponse();
-                current_pkt->deleteData();
-                return true;
+                return finish(controller, current_pkt);
             }
-            controller.sendLoad(this, prevNodeId);
+            controller.sweepLoad(this, prevNodeId);
             state = NCRevoke_LOAD_LEFT;
             return false;
         case NCRevoke_LOAD_LEFT:
@@ -404,23 +696,28 @@ NodeControllerRevoke::transit(NodeController& controller, PacketPtr current_pkt,
             state = NCRevoke_STORE_LEFT;
             return false;
         case NCRevoke_STORE_LEFT:
-            current_pkt->makeResponse();
-            current_pkt->deleteData();
-            return true;
+            return finish(controller, current_pkt);
         case NCRevoke_STORE:
             if(curNodeId == NODE_ID_INVALID) {
                 if(prevNodeId == NODE_ID_INVALID) {
                     // the tree is empty
                     controller.tree_root = NODE_ID_INVALID;
-                    current_pkt->makeResponse();
-                    current_pkt->deleteData();
-                    return true;
+                    return finish(controller, current_pkt);
                 }
+            }
+            if(controller.asyncRevoke && !background) {
+                // the root is invalid now, so the capabilities it covers
+                // can no longer be used, respond and sweep the rest
+                background = true;
+                current_pkt->makeResponse();
+                controller.startSweep(this, rootDepth);
+            }
+            if(curNodeId == NODE_ID_INVALID) {
                 // need to change prev->next
-                controller.sendLoad(this, prevNodeId);
+                controller.sweepLoad(this, prevNodeId);
                 state = NCRevoke_LOAD_LEFT;
             } else{
-                controller.sendLoad(this, curNodeId);
+                controller.sweepLoad(this, curNodeId);
                 state = NCRevoke_LOAD;
             }
             return false;
@@ -429,6 +726,171 @@ NodeControllerRevoke::transit(NodeController& controller, PacketPtr current_pkt,
     }
 }
 
+bool
+NodeControllerRevoke::finish(NodeController& controller, PacketPtr current_pkt) {
+    controller.recordRevokeWalk(walkLength, lineTouches);
+    if(!background) {
+        current_pkt->makeResponse();
+    }
+    return true;
+}
+
+NodeControllerRevokeBatch::NodeControllerRevokeBatch(
+        std::vector<NodeID> node_ids) : roots(std::move(node_ids)) {
+    std::sort(roots.begin(), roots.end());
+    roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+}
+
+NodeID
+NodeControllerRevokeBatch::invalidate(NodeController& controller,
+        NodeID node_id, Node& node) {
+    NodeID next = node.next;
+    node.state = 0;
+    ++ walkLength;
+    if(node.counter == 0) {
+        controller.freeNode(node, node_id);
+    }
+    return next;
+}
+
+Tick
+NodeControllerRevokeBatch::handleAtomic(NodeController& controller, PacketPtr pkt) {
+    Node node;
+    Tick latency = 0;
+    runs = 0;
+    walkLength = 0;
+    for(NodeID root : roots) {
+        latency += controller.atomicLoadNode(this, root, &node);
+        if(node.state == 0) {
+            // in the subtree of an earlier root
+            continue;
+        }
+        ++ runs;
+        rootDepth = node.depth;
+        prevNodeId = node.prev;
+        curNodeId = invalidate(controller, root, node);
+        latency += controller.atomicStoreNode(this, root, &node);
+        while(curNodeId != NODE_ID_INVALID) {
+            latency += controller.atomicLoadNode(this, curNodeId, &node);
+            if(node.depth <= rootDepth && !isRoot(curNodeId)) {
+                node.prev = prevNodeId;
+                latency += controller.atomicStoreNode(this, curNodeId, &node);
+                break;
+            }
+            // a descendant, or the next root right after the subtree
+            rootDepth = std::min(rootDepth, (unsigned int)node.depth);
+            NodeID node_id = curNodeId;
+            curNodeId = invalidate(controller, node_id, node);
+            latency += controller.atomicStoreNode(this, node_id, &node);
+        }
+        if(prevNodeId == NODE_ID_INVALID) {
+            controller.tree_root = curNodeId;
+        } else{
+            latency += controller.atomicLoadNode(this, prevNodeId, &node);
+            node.next = curNodeId;
+            latency += controller.atomicStoreNode(this, prevNodeId, &node);
+        }
+    }
+
+    controller.recordRevokeBatch(roots.size(), runs, walkLength);
+    pkt->makeResponse();
+
+    return latency;
+}
+
+void
+NodeControllerRevokeBatch::setup(NodeController& controller, PacketPtr pkt) {
+    assert(!roots.empty());
+    runs = 0;
+    walkLength = 0;
+    nextRoot = 0;
+    nextRun(controller, pkt);
+}
+
+// starts the walk from the next root, or finishes the batch
+bool
+NodeControllerRevokeBatch::nextRun(NodeController& controller, PacketPtr current_pkt) {
+    if(nextRoot == roots.size()) {
+        controller.recordRevokeBatch(roots.size(), runs, walkLength);
+        current_pkt->makeResponse();
+        return true;
+    }
+    curNodeId = roots[nextRoot ++];
+    controller.sendLoad(this, curNodeId);
+    state = NCRevokeBatch_LOAD_ROOT;
+    return false;
+}
+
+// links the nodes before and after the run
+bool
+NodeControllerRevokeBatch::relink(NodeController& controller, PacketPtr current_pkt) {
+    if(prevNodeId == NODE_ID_INVALID) {
+        controller.tree_root = curNodeId;
+        return nextRun(controller, current_pkt);
+    }
+    controller.sendLoad(this, prevNodeId);
+    state = NCRevokeBatch_LOAD_LEFT;
+    return false;
+}
+
+bool
+NodeControllerRevokeBatch::transit(NodeController& controller, PacketPtr current_pkt, PacketPtr pkt) {
+    Node node;
+    NodeID old_node_id;
+    switch(state) {
+        case NCRevokeBatch_LOAD_ROOT:
+            node = pkt->getRaw<Node>();
+            if(node.state == 0) {
+                // in the subtree of an earlier root
+                return nextRun(controller, current_pkt);
+            }
+            ++ runs;
+            rootDepth = node.depth;
+            prevNodeId = node.prev;
+            old_node_id = curNodeId;
+            curNodeId = invalidate(controller, old_node_id, node);
+            controller.sendStore(this, old_node_id, node);
+            state = NCRevokeBatch_STORE;
+            return false;
+        case NCRevokeBatch_STORE:
+            if(curNodeId == NODE_ID_INVALID) {
+                // reached the end of the list
+                return relink(controller, current_pkt);
+            }
+            controller.sendLoad(this, curNodeId);
+            state = NCRevokeBatch_LOAD;
+            return false;
+        case NCRevokeBatch_LOAD:
+            node = pkt->getRaw<Node>();
+            if(node.depth > rootDepth || isRoot(curNodeId)) {
+                // a descendant, or the next root right after the subtree
+                rootDepth = std::min(rootDepth, (unsigned int)node.depth);
+                old_node_id = curNodeId;
+                curNodeId = invalidate(controller, old_node_id, node);
+                controller.sendStore(this, old_node_id, node);
+                state = NCRevokeBatch_STORE;
+            } else{
+                // the first node after the run
+                node.prev = prevNodeId;
+                controller.sendStore(this, curNodeId, node);
+                state = NCRevokeBatch_STORE_RIGHT;
+            }
+            return false;
+        case NCRevokeBatch_STORE_RIGHT:
+            return relink(controller, current_pkt);
+        case NCRevokeBatch_LOAD_LEFT:
+            node = pkt->getRaw<Node>();
+            node.next = curNodeId;
+            controller.sendStore(this, prevNodeId, node);
+            state = NCRevokeBatch_STORE_LEFT;
+            return false;
+        case NCRevokeBatch_STORE_LEFT:
+            return nextRun(controller, current_pkt);
+        default:
+            panic("incorrect state for batched node revocation operation!");
+    }
+}
+
 // when rc reaches 0
 // if the node if invalid: add the node to the free list
 // if the node is valid: no need to do anything
@@ -457,7 +919,6 @@ NodeControllerRcUpdate::transit(NodeController& controller, PacketPtr current_pk
             return false;
         case NCRcUpdate_STORE:
             current_pkt->makeResponse();
-            current_pkt->deleteData();
             // TODO: consider returning status code
             return true;
         default:
@@ -467,28 +928,200 @@ NodeControllerRcUpdate::transit(NodeController& controller, PacketPtr current_pk
 
 void
 NodeController::handleResp(PacketPtr pkt) {
-    assert(currentPkt != NULL);
-
-    NodeControllerCommand* cmd = currentPkt->getPtr<NodeControllerCommand>();
-    assert(cmd != NULL);
+    NodeSenderState* sender_state =
+        safe_cast<NodeSenderState*>(pkt->popSenderState());
+    NodeControllerCommand* cmd = sender_state->cmd;
+    senderStatePool.release(sender_state);
+
+    auto it = cmdQueue.begin();
+    while(it != cmdQueue.end() && it->cmd != cmd) {
+        ++ it;
+    }
+    panic_if(it == cmdQueue.end() || !it->active,
+            "node controller received response for unknown command");
 
-    bool finish = cmd->transit(*this, currentPkt, pkt);
+    bool finish = cmd->transit(*this, it->pkt, pkt);
 
-    delete pkt;
+    packetPool.release(pkt);
 
     if(finish) {
-        pkt = currentPkt;
-        currentPkt = NULL;
+        if(cmd == sweep) {
+            endSweep();
+        }
+        pkt = it->pkt;
+        if(pkt != nullptr) {
+            traceCommand(cmd, it->arrival, it->port, pkt);
+        }
+        freeCommand(cmd);
+
+        if(pkt != nullptr) { // the background sweep has responded already
+            cpuSidePorts[it->port]->trySendResp(pkt);
+        }
+        cmdQueue.erase(it);
+        stats.cmdQueueOccupancy = cmdQueue.size();
+
+        // the sweep might be waiting for this command
+        if(sweepBlockedOn != NODE_ID_INVALID &&
+                !rcUpdateActiveOn(sweepBlockedOn)) {
+            NodeID node_id = sweepBlockedOn;
+            sweepBlockedOn = NODE_ID_INVALID;
+            sweepLoad(sweep, node_id);
+        }
 
-        delete cmd;
+        // younger commands blocked by this one might be able to start now
+        startCommands();
+        // and there is room for a waiting request
+        scheduleArbitration();
 
-        cpu_side.trySendResp(pkt);
+        tryCompleteDrain();
+    } else if(sweep != nullptr) {
+        // the sweep moved on, rc updates to its previous node can start
+        startCommands();
+    }
+}
+
+bool
+NodeController::hasHazard(CommandQueue::iterator it) {
+    NodeID node_id = it->cmd->getNodeId();
+    for(auto older = cmdQueue.begin(); older != it; ++ older) {
+        if(older->cmd == sweep) {
+            // queries check the nodes they load against the sweep instead
+            if(node_id == NODE_ID_INVALID ||
+                    (it->cmd->getType() == NodeControllerCommand::Type::RC_UPDATE &&
+                     (node_id == sweepNode || node_id == sweepBlockedOn))) {
+                return true;
+            }
+            continue;
+        }
+        NodeID older_node_id = older->cmd->getNodeId();
+        if(node_id == NODE_ID_INVALID || older_node_id == NODE_ID_INVALID ||
+                node_id == older_node_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+NodeController::rcUpdateActiveOn(NodeID node_id) const {
+    for(const PendingCommand& entry : cmdQueue) {
+        if(entry.active &&
+                entry.cmd->getType() == NodeControllerCommand::Type::RC_UPDATE &&
+                entry.cmd->getNodeId() == node_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Responds to the revocation and lets the younger commands run alongside
+ * the rest of its walk. The revocation stays in the command queue until
+ * the walk is done, so that allocations, revocations and draining still
+ * wait for it.
+ * */
+void
+NodeController::startSweep(NodeControllerRevoke* cmd, unsigned int root_depth) {
+    auto it = cmdQueue.begin();
+    while(it != cmdQueue.end() && it->cmd != cmd) {
+        ++ it;
+    }
+    assert(it != cmdQueue.end() && sweep == nullptr);
+
+    DPRINTF(CapstoneNodeOps, "revoke %u continues in the background\n",
+            cmd->nodeId);
+    sweep = cmd;
+    sweepRootDepth = root_depth;
+    sweepStart = curTick();
+    sweepNode = NODE_ID_INVALID;
+
+    PacketPtr pkt = it->pkt;
+    it->pkt = nullptr;
+    traceCommand(cmd, it->arrival, it->port, pkt);
+    cpuSidePorts[it->port]->trySendResp(pkt);
+
+    startCommands();
+}
+
+// loads a node for a revocation, waiting for the rc updates in flight on
+// the node if the revocation runs in the background
+void
+NodeController::sweepLoad(NodeControllerRevoke* cmd, NodeID node_id) {
+    if(cmd != sweep) {
+        sendLoad(cmd, node_id);
+        return;
+    }
+    if(rcUpdateActiveOn(node_id)) {
+        ++ stats.sweepStalls;
+        sweepBlockedOn = node_id;
+        return;
+    }
+    sweepNode = node_id;
+    sendLoad(cmd, node_id);
+}
+
+// a valid node deeper than the revoked root might be in its subtree
+bool
+NodeController::mustWaitForSweep(const Node& node) const {
+    return sweep != nullptr && node.state != 0 &&
+        node.depth > sweepRootDepth;
+}
+
+void
+NodeController::waitForSweep(NodeControllerQuery* cmd) {
+    ++ stats.sweepQueryWaits;
+    sweepWaiters.push_back(cmd);
+}
+
+void
+NodeController::endSweep() {
+    stats.sweepLatency.sample(curTick() - sweepStart);
+    sweep = nullptr;
+    sweepNode = NODE_ID_INVALID;
+    sweepBlockedOn = NODE_ID_INVALID;
+
+    // reload the nodes of the queries that waited
+    std::vector<NodeControllerQuery*> waiters;
+    waiters.swap(sweepWaiters);
+    for(NodeControllerQuery* cmd : waiters) {
+        cmd->setup(*this, nullptr);
+    }
+}
+
+void
+NodeController::recordRevokeWalk(unsigned int length, unsigned int lines) {
+    stats.revokeWalkLength.sample(length);
+    stats.revokeWalkLines.sample(lines);
+}
+
+void
+NodeController::recordRevokeBatch(unsigned int roots, unsigned int runs,
+        unsigned int length) {
+    stats.revokeBatchRoots += roots;
+    stats.revokeBatchRuns += runs;
+    stats.revokeBatchWalkLength.sample(length);
+}
+
+void
+NodeController::touchRevokeLine(NodeControllerCommandPtr cmd, NodeID node_id) {
+    static_cast<NodeControllerRevoke*>(cmd)->touchLine(
+            nodeId2Addr(node_id) / system->cacheLineSize());
+}
+
+void
+NodeController::startCommands() {
+    for(auto it = cmdQueue.begin(); it != cmdQueue.end(); ++ it) {
+        if(it->active || hasHazard(it)) {
+            continue;
+        }
+        it->active = true;
+        it->cmd->setup(*this, it->pkt);
     }
 }
 
 Port& NodeController::getPort(const std::string& name, PortID idx) {
-    if(name == "cpu_side")
-        return cpu_side;
+    if(name == "cpu_side" && idx >= 0 && idx < (PortID)cpuSidePorts.size())
+        return *cpuSidePorts[idx];
     if(name == "mem_side")
         return mem_side;
     return ClockedObject::getPort(name, idx);
@@ -496,8 +1129,7 @@ Port& NodeController::getPort(const std::string& name, PortID idx) {
 
 NodeController::MemSidePort::MemSidePort(NodeController* owner) :
     RequestPort(owner->name() + ".mem_side", owner),
-    owner(owner),
-    retryPkt(NULL)
+    owner(owner)
 {
 
 }
@@ -509,10 +1141,10 @@ NodeController::nodeId2Addr(NodeID node_id) {
 
 void
 NodeController::MemSidePort::trySendReq(PacketPtr pkt) {
-    assert(retryPkt == NULL);
     assert(pkt->isRead() || pkt->isWrite());
-    if(!sendTimingReq(pkt)) {
-        retryPkt = pkt;
+    // keep the order of requests if some are already waiting for retry
+    if(!retryPkts.empty() || !sendTimingReq(pkt)) {
+        retryPkts.push_back(pkt);
     }
 }
 
@@ -523,6 +1155,307 @@ NodeController::init() {
     requestorId = system->getRequestorId(this);
 }
 
+bool
+NodeController::isDrained() const {
+    if(!cmdQueue.empty() || nodeCache.dirtyCount() != 0 ||
+            writebacksInFlight != 0 || !prefetchesInFlight.empty()) {
+        return false;
+    }
+    for(const CPUSidePort* port : cpuSidePorts) {
+        if(port->hasPendingReqs() || port->hasPendingResps()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+NodeController::tryCompleteDrain() {
+    if(drainState() != DrainState::Draining) {
+        return;
+    }
+    if(cmdQueue.empty()) {
+        // nodes stored by the last commands
+        flushNodeCache();
+    }
+    if(isDrained()) {
+        DPRINTF(Drain, "node controller done draining\n");
+        signalDrainDone();
+    }
+}
+
+NodeController::HostNode&
+NodeController::hostNode(NodeID node_id) {
+    assert(node_id < nodeCount);
+    ++ stats.hostNodeAccesses;
+    HostNode& host_node = hostNodes.getMutable(node_id);
+    if(!host_node.valid) {
+        ++ stats.hostNodeFills;
+        PacketPtr pkt = packetPool.acquire(MemCmd::ReadReq, requestorId,
+                nodeId2Addr(node_id));
+        mem_side.sendFunctional(pkt);
+        host_node.node = pkt->getRaw<Node>();
+        host_node.valid = true;
+        host_node.dirty = false;
+        packetPool.release(pkt);
+    }
+    return host_node;
+}
+
+// the next phase might run in timing mode, so memory has to be up to date
+void
+NodeController::writeBackHostNodes() {
+    if(hostNodes.allocatedChunkCount() == 0) {
+        return;
+    }
+    DPRINTF(Drain, "writing back %u nodes from the host-side node array\n",
+            hostNodesDirty.size());
+    for(NodeID node_id : hostNodesDirty) {
+        ++ stats.hostNodeWritebacks;
+        PacketPtr pkt = packetPool.acquire(MemCmd::WriteReq, requestorId,
+                nodeId2Addr(node_id));
+        memcpy(pkt->getPtr<void>(), &hostNodes.get(node_id).node, sizeof(Node));
+        mem_side.sendFunctional(pkt);
+        packetPool.release(pkt);
+    }
+    hostNodesDirty.clear();
+    hostNodes.clear();
+    // the node cache was bypassed and might hold stale nodes
+    nodeCache.clear();
+}
+
+DrainState
+NodeController::drain() {
+    writeBackHostNodes();
+    if(cmdQueue.empty()) {
+        // the checkpointed memory has to hold the latest nodes
+        flushNodeCache();
+    }
+    if(isDrained()) {
+        return DrainState::Drained;
+    }
+    DPRINTF(Drain, "node controller draining, %u commands in flight\n",
+            cmdQueue.size());
+    return DrainState::Draining;
+}
+
+/**
+ * The revocation tree itself lives in simulated memory and is checkpointed
+ * with it. The controller only keeps the free list and tree heads in the
+ * checkpoint file; the object ranges and the capability tracking table
+ * (which covers the register and memory locations of all CPUs) go into a
+ * separate compressed binary file, like the physical memory stores.
+ *
+ * Layout of the binary file (all fields are host-endian uint64_t):
+ *   magic, version
+ *   object range count, then (node id, start, end) for each range
+ *   tracked location count, then (type, node id, position) for each
+ *   location, where position is the address for memory locations and
+ *   (thread id << 32 | register index) for registers
+ *   (since version 2) root slab of the slab allocator, slab count, then
+ *   (free head, used, overflow, listed) for each slab, partial slab
+ *   count, then the index of each partial slab; no slabs under the lifo
+ *   allocation policy
+ * */
+static const uint64_t CAPSTONE_CPT_MAGIC = 0x4b52545043504143ULL; // "CAPCPTRK"
+static const uint64_t CAPSTONE_CPT_VERSION = 2;
+
+void
+NodeController::serializeState(const std::string& filepath) const {
+    gzFile f = gzopen(filepath.c_str(), "wb");
+    fatal_if(f == NULL, "Can't open node controller checkpoint file '%s'\n",
+            filepath);
+
+    auto write = [&](uint64_t val) {
+        fatal_if(gzwrite(f, &val, sizeof(val)) != (int)sizeof(val),
+                "Write failed on node controller checkpoint file '%s'\n",
+                filepath);
+    };
+
+    write(CAPSTONE_CPT_MAGIC);
+    write(CAPSTONE_CPT_VERSION);
+
+    // only populated chunks are visited
+    const SimpleAddrRange empty_range;
+    uint64_t obj_count = 0;
+    for(size_t c = 0; c < node2Obj.chunkCount(); ++ c) {
+        const SimpleAddrRange* chunk = node2Obj.chunk(c);
+        for(size_t i = 0; chunk != nullptr && i < node2Obj.CHUNK_SIZE; ++ i) {
+            if(!(chunk[i] == empty_range)) {
+                ++ obj_count;
+            }
+        }
+    }
+    write(obj_count);
+    for(size_t c = 0; c < node2Obj.chunkCount(); ++ c) {
+        const SimpleAddrRange* chunk = node2Obj.chunk(c);
+        for(size_t i = 0; chunk != nullptr && i < node2Obj.CHUNK_SIZE; ++ i) {
+            if(!(chunk[i] == empty_range)) {
+                write(c * node2Obj.CHUNK_SIZE + i);
+                write(chunk[i].start);
+                write(chunk[i].end);
+            }
+        }
+    }
+
+    uint64_t track_count = 0;
+    capTrackTable.forEach([&](const CapLoc& loc, NodeID node_id) {
+        ++ track_count;
+    });
+    write(track_count);
+    capTrackTable.forEach([&](const CapLoc& loc, NodeID node_id) {
+        write(loc.type);
+        write(node_id);
+        if(loc.type == CapLoc::CAP_TRACK_MEM) {
+            write(loc.pos.mem.addr);
+        } else{
+            write(((uint64_t)loc.pos.reg.threadId << 32) | loc.pos.reg.regId);
+        }
+    });
+
+    write(slabAllocator.rootSlabIndex());
+    write(slabAllocator.reservedSlabs());
+    slabAllocator.forEachSlab([&](NodeID slab, const SlabNodeAllocator::Slab& s) {
+        write(s.freeHead);
+        write(s.used);
+        write(s.overflow);
+        write(s.listed);
+    });
+    write(slabAllocator.partialSlabList().size());
+    for(NodeID slab : slabAllocator.partialSlabList()) {
+        write(slab);
+    }
+
+    fatal_if(gzclose(f), "Close failed on node controller checkpoint file '%s'\n",
+            filepath);
+
+    DPRINTF(Checkpoint, "Serialized %llu object ranges and %llu tracked "
+            "locations to %s\n", obj_count, track_count, filepath);
+}
+
+void
+NodeController::unserializeState(const std::string& filepath) {
+    gzFile f = gzopen(filepath.c_str(), "rb");
+    fatal_if(f == NULL, "Can't open node controller checkpoint file '%s'\n",
+            filepath);
+
+    auto read = [&]() {
+        uint64_t val;
+        fatal_if(gzread(f, &val, sizeof(val)) != (int)sizeof(val),
+                "Node controller checkpoint file '%s' is truncated\n",
+                filepath);
+        return val;
+    };
+
+    fatal_if(read() != CAPSTONE_CPT_MAGIC,
+            "'%s' is not a node controller checkpoint file\n", filepath);
+    uint64_t version = read();
+    fatal_if(version == 0 || version > CAPSTONE_CPT_VERSION,
+            "Unsupported node controller checkpoint version %llu\n", version);
+
+    node2Obj.clear();
+    uint64_t obj_count = read();
+    for(uint64_t i = 0; i < obj_count; ++ i) {
+        NodeID node_id = read();
+        Addr start = read();
+        Addr end = read();
+        fatal_if(node_id >= nodeCount,
+                "Checkpointed node %llu is beyond node_count\n", node_id);
+        node2Obj.set(node_id, SimpleAddrRange(start, end));
+    }
+
+    capTrackTable.clear();
+    uint64_t track_count = read();
+    for(uint64_t i = 0; i < track_count; ++ i) {
+        uint64_t type = read();
+        NodeID node_id = read();
+        uint64_t pos = read();
+        if(type == CapLoc::CAP_TRACK_MEM) {
+            capTrackTable.add(CapLoc::makeMem(pos), node_id);
+        } else{
+            capTrackTable.add(CapLoc::makeReg((int)(pos >> 32),
+                        (RegIndex)(pos & 0xffffffffULL)), node_id);
+        }
+    }
+
+    slabAllocator.clear();
+    if(version >= 2) {
+        NodeID root_slab = read();
+        uint64_t slab_count = read();
+        std::vector<SlabNodeAllocator::Slab> slabs(slab_count);
+        for(SlabNodeAllocator::Slab& s : slabs) {
+            s.freeHead = read();
+            s.used = read();
+            s.overflow = read();
+            s.listed = read();
+        }
+        std::vector<NodeID> partial_slabs(read());
+        for(NodeID& slab : partial_slabs) {
+            slab = read();
+        }
+        slabAllocator.restore(root_slab, slabs, partial_slabs);
+    }
+
+    gzclose(f);
+
+    DPRINTF(Checkpoint, "Unserialized %llu object ranges and %llu tracked "
+            "locations from %s\n", obj_count, track_count, filepath);
+}
+
+void
+NodeController::serialize(CheckpointOut& cp) const {
+    // commands in flight are not checkpointed, drain() waits for them
+    assert(isDrained());
+
+    uint64_t node_count = nodeCount;
+    SERIALIZE_SCALAR(node_count);
+    SERIALIZE_SCALAR(free_head);
+    SERIALIZE_SCALAR(tree_root);
+    SERIALIZE_SCALAR(freeNodeInited);
+    int alloc_policy = allocPolicy;
+    SERIALIZE_SCALAR(alloc_policy);
+    uint64_t alloc_slab_size = slabAllocator.slabNodes();
+    SERIALIZE_SCALAR(alloc_slab_size);
+
+    std::string filename = name() + ".captrack.gz";
+    SERIALIZE_SCALAR(filename);
+    serializeState(CheckpointIn::dir() + "/" + filename);
+}
+
+void
+NodeController::unserialize(CheckpointIn& cp) {
+    uint64_t node_count;
+    UNSERIALIZE_SCALAR(node_count);
+    fatal_if(node_count != nodeCount,
+            "Node count has changed! Saw %llu, expected %llu\n",
+            node_count, nodeCount);
+    UNSERIALIZE_SCALAR(free_head);
+    UNSERIALIZE_SCALAR(tree_root);
+    UNSERIALIZE_SCALAR(freeNodeInited);
+    // the free lists of one policy are meaningless to the other
+    int alloc_policy = enums::lifo;
+    UNSERIALIZE_OPT_SCALAR(alloc_policy);
+    fatal_if(alloc_policy != allocPolicy,
+            "Node allocation policy has changed! Saw %s, expected %s\n",
+            enums::NodeAllocPolicyStrings[alloc_policy],
+            enums::NodeAllocPolicyStrings[allocPolicy]);
+    if(allocPolicy == enums::slab) {
+        uint64_t alloc_slab_size;
+        UNSERIALIZE_SCALAR(alloc_slab_size);
+        fatal_if(alloc_slab_size != slabAllocator.slabNodes(),
+                "Slab size has changed! Saw %llu, expected %llu\n",
+                alloc_slab_size, slabAllocator.slabNodes());
+    }
+
+    std::string filename;
+    UNSERIALIZE_SCALAR(filename);
+    unserializeState(cp.getCptDir() + "/" + filename);
+
+    nodeCache.clear();
+    hostNodesDirty.clear();
+    hostNodes.clear();
+}
+
 void
 NodeControllerQuery::setup(NodeController& controller, PacketPtr pkt) {
     DPRINTF(CapstoneNCache, "Read from node cache\n");
@@ -533,15 +1466,7 @@ NodeControllerQuery::setup(NodeController& controller, PacketPtr pkt) {
 
 void
 NodeControllerAllocate::setup(NodeController& controller, PacketPtr pkt) {
-    if(controller.free_head == NODE_ID_INVALID) {
-        panic_if(controller.freeNodeInited >= CAPSTONE_NODE_N, "no free node remaining.");
-        toAllocate = (NodeID)controller.freeNodeInited;
-        fromFreeList = false;
-    } else{
-        toAllocate = controller.free_head;
-        fromFreeList = true;
-    }
-    // TODO: need to handle the case when there are no free nodes
+    controller.pickFreeNode(parentId, &toAllocate, &fromFreeList);
     if(parentId == NODE_ID_INVALID) {
         // skip setting parent
         // same as in NCAllocate_STORE_PARENT
@@ -574,37 +1499,86 @@ void
 NodeControllerRevoke::setup(NodeController& controller, PacketPtr pkt) {
     assert(nodeId != NODE_ID_INVALID);
     state = NCRevoke_LOAD_ROOT;
+    lastLine = MaxAddr;
+    lineTouches = 0;
     controller.sendLoad(this, nodeId);
 }
 
 
-bool
-NodeController::handleTimingReq(PacketPtr pkt) {
-    if(currentPkt != NULL) {
-        return false;
+void
+NodeController::scheduleArbitration() {
+    if(!arbitrateEvent.scheduled()) {
+        schedule(arbitrateEvent, clockEdge());
+    }
+}
+
+void
+NodeController::arbitrate() {
+    PortID n = cpuSidePorts.size();
+    PortID port = -1;
+    for(PortID i = 1; i <= n; ++ i) {
+        PortID candidate = (lastArbitratedPort + i) % n;
+        if(cpuSidePorts[candidate]->hasPendingReqs()) {
+            port = candidate;
+            break;
+        }
+    }
+    if(port < 0) {
+        return;
+    }
+
+    if(cmdQueue.size() >= cmdQueueDepth) {
+        // a finishing command triggers the arbitration again
+        ++ stats.arbitrationStalls;
+        return;
+    }
+
+    lastArbitratedPort = port;
+    acceptTimingReq(cpuSidePorts[port]->popReq(), port);
+    cpuSidePorts[port]->trySendRetryReq();
+
+    for(CPUSidePort* p : cpuSidePorts) {
+        if(p->hasPendingReqs()) {
+            schedule(arbitrateEvent, clockEdge(Cycles(1)));
+            break;
+        }
     }
+}
+
+void
+NodeController::acceptTimingReq(PacketPtr pkt, PortID port) {
     ++ stats.timingReqCount;
     
-    NodeControllerCommand* cmd = pkt->getPtr<NodeControllerCommand>();
+    NodeControllerCommand* cmd = pkt->getRaw<NodeControllerCommandPtr>();
     panic_if(cmd == NULL, "node controller received invalid command");
 
     handleCommon(cmd);
 
-    cmd->setup(*this, pkt);
-
-    currentPkt = pkt;
+    cmdQueue.emplace_back(pkt, cmd, port);
+    stats.cmdQueueOccupancy = cmdQueue.size();
 
-    return true;
+    auto it = std::prev(cmdQueue.end());
+    if(hasHazard(it)) {
+        DPRINTF(CapstoneNCache, "command delayed by hazard on node %u\n",
+                cmd->getNodeId());
+        ++ stats.hazardStalls;
+    } else {
+        it->active = true;
+        cmd->setup(*this, pkt);
+    }
 }
 
 
 bool NodeController::CPUSidePort::recvTimingReq(PacketPtr pkt) {
-    DPRINTF(CapstoneNCache, "NCache packet received\n");
-    // no latency
-    if(!owner->handleTimingReq(pkt)) {
+    DPRINTF(CapstoneNCache, "NCache packet received on port %d\n", id);
+    if(reqQueue.size() >= owner->portQueueDepth) {
+        ++ owner->stats.queueFullStalls;
         toRetryReq = true;
         return false;
     }
+    ++ owner->stats.portReqCount[id];
+    reqQueue.push_back(pkt);
+    owner->scheduleArbitration();
     return true;
 }
 
@@ -617,6 +1591,9 @@ NodeController::handleCommon(NodeControllerCommandPtr cmd) {
         case NodeControllerCommand::Type::REVOKE:
             ++ stats.revokeCount;
             break;
+        case NodeControllerCommand::Type::REVOKE_BATCH:
+            ++ stats.revokeBatchCount;
+            break;
         case NodeControllerCommand::Type::RC_UPDATE:
             ++ stats.rcUpdateCount;
             break;
@@ -629,7 +1606,7 @@ NodeController::handleCommon(NodeControllerCommandPtr cmd) {
 
 Tick
 NodeController::handleAtomicReq(PacketPtr pkt) {
-    NodeControllerCommand* cmd  = pkt->getPtr<NodeControllerCommand>();
+    NodeControllerCommand* cmd  = pkt->getRaw<NodeControllerCommandPtr>();
     panic_if(cmd == NULL, "node controller received invalid command (atomic)");
     
     ++ stats.atomicReqCount;
@@ -638,7 +1615,8 @@ NodeController::handleAtomicReq(PacketPtr pkt) {
 
     Tick ticks = cmd->handleAtomic(*this, pkt);
 
-    delete cmd;
+    traceCommand(cmd, curTick(), InvalidPortID, pkt);
+    freeCommand(cmd);
 
     return ticks;
 }
@@ -651,18 +1629,26 @@ NodeController::CPUSidePort::recvAtomic(PacketPtr pkt) {
 
 
 void NodeController::CPUSidePort::recvRespRetry() {
-    assert(retryPkt != NULL);
-    PacketPtr pkt = retryPkt;
-    retryPkt = NULL;
-    trySendResp(pkt);
+    assert(!retryPkts.empty());
+    while(!retryPkts.empty()) {
+        if(!sendTimingResp(retryPkts.front())) {
+            return;
+        }
+        retryPkts.pop_front();
+    }
+    owner->tryCompleteDrain();
 }
 
 void NodeController::CPUSidePort::trySendResp(PacketPtr pkt) {
     DPRINTF(CapstoneNCache, "NCacheController try sending response\n");
-    assert(retryPkt == NULL);
-    if(!sendTimingResp(pkt)) {
-        retryPkt = pkt;
-    } else if(toRetryReq){
+    // responses are returned in the order the commands finish
+    if(!retryPkts.empty() || !sendTimingResp(pkt)) {
+        retryPkts.push_back(pkt);
+    }
+}
+
+void NodeController::CPUSidePort::trySendRetryReq() {
+    if(toRetryReq && reqQueue.size() < owner->portQueueDepth) {
         toRetryReq = false;
         sendRetryReq(); // ready to receive new request
     }
@@ -708,6 +1694,34 @@ NodeController::freeObject(Addr addr) {
     //return std::optional<SimpleAddrRange>();
 //}
 
+void
+NodeController::freeCommand(NodeControllerCommandPtr cmd) {
+    switch(cmd->getType()) {
+        case NodeControllerCommand::Type::ALLOCATE:
+            commandPool<NodeControllerAllocate>().release(
+                    static_cast<NodeControllerAllocate*>(cmd));
+            break;
+        case NodeControllerCommand::Type::QUERY:
+            commandPool<NodeControllerQuery>().release(
+                    static_cast<NodeControllerQuery*>(cmd));
+            break;
+        case NodeControllerCommand::Type::RC_UPDATE:
+            commandPool<NodeControllerRcUpdate>().release(
+                    static_cast<NodeControllerRcUpdate*>(cmd));
+            break;
+        case NodeControllerCommand::Type::REVOKE:
+            commandPool<NodeControllerRevoke>().release(
+                    static_cast<NodeControllerRevoke*>(cmd));
+            break;
+        case NodeControllerCommand::Type::REVOKE_BATCH:
+            commandPool<NodeControllerRevokeBatch>().release(
+                    static_cast<NodeControllerRevokeBatch*>(cmd));
+            break;
+        default:
+            panic("unknown node controller command type");
+    }
+}
+
 void
 NodeController::regStats() {
     ClockedObject::regStats();
@@ -717,33 +1731,75 @@ void
 NodeController::addCapTrack(const CapLoc& loc, NodeID node_id) {
     DPRINTF(CapstoneCapTrack, "cap track added with node %u, %s\n", node_id,
             loc.toString().c_str());
-    capTrackMap[loc] = node_id;
+    capTrackTable.add(loc, node_id);
 }
 
 NodeID
 NodeController::queryCapTrack(const CapLoc& loc) {
     //DPRINTF(CapstoneCapTrack, "cap track queried\n");
-    try{
-        return capTrackMap.at(loc);
-    } catch(const std::out_of_range& e) {
-        return NODE_ID_INVALID;
-    }
+    return capTrackTable.query(loc);
 }
 
 void
 NodeController::removeCapTrack(const CapLoc& loc) {
     DPRINTF(CapstoneCapTrack, "cap track removed %s\n",
             loc.toString().c_str());
-    capTrackMap.erase(loc);
+    capTrackTable.remove(loc);
 }
 
 void
 NodeController::freeNode(Node& node, NodeID node_id) {
     DPRINTF(CapstoneNodeOps, "free node with id %lu\n", node_id);
+    if(allocPolicy == enums::slab) {
+        node.next = slabAllocator.release(node_id);
+        return;
+    }
     node.next = free_head;
     free_head = node_id;
 }
 
+void
+NodeController::pickFreeNode(NodeID parent_id, NodeID* node_id,
+        bool* from_free_list) {
+    if(allocPolicy == enums::slab) {
+        SlabNodeAllocator::Choice choice = slabAllocator.pick(parent_id);
+        panic_if(choice.nodeId == NODE_ID_INVALID, "no free node remaining.");
+        *node_id = choice.nodeId;
+        *from_free_list = choice.fromFreeList;
+    } else if(free_head == NODE_ID_INVALID) {
+        panic_if((NodeID)freeNodeInited >= nodeCount, "no free node remaining.");
+        *node_id = (NodeID)freeNodeInited;
+        *from_free_list = false;
+    } else{
+        *node_id = free_head;
+        *from_free_list = true;
+    }
+
+    if(parent_id != NODE_ID_INVALID) {
+        ++ stats.childAllocs;
+        unsigned int line_size = system->cacheLineSize();
+        if(nodeId2Addr(*node_id) / line_size ==
+                nodeId2Addr(parent_id) / line_size) {
+            ++ stats.childAllocsNearParent;
+        }
+    }
+    DPRINTF(CapstoneNodeOps, "picked node %u for parent %u (%s)\n", *node_id,
+            parent_id, *from_free_list ? "free list" : "fresh");
+}
+
+void
+NodeController::takeFreeNode(NodeID node_id, bool from_free_list,
+        NodeID next_free) {
+    if(allocPolicy == enums::slab) {
+        slabAllocator.take(SlabNodeAllocator::Choice{node_id, from_free_list},
+                next_free);
+    } else if(from_free_list) {
+        free_head = next_free;
+    } else{
+        ++ freeNodeInited;
+    }
+}
+
 NodeControllerCommand::Type NodeControllerAllocate::getType() const {
     return Type::ALLOCATE;
 }
@@ -760,6 +1816,10 @@ NodeControllerCommand::Type NodeControllerRevoke::getType() const {
     return Type::REVOKE;
 }
 
+NodeControllerCommand::Type NodeControllerRevokeBatch::getType() const {
+    return Type::REVOKE_BATCH;
+}
+
 
 } // end of namespace gem5::RiscvcapstoneISA
 
@@ -1,32 +1,42 @@
 #ifndef NODE_CONTROLLER_H
 #define NODE_CONTROLLER_H
 
+#include<algorithm>
 #include<bitset>
+#include<deque>
+#include<list>
 #include<utility>
 #include<optional>
+#include<tuple>
 #include<vector>
 #include "sim/clocked_object.hh"
 #include "sim/system.hh"
 #include "mem/packet.hh"
 #include "mem/port.hh"
 #include "params/NodeController.hh"
+#include "enums/NodeAllocPolicy.hh"
 #include "base/trace.hh"
 #include "arch/riscvcapstone/cap_track.hh"
+#include "arch/riscvcapstone/node_allocator.hh"
+#include "arch/riscvcapstone/node_cache.hh"
+#include "arch/riscvcapstone/node_packet_pool.hh"
+#include "arch/riscvcapstone/pool.hh"
+#include "arch/riscvcapstone/sparse_table.hh"
 #include "base/statistics.hh"
 
 //#define CAPSTONE_NODE_BASE_ADDR 0x100000000000ULL
 #define CAPSTONE_NODE_BASE_ADDR 0x7d0000000ULL
-#define CAPSTONE_NODE_N (1<<24)
 
 // size of each revocation nodes (in bits)
 
+class ProtoOutputStream;
+
 namespace gem5::RiscvcapstoneISA {
 
 const size_t CAPSTONE_NODE_SIZE = 128;
 
 class NodeController;
-
-const NodeID NODE_ID_INVALID = (NodeID)(-1ULL & ((1ULL << 31) - 1));
+struct Node;
 
 /**
  * base class for all commands to node controller
@@ -36,12 +46,16 @@ struct NodeControllerCommand {
         ALLOCATE,
         QUERY,
         RC_UPDATE,
-        REVOKE
+        REVOKE,
+        REVOKE_BATCH
     } Type;
     virtual void setup(NodeController& controller, PacketPtr pkt) = 0;
     virtual bool transit(NodeController& controller, PacketPtr current_pkt, PacketPtr pkt) = 0;
     virtual Tick handleAtomic(NodeController& controller, PacketPtr pkt) = 0;
     virtual Type getType() const = 0;
+    // the only node the command touches, or NODE_ID_INVALID if the command
+    // might touch arbitrary nodes and controller state (e.g., allocation)
+    virtual NodeID getNodeId() const { return NODE_ID_INVALID; }
 };
 
 struct NodeControllerQuery : NodeControllerCommand {
@@ -52,18 +66,40 @@ struct NodeControllerQuery : NodeControllerCommand {
     bool transit(NodeController& controller, PacketPtr current_pkt, PacketPtr pkt) override;
     Tick handleAtomic(NodeController& controller, PacketPtr pkt) override;
     Type getType() const override;
+    NodeID getNodeId() const override { return nodeId; }
 };
 
 
 struct NodeControllerRevoke : NodeControllerCommand {
     NodeID nodeId;
-    NodeControllerRevoke() {}
-    NodeControllerRevoke(NodeID node_id) : nodeId(node_id) {}
+    NodeControllerRevoke() : background(false), walkLength(0),
+        lastLine(MaxAddr), lineTouches(0) {}
+    NodeControllerRevoke(NodeID node_id) :
+        nodeId(node_id), background(false), walkLength(0),
+        lastLine(MaxAddr), lineTouches(0) {}
     void setup(NodeController& controller, PacketPtr pkt) override;
     bool transit(NodeController& controller, PacketPtr current_pkt, PacketPtr pkt) override;
     Tick handleAtomic(NodeController& controller, PacketPtr pkt) override;
     Type getType() const override;
+
+    // called for each node loaded by the walk
+    void
+    touchLine(Addr line) {
+        if(line != lastLine) {
+            lastLine = line;
+            ++ lineTouches;
+        }
+    }
     private:
+        bool finish(NodeController& controller, PacketPtr current_pkt);
+
+        // responded already, the walk continues in the background
+        bool background;
+        unsigned int walkLength; // number of nodes invalidated
+        // cache lines visited by the walk, counting a line again whenever
+        // the walk comes back to it
+        Addr lastLine;
+        unsigned int lineTouches;
         enum {
             NCRevoke_LOAD_ROOT,
             NCRevoke_LOAD,
@@ -76,6 +112,48 @@ struct NodeControllerRevoke : NodeControllerCommand {
         NodeID prevNodeId;
 };
 
+/**
+ * Revocation of many nodes at once, e.g., when an arena is torn down.
+ * The roots are visited in ID order. A root that was already invalidated
+ * by the walk of an earlier root in the batch is skipped, and when a walk
+ * reaches another root right after a subtree, it goes on with the subtree
+ * of that root. Each run of adjacent subtrees is therefore unlinked from
+ * the list with a single relink of its neighbours.
+ * */
+struct NodeControllerRevokeBatch : NodeControllerCommand {
+    std::vector<NodeID> roots; // sorted, without duplicates
+    NodeControllerRevokeBatch() {}
+    NodeControllerRevokeBatch(std::vector<NodeID> node_ids);
+    void setup(NodeController& controller, PacketPtr pkt) override;
+    bool transit(NodeController& controller, PacketPtr current_pkt, PacketPtr pkt) override;
+    Tick handleAtomic(NodeController& controller, PacketPtr pkt) override;
+    Type getType() const override;
+    private:
+        bool
+        isRoot(NodeID node_id) const {
+            return std::binary_search(roots.begin(), roots.end(), node_id);
+        }
+        // invalidates the node and returns the next one in the list
+        NodeID invalidate(NodeController& controller, NodeID node_id,
+                Node& node);
+        bool relink(NodeController& controller, PacketPtr current_pkt);
+        bool nextRun(NodeController& controller, PacketPtr current_pkt);
+
+        enum {
+            NCRevokeBatch_LOAD_ROOT,
+            NCRevokeBatch_LOAD,
+            NCRevokeBatch_STORE,
+            NCRevokeBatch_STORE_RIGHT,
+            NCRevokeBatch_LOAD_LEFT, NCRevokeBatch_STORE_LEFT,
+        } state;
+        size_t nextRoot; // index of the root to visit after this run
+        NodeID curNodeId;
+        unsigned int rootDepth; // lowest depth of the roots in this run
+        NodeID prevNodeId; // the node before the run
+        unsigned int runs;
+        unsigned int walkLength; // number of nodes invalidated
+};
+
 struct NodeControllerRcUpdate : NodeControllerCommand {
     NodeID nodeId;
     int delta;
@@ -85,6 +163,7 @@ struct NodeControllerRcUpdate : NodeControllerCommand {
     bool transit(NodeController& controller, PacketPtr current_pkt, PacketPtr pkt) override;
     Tick handleAtomic(NodeController& controller, PacketPtr pkt) override;
     Type getType() const override;
+    NodeID getNodeId() const override { return nodeId; }
     private:
         enum {
             NCRcUpdate_LOAD,
@@ -134,10 +213,11 @@ struct Node {
 };
 
 static_assert(sizeof(Node) == (CAPSTONE_NODE_SIZE >> 3));
+static_assert(sizeof(Node) <= NodePacketPool::DATA_SIZE);
 
 struct SimpleAddrRange {
     Addr start, end;
-    SimpleAddrRange() {}
+    SimpleAddrRange() : start(0), end(0) {}
     SimpleAddrRange(Addr start, Addr end) : start(start), end(end) {}
     bool operator < (const SimpleAddrRange& other) const {
         if(start != other.start) {
@@ -161,26 +241,42 @@ typedef std::set<SimpleAddrRange> SimpleAddrRangeSet;
 
 class NodeController : public ClockedObject {
     private:
+        /**
+         * One port per core. Timing requests wait in a per-port queue
+         * until the arbiter moves them into the command queue.
+         * */
         class CPUSidePort : public ResponsePort {
             private:
                 NodeController* owner;
-                PacketPtr retryPkt;
+                std::deque<PacketPtr> reqQueue; // requests waiting for arbitration
+                std::deque<PacketPtr> retryPkts; // responses to retry, in order
                 bool toRetryReq;
 
             public:
-                CPUSidePort(NodeController* owner);
+                const PortID id;
+
+                CPUSidePort(NodeController* owner, PortID id);
                 Tick recvAtomic(PacketPtr pkt) override;
                 bool recvTimingReq(PacketPtr pkt) override;
                 void recvRespRetry() override;
                 void recvFunctional(PacketPtr pkt) override;
                 AddrRangeList getAddrRanges() const override;
                 void trySendResp(PacketPtr pkt);
+                void trySendRetryReq();
+                bool hasPendingResps() const { return !retryPkts.empty(); }
+                bool hasPendingReqs() const { return !reqQueue.empty(); }
+                PacketPtr
+                popReq() {
+                    PacketPtr pkt = reqQueue.front();
+                    reqQueue.pop_front();
+                    return pkt;
+                }
         };
 
         class MemSidePort : public RequestPort {
             private:
                 NodeController* owner;
-                PacketPtr retryPkt; // request packet to retry
+                std::deque<PacketPtr> retryPkts; // request packets to retry, in order
 
             protected:
                 bool recvTimingResp(PacketPtr pkt) override;
@@ -219,8 +315,53 @@ class NodeController : public ClockedObject {
                 ADD_STAT(revokePacketCount, "Number of all packets for node revocations",
                         revokePacketStoreCount + revokePacketLoadCount),
                 ADD_STAT(rcUpdatePacketCount, "Number of all packets for node rc updates",
-                        rcUpdatePacketStoreCount + rcUpdatePacketLoadCount)
-                    {}
+                        rcUpdatePacketStoreCount + rcUpdatePacketLoadCount),
+                ADD_STAT(cmdQueueOccupancy, "Average number of commands in the command queue"),
+                ADD_STAT(hazardStalls, "Number of commands delayed by a node hazard"),
+                ADD_STAT(queueFullStalls, "Number of requests rejected because the CPU port queue is full"),
+                ADD_STAT(commandAllocs, "Number of commands allocated from the heap"),
+                ADD_STAT(portReqCount, "Number of timing requests received on each CPU port"),
+                ADD_STAT(arbitrationStalls, "Number of cycles with requests waiting in "
+                        "the CPU ports while the command queue is full"),
+                ADD_STAT(revokeWalkLength, "Number of nodes invalidated by each revocation"),
+                ADD_STAT(sweepLatency, "Ticks from the response of an asynchronous "
+                        "revocation to the end of its background sweep"),
+                ADD_STAT(sweepStalls, "Number of times the background sweep waited for "
+                        "an rc update to the node it was about to visit"),
+                ADD_STAT(sweepQueryWaits, "Number of queries that waited for the "
+                        "background sweep before reloading their node"),
+                ADD_STAT(hostNodeAccesses, "Number of node accesses served by "
+                        "the host-side node array"),
+                ADD_STAT(hostNodeFills, "Number of nodes copied from memory into "
+                        "the host-side node array"),
+                ADD_STAT(hostNodeWritebacks, "Number of nodes copied from the "
+                        "host-side node array back to memory"),
+                ADD_STAT(bulkCopies, "Number of bulk capability copies"),
+                ADD_STAT(bulkCopyCaps, "Number of capabilities copied or "
+                        "overwritten by bulk copies"),
+                ADD_STAT(bulkCopyRcUpdates, "Number of rc updates issued "
+                        "for bulk copies"),
+                ADD_STAT(revokeWalkLines, "Number of cache line switches "
+                        "during each revocation walk"),
+                ADD_STAT(childAllocs, "Number of allocations with a parent"),
+                ADD_STAT(childAllocsNearParent, "Number of allocations that "
+                        "placed the node on the cache line of its parent"),
+                ADD_STAT(childAllocLocality, "Ratio of allocations with a "
+                        "parent that placed the node on the line of its parent",
+                        childAllocsNearParent / childAllocs),
+                ADD_STAT(revokeBatchCount, "Number of batched revocations"),
+                ADD_STAT(revokeBatchRoots, "Number of nodes given to "
+                        "batched revocations"),
+                ADD_STAT(revokeBatchRuns, "Number of runs of adjacent "
+                        "subtrees unlinked by batched revocations"),
+                ADD_STAT(revokeBatchWalkLength, "Number of nodes invalidated "
+                        "by each batched revocation")
+            {
+                revokeWalkLength.init(16);
+                revokeWalkLines.init(16);
+                revokeBatchWalkLength.init(16);
+                sweepLatency.init(16);
+            }
 
             // overall request statistics
             statistics::Scalar timingReqCount;
@@ -247,29 +388,231 @@ class NodeController : public ClockedObject {
             statistics::Formula queryPacketCount;
             statistics::Formula revokePacketCount;
             statistics::Formula rcUpdatePacketCount;
+
+            // command queue statistics
+            statistics::Average cmdQueueOccupancy;
+            statistics::Scalar hazardStalls;
+            statistics::Scalar queueFullStalls;
+
+            statistics::Scalar commandAllocs;
+
+            // arbitration among the CPU ports
+            statistics::Vector portReqCount;
+            statistics::Scalar arbitrationStalls;
+
+            // revocation
+            statistics::Histogram revokeWalkLength;
+            statistics::Histogram sweepLatency;
+            statistics::Scalar sweepStalls;
+            statistics::Scalar sweepQueryWaits;
+
+            // functional node accesses
+            statistics::Scalar hostNodeAccesses;
+            statistics::Scalar hostNodeFills;
+            statistics::Scalar hostNodeWritebacks;
+
+            // bulk copies
+            statistics::Scalar bulkCopies;
+            statistics::Scalar bulkCopyCaps;
+            statistics::Scalar bulkCopyRcUpdates;
+
+            // node placement
+            statistics::Histogram revokeWalkLines;
+            statistics::Scalar childAllocs;
+            statistics::Scalar childAllocsNearParent;
+            statistics::Formula childAllocLocality;
+
+            // batched revocation
+            statistics::Scalar revokeBatchCount;
+            statistics::Scalar revokeBatchRoots;
+            statistics::Scalar revokeBatchRuns;
+            statistics::Histogram revokeBatchWalkLength;
+        };
+
+        struct NodeCacheStats : public statistics::Group {
+            NodeCacheStats(statistics::Group* parent) :
+                statistics::Group(parent, "nodeCache"),
+                ADD_STAT(hits, "Number of node accesses that hit in the node cache"),
+                ADD_STAT(misses, "Number of node accesses that missed in the node cache"),
+                ADD_STAT(hitRate, "Ratio of node accesses that hit in the node cache",
+                        hits / (hits + misses)),
+                ADD_STAT(writebacks, "Number of dirty nodes written back to memory"),
+                ADD_STAT(prefetches, "Number of neighbour nodes prefetched"),
+                ADD_STAT(usefulPrefetches, "Number of prefetched nodes accessed "
+                        "before their eviction")
+            {}
+
+            statistics::Scalar hits;
+            statistics::Scalar misses;
+            statistics::Formula hitRate;
+            statistics::Scalar writebacks;
+            statistics::Scalar prefetches;
+            statistics::Scalar usefulPrefetches;
         };
 
+        /**
+         * identifies the command a memory-side packet belongs to,
+         * nullptr for node cache write-backs and prefetches
+         * */
+        struct NodeSenderState : public Packet::SenderState {
+            NodeControllerCommandPtr cmd;
+            NodeID nodeId;
+            NodeSenderState(NodeControllerCommandPtr cmd,
+                    NodeID node_id = NODE_ID_INVALID) :
+                cmd(cmd), nodeId(node_id) {}
+        };
+
+        /**
+         * a command accepted by the controller, either in flight
+         * or waiting for an older conflicting command to finish
+         * */
+        struct PendingCommand {
+            PacketPtr pkt;
+            NodeControllerCommandPtr cmd;
+            PortID port; // the CPU port to respond to
+            bool active;
+            Tick arrival;
+            PendingCommand(PacketPtr pkt, NodeControllerCommandPtr cmd,
+                    PortID port) :
+                pkt(pkt), cmd(cmd), port(port), active(false),
+                arrival(curTick()) {}
+        };
+
+        typedef std::list<PendingCommand> CommandQueue;
+
 
         NodeControllerStats stats;
+        NodeCacheStats nodeCacheStats;
+
+        // packets for node loads and stores
+        NodePacketPool packetPool;
+        ObjectPool<NodeSenderState> senderStatePool;
+        // commands are handed out to the CPUs and come back here once done
+        std::tuple<ObjectPool<NodeControllerQuery>,
+            ObjectPool<NodeControllerRevoke>,
+            ObjectPool<NodeControllerRevokeBatch>,
+            ObjectPool<NodeControllerRcUpdate>,
+            ObjectPool<NodeControllerAllocate>> commandPools;
+
+        template<typename T>
+        ObjectPool<T>&
+        commandPool() {
+            return std::get<ObjectPool<T>>(commandPools);
+        }
 
-        PacketPtr currentPkt; // packet currently handling
+        CommandQueue cmdQueue; // commands accepted, in arrival order
+        const unsigned int cmdQueueDepth;
+        const unsigned int portQueueDepth;
         
-        CPUSidePort cpu_side;
+        std::vector<CPUSidePort*> cpuSidePorts;
         MemSidePort mem_side;
 
+        // round-robin arbitration among the CPU ports, one request per cycle
+        EventFunctionWrapper arbitrateEvent;
+        PortID lastArbitratedPort;
+
         SimpleAddrRangeSet objectRanges;
     
         System* system; // the system the node controller belongs to
         RequestorID requestorId;
 
-        CapTrackMap capTrackMap;
+        CapTrackTable capTrackTable;
+
+        // the revocation whose sweep continues in the background, if any
+        NodeControllerRevoke* sweep;
+        NodeID sweepNode; // the node the sweep is loading or storing
+        NodeID sweepBlockedOn; // the node the sweep waits to load
+        unsigned int sweepRootDepth;
+        Tick sweepStart;
+        std::vector<NodeControllerQuery*> sweepWaiters;
+
+        bool rcUpdateActiveOn(NodeID node_id) const;
+        void endSweep();
+
+        /**
+         * The node cache keeps revocation nodes (rather than 64-byte
+         * lines) in front of the memory side port. Loads that hit and all
+         * stores are answered after node_cache_latency, stores only reach
+         * memory when their node is evicted or the controller drains.
+         * Disabled when node_cache_entries is 0.
+         * */
+        NodeCache<Node> nodeCache;
+        const Cycles nodeCacheLatency;
+        const bool nodeCachePrefetch;
+        std::deque<std::pair<Tick, PacketPtr>> nodeCacheResps; // in tick order
+        EventFunctionWrapper nodeCacheRespEvent;
+        std::vector<NodeID> prefetchesInFlight;
+        unsigned int writebacksInFlight;
+
+        PacketPtr nodeCacheAccess(NodeControllerCommandPtr cmd, NodeID node_id,
+                const Node* store_node, bool atomic);
+        void sendNodeCacheResps();
+        void fillNodeCache(NodeID node_id, const Node& node, bool prefetched,
+                bool atomic);
+        void writeBackNode(NodeID node_id, const Node& node, bool atomic);
+        void prefetchNeighbours(NodeControllerCommandPtr cmd, const Node& node);
+        void flushNodeCache();
+        void handleMemResp(PacketPtr pkt);
+
+
+        // latency of the atomic memory accesses of the current node access
+        Tick atomicLatency;
+
+        /**
+         * With functional_atomic, atomic-mode commands work on a host-side
+         * copy of the nodes instead of sending packets to memory, and take
+         * no time. Nodes are copied in from memory on their first access,
+         * and the modified ones are copied back when the controller drains
+         * (before the CPUs are switched or a checkpoint is taken).
+         * Bypasses the node cache.
+         * */
+        struct HostNode {
+            Node node;
+            bool valid; // copied from memory
+            bool dirty;
+        };
+        const bool functionalAtomic;
+        SparseTable<HostNode> hostNodes;
+        std::vector<NodeID> hostNodesDirty;
+
+        bool
+        functionalNodes() const {
+            return functionalAtomic && system->isAtomicMode();
+        }
+        HostNode& hostNode(NodeID node_id);
+        void writeBackHostNodes();
 
+        void touchRevokeLine(NodeControllerCommandPtr cmd, NodeID node_id);
+
+        /**
+         * With trace_file set, every command is written to a protobuf
+         * stream (see node_cmd.proto) when the controller responds to it,
+         * for NodeControllerTraceReplayer. pkt is the response.
+         * */
+        ProtoOutputStream* traceStream;
+        void traceCommand(NodeControllerCommandPtr cmd, Tick arrival,
+                PortID port, PacketPtr pkt);
+        void closeTrace();
 
         void sendPacketToMem(PacketPtr pkt, bool atomic);
         void handleCommon(NodeControllerCommandPtr cmd);
 
+        bool hasHazard(CommandQueue::iterator it);
+        void startCommands();
+
+        void scheduleArbitration();
+        void arbitrate();
+        void acceptTimingReq(PacketPtr pkt, PortID port);
+
+        bool isDrained() const;
+        void tryCompleteDrain();
+
+        void serializeState(const std::string& filepath) const;
+        void unserializeState(const std::string& filepath);
+
     public:
         NodeController(const NodeControllerParams& p);
+        ~NodeController();
         Port& getPort(const std::string& name, PortID idx) override;
 
         // only update the object registry
@@ -282,42 +625,179 @@ class NodeController : public ClockedObject {
 
         void regStats() override;
 
-        bool handleTimingReq(PacketPtr pkt);
         Tick handleAtomicReq(PacketPtr pkt);
         void handleResp(PacketPtr pkt);
 
         void init() override;
 
+        DrainState drain() override;
+        void serialize(CheckpointOut& cp) const override;
+        void unserialize(CheckpointIn& cp) override;
+
         PacketPtr sendLoad(NodeControllerCommandPtr cmd, NodeID node_id, 
                 bool atomic = false);
         PacketPtr sendStore(NodeControllerCommandPtr cmd, NodeID node_id,
                 const Node& node, bool atomic = false);
 
-        void atomicLoadNode(NodeControllerCommandPtr cmd, NodeID node_id, Node* node) {
+        // both return the latency of the access
+        Tick atomicLoadNode(NodeControllerCommandPtr cmd, NodeID node_id, Node* node) {
+            if(functionalNodes()) {
+                if(cmd->getType() == NodeControllerCommand::Type::REVOKE) {
+                    touchRevokeLine(cmd, node_id);
+                }
+                *node = hostNode(node_id).node;
+                return 0;
+            }
+            atomicLatency = 0;
             PacketPtr pkt = sendLoad(cmd, node_id, true);
             memcpy(node, pkt->getPtr<void>(), sizeof(Node));
-            delete pkt;
+            packetPool.release(pkt);
+            return atomicLatency;
         }
 
-        void atomicStoreNode(NodeControllerCommandPtr cmd, NodeID node_id, const Node* node) {
+        Tick atomicStoreNode(NodeControllerCommandPtr cmd, NodeID node_id, const Node* node) {
+            if(functionalNodes()) {
+                HostNode& host_node = hostNode(node_id);
+                host_node.node = *node;
+                if(!host_node.dirty) {
+                    host_node.dirty = true;
+                    hostNodesDirty.push_back(node_id);
+                }
+                return 0;
+            }
+            atomicLatency = 0;
             PacketPtr pkt = sendStore(cmd, node_id, *node, true);
-            delete pkt;
+            packetPool.release(pkt);
+            return atomicLatency;
         }
 
+        /**
+         * Creates a command to send to this controller. The controller
+         * frees it when the command finishes, so the sender must not
+         * touch it after receiving the response.
+         * */
+        template<typename T, typename... Args>
+        T*
+        newCommand(Args&&... args) {
+            ObjectPool<T>& pool = commandPool<T>();
+            if(pool.freeCount() == 0) {
+                ++ stats.commandAllocs;
+            }
+            return pool.acquire(std::forward<Args>(args)...);
+        }
+
+        void freeCommand(NodeControllerCommandPtr cmd);
+
+        /**
+         * Asynchronous revocation: the revoke responds once its root is
+         * invalidated, and the walk over the descendants continues in the
+         * background. Meanwhile, rc updates and queries proceed, except
+         * that rc updates do not overlap with the sweep on the same node,
+         * and queries that find a valid node that might still be pending
+         * invalidation wait for the sweep and reload it. Allocations and
+         * revocations wait for the sweep to finish.
+         * */
+        const bool asyncRevoke;
+        void startSweep(NodeControllerRevoke* cmd, unsigned int root_depth);
+        void sweepLoad(NodeControllerRevoke* cmd, NodeID node_id);
+        bool mustWaitForSweep(const Node& node) const;
+        void waitForSweep(NodeControllerQuery* cmd);
+        void recordRevokeWalk(unsigned int length, unsigned int lines);
+        void recordRevokeBatch(unsigned int roots, unsigned int runs,
+                unsigned int length);
+
         void addCapTrack(const CapLoc& loc, NodeID node_id);
         NodeID queryCapTrack(const CapLoc& loc);
         void removeCapTrack(const CapLoc& loc);
 
+        // registers of the thread holding capabilities, one bit per
+        // register index
+        uint64_t
+        capTrackRegMask(int thread_id) const {
+            return capTrackTable.regMask(thread_id);
+        }
+
+        // whether a write to [addr, addr + size) might hit a capability
+        bool
+        capTrackTouches(Addr addr, Addr size) const {
+            return capTrackTable.memTouches(addr, size);
+        }
+
+        /**
+         * Bulk copy of the capabilities in [src, src + size) to
+         * [dst, dst + size), e.g., for memcpy. The tracking entries move at
+         * once, and the reference count changes are merged per node:
+         * issue(node_id, delta) is called once for each node whose count
+         * changes.
+         * */
+        template<typename F>
+        void
+        copyCapTrackRange(Addr dst, Addr src, Addr size, F issue) {
+            ++ stats.bulkCopies;
+            std::vector<std::pair<NodeID, int>> deltas;
+            auto count = [this, &deltas](NodeID node_id, int delta) {
+                ++ stats.bulkCopyCaps;
+                for(auto& d : deltas) {
+                    if(d.first == node_id) {
+                        d.second += delta;
+                        return;
+                    }
+                }
+                deltas.emplace_back(node_id, delta);
+            };
+            capTrackTable.copyMemRange(dst, src, size,
+                    [&count](Addr addr, NodeID node_id) { count(node_id, -1); },
+                    [&count](Addr addr, NodeID node_id) { count(node_id, 1); });
+            for(const auto& d : deltas) {
+                if(d.second != 0) {
+                    ++ stats.bulkCopyRcUpdates;
+                    issue(d.first, d.second);
+                }
+            }
+        }
+
+        // removes the capabilities in memory overlapping [addr, addr + size)
+        // and calls f(node_id) for each of them
+        template<typename F>
+        void
+        removeCapTrackRange(Addr addr, Addr size, F f) {
+            capTrackTable.removeMemRange(addr, size,
+                    [&f](Addr cap_addr, NodeID node_id) {
+                f(node_id);
+            });
+        }
+
         void freeNode(Node& node, NodeID node_id);
 
-        // free list
+        /**
+         * Allocation takes two steps because the free lists are linked
+         * through the free nodes in memory: pickFreeNode() chooses the
+         * node for a new child of parent_id, and takeFreeNode() removes
+         * it from its free list once the node has been loaded and its
+         * next free node is known. Allocations do not overlap, so nothing
+         * else allocates in between.
+         * */
+        void pickFreeNode(NodeID parent_id, NodeID* node_id,
+                bool* from_free_list);
+        void takeFreeNode(NodeID node_id, bool from_free_list,
+                NodeID next_free);
+
+        const enums::NodeAllocPolicy allocPolicy;
+        // only used by the slab policy
+        SlabNodeAllocator slabAllocator;
+
+        // free list (lifo policy)
         NodeID free_head;
         // tree
         NodeID tree_root;
 
         int freeNodeInited;
 
-        SimpleAddrRange node2Obj[CAPSTONE_NODE_N];
+        // total number of revocation nodes
+        const NodeID nodeCount;
+
+        // object range of each node, only populated for nodes in use
+        SparseTable<SimpleAddrRange> node2Obj;
 };
 
 } // end of namespace gem5::RiscvcapstoneISA
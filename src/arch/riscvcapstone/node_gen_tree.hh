@@ -0,0 +1,143 @@
+#ifndef NODE_GEN_TREE_H
+#define NODE_GEN_TREE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "arch/riscvcapstone/cap_track.hh"
+#include "arch/riscvcapstone/types.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * The live revocation nodes as far as a synthetic workload (the node
+ * controller traffic generator) knows, with their derivation tree.
+ *
+ * The controller reuses the IDs of freed nodes, so every node gets a
+ * serial that tells the incarnations of an ID apart. A revoked node is
+ * unlinked from its parent, so revoking the parent later does not walk
+ * into an ID that is free or belongs to an unrelated node by then.
+ * */
+class NodeGenTree {
+    public:
+        struct GenNode {
+            uint64_t serial; // tells reused node IDs apart
+            NodeID parent; // NODE_ID_INVALID for a root
+            unsigned int depth;
+            unsigned int children; // allocated or being allocated
+            unsigned int refs; // references besides the initial one
+            size_t livePos; // index in liveNodes
+            std::vector<NodeID> childIds;
+        };
+
+    private:
+        std::unordered_map<NodeID, GenNode> nodes;
+        std::vector<NodeID> liveNodes;
+        uint64_t nextSerial;
+
+    public:
+        NodeGenTree() : nextSerial(0) {}
+
+        size_t
+        size() const {
+            return nodes.size();
+        }
+
+        bool
+        empty() const {
+            return nodes.empty();
+        }
+
+        // the i-th live node, in no particular order
+        NodeID
+        liveAt(size_t i) const {
+            return liveNodes[i];
+        }
+
+        // the live node, or nullptr
+        GenNode*
+        find(NodeID node_id) {
+            auto it = nodes.find(node_id);
+            return it == nodes.end() ? nullptr : &it->second;
+        }
+
+        // same, and nullptr if the ID has been reused since serial
+        GenNode*
+        find(NodeID node_id, uint64_t serial) {
+            GenNode* node = find(node_id);
+            return node == nullptr || node->serial != serial ? nullptr : node;
+        }
+
+        /**
+         * Records a new node derived from parent (NODE_ID_INVALID for a
+         * root), which must be live. The parent's children count is not
+         * touched, since it already counts the allocation in flight.
+         * Returns the serial of the node.
+         * */
+        uint64_t
+        add(NodeID node_id, NodeID parent) {
+            assert(nodes.find(node_id) == nodes.end());
+            GenNode node = GenNode();
+            node.serial = nextSerial ++;
+            node.parent = parent;
+            node.depth = 1;
+            if(parent != NODE_ID_INVALID) {
+                GenNode* p = find(parent);
+                assert(p != nullptr);
+                p->childIds.push_back(node_id);
+                node.depth = p->depth + 1;
+            }
+            node.livePos = liveNodes.size();
+            nodes[node_id] = node;
+            liveNodes.push_back(node_id);
+            return node.serial;
+        }
+
+        /**
+         * Forgets the node and its subtree, and calls f(node_id, refs)
+         * for each of them. Returns the number of nodes removed.
+         * */
+        template<typename F>
+        unsigned int
+        kill(NodeID node_id, F f) {
+            GenNode* root = find(node_id);
+            assert(root != nullptr);
+            if(root->parent != NODE_ID_INVALID) {
+                GenNode* parent = find(root->parent);
+                assert(parent != nullptr);
+                auto& ids = parent->childIds;
+                ids.erase(std::find(ids.begin(), ids.end(), node_id));
+                -- parent->children;
+            }
+
+            std::vector<NodeID> stack{node_id};
+            unsigned int size = 0;
+            while(!stack.empty()) {
+                NodeID id = stack.back();
+                stack.pop_back();
+                auto it = nodes.find(id);
+                assert(it != nodes.end());
+                GenNode& node = it->second;
+                stack.insert(stack.end(), node.childIds.begin(),
+                        node.childIds.end());
+
+                NodeID last = liveNodes.back();
+                liveNodes[node.livePos] = last;
+                nodes[last].livePos = node.livePos;
+                liveNodes.pop_back();
+
+                f(id, node.refs);
+                nodes.erase(it);
+                ++ size;
+            }
+            return size;
+        }
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
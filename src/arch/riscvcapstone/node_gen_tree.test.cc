@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "arch/riscvcapstone/node_gen_tree.hh"
+
+using namespace gem5::RiscvcapstoneISA;
+
+typedef std::vector<std::pair<NodeID, unsigned int>> Killed;
+
+static unsigned int
+killAndRecord(NodeGenTree& tree, NodeID node_id, Killed& killed) {
+    return tree.kill(node_id, [&killed](NodeID id, unsigned int refs) {
+        killed.emplace_back(id, refs);
+    });
+}
+
+TEST(NodeGenTreeTest, AddAndFind)
+{
+    NodeGenTree tree;
+    EXPECT_TRUE(tree.empty());
+
+    uint64_t root = tree.add(1, NODE_ID_INVALID);
+    uint64_t child = tree.add(2, 1);
+    EXPECT_NE(root, child);
+    EXPECT_EQ(tree.size(), 2);
+
+    ASSERT_NE(tree.find(2), nullptr);
+    EXPECT_EQ(tree.find(1)->depth, 1);
+    EXPECT_EQ(tree.find(2)->depth, 2);
+    EXPECT_EQ(tree.find(2)->parent, 1);
+    EXPECT_EQ(tree.find(1)->childIds, std::vector<NodeID>{2});
+    EXPECT_NE(tree.find(2, child), nullptr);
+    EXPECT_EQ(tree.find(2, root), nullptr);
+    EXPECT_EQ(tree.find(3), nullptr);
+}
+
+TEST(NodeGenTreeTest, KillSubtree)
+{
+    NodeGenTree tree;
+    tree.add(1, NODE_ID_INVALID);
+    tree.add(2, 1);
+    tree.add(3, 2);
+    tree.add(4, NODE_ID_INVALID);
+    tree.find(3)->refs = 2;
+
+    Killed killed;
+    EXPECT_EQ(killAndRecord(tree, 1, killed), 3);
+    ASSERT_EQ(killed.size(), 3);
+    EXPECT_EQ(killed[2], std::make_pair(NodeID(3), 2u));
+    EXPECT_EQ(tree.size(), 1);
+    EXPECT_EQ(tree.liveAt(0), 4);
+}
+
+TEST(NodeGenTreeTest, ChildRevokedBeforeParent)
+{
+    NodeGenTree tree;
+    tree.add(1, NODE_ID_INVALID);
+    tree.find(1)->children = 2;
+    tree.add(2, 1);
+    tree.add(3, 1);
+
+    Killed killed;
+    EXPECT_EQ(killAndRecord(tree, 2, killed), 1);
+    EXPECT_EQ(tree.find(1)->childIds, std::vector<NodeID>{3});
+    EXPECT_EQ(tree.find(1)->children, 1);
+
+    // the controller hands the freed ID out again, to an unrelated root
+    uint64_t reused = tree.add(2, NODE_ID_INVALID);
+
+    killed.clear();
+    EXPECT_EQ(killAndRecord(tree, 1, killed), 2);
+    for(auto& k : killed) {
+        EXPECT_NE(k.first, 2);
+    }
+    ASSERT_NE(tree.find(2, reused), nullptr);
+    EXPECT_EQ(tree.size(), 1);
+    EXPECT_EQ(tree.liveAt(0), 2);
+}
+
+TEST(NodeGenTreeTest, RevokeThenAllocateUnderSameParent)
+{
+    NodeGenTree tree;
+    tree.add(1, NODE_ID_INVALID);
+    tree.find(1)->children = 2;
+    uint64_t old_serial = tree.add(2, 1);
+    tree.add(3, 1);
+
+    Killed killed;
+    EXPECT_EQ(killAndRecord(tree, 2, killed), 1);
+
+    // the controller hands the freed ID out again, to a new child of the
+    // same parent
+    ++ tree.find(1)->children;
+    uint64_t serial = tree.add(2, 1);
+    EXPECT_NE(serial, old_serial);
+    EXPECT_EQ(tree.find(2, old_serial), nullptr);
+    ASSERT_NE(tree.find(2, serial), nullptr);
+    EXPECT_EQ(tree.find(2)->parent, 1);
+    EXPECT_EQ(tree.find(2)->depth, 2);
+    EXPECT_EQ(tree.find(1)->childIds, (std::vector<NodeID>{3, 2}));
+    EXPECT_EQ(tree.find(1)->children, 2);
+
+    // each node of the subtree goes exactly once
+    killed.clear();
+    EXPECT_EQ(killAndRecord(tree, 1, killed), 3);
+    ASSERT_EQ(killed.size(), 3);
+    EXPECT_EQ(std::count_if(killed.begin(), killed.end(),
+                [](const std::pair<NodeID, unsigned int>& k) {
+                    return k.first == 2;
+                }), 1);
+    EXPECT_TRUE(tree.empty());
+}
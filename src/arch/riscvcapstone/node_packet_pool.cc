@@ -0,0 +1,67 @@
+#include "arch/riscvcapstone/node_packet_pool.hh"
+
+#include <new>
+
+namespace gem5::RiscvcapstoneISA {
+
+NodePacketPool::NodePacketPoolStats::NodePacketPoolStats(
+        statistics::Group* parent, const char* name) :
+    statistics::Group(parent, name),
+    ADD_STAT(acquires, "Number of packets handed out"),
+    ADD_STAT(packetAllocs, "Number of packets allocated from the heap"),
+    ADD_STAT(requestAllocs, "Number of requests allocated from the heap"),
+    ADD_STAT(bufferAllocs, "Number of data buffers allocated from the heap")
+{}
+
+NodePacketPool::NodePacketPool(statistics::Group* parent, const char* name) :
+    stats(parent, name) {
+}
+
+PacketPtr
+NodePacketPool::acquire(MemCmd cmd, RequestorID requestor_id, Addr paddr) {
+    ++ stats.acquires;
+
+    RequestPtr req;
+    if(requests.empty()) {
+        ++ stats.requestAllocs;
+        req = std::make_shared<Request>();
+    } else{
+        req = std::move(requests.back());
+        requests.pop_back();
+        // reset in place, Request is not assignable
+        req->~Request();
+        new (req.get()) Request();
+    }
+    req->requestorId(requestor_id);
+    if(paddr != MaxAddr) {
+        req->setPaddr(paddr);
+    }
+
+    if(packets.freeCount() == 0) {
+        ++ stats.packetAllocs;
+    }
+    PacketPtr pkt = packets.acquire(req, cmd);
+
+    if(buffers.freeCount() == 0) {
+        ++ stats.bufferAllocs;
+    }
+    pkt->setSize(DATA_SIZE);
+    pkt->dataStatic(buffers.acquire()->bytes);
+
+    return pkt;
+}
+
+void
+NodePacketPool::release(PacketPtr pkt) {
+    assert(pkt->senderState == nullptr);
+    RequestPtr req = pkt->req;
+    Buffer* buffer = reinterpret_cast<Buffer*>(pkt->getPtr<uint8_t>());
+
+    packets.release(pkt);
+    buffers.release(buffer);
+    if(req.use_count() == 1) {
+        requests.push_back(std::move(req));
+    }
+}
+
+} // end of namespace gem5::RiscvcapstoneISA
@@ -0,0 +1,58 @@
+#ifndef NODE_PACKET_POOL_H
+#define NODE_PACKET_POOL_H
+
+#include <cstdint>
+#include <vector>
+
+#include "arch/riscvcapstone/pool.hh"
+#include "base/statistics.hh"
+#include "mem/packet.hh"
+#include "mem/request.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * Packets for the node cache path: commands sent from a CPU to the node
+ * controller, and node loads/stores sent from the node controller to
+ * memory. All of them carry at most one revocation node of data, so
+ * each packet gets a fixed-size inline buffer instead of a heap
+ * allocation, and the packet, its request and its buffer are recycled
+ * when the packet is released.
+ *
+ * A request is only reused if nothing else (e.g., a cache) still holds
+ * a reference to it when its packet is released.
+ * */
+class NodePacketPool {
+    public:
+        static const size_t DATA_SIZE = 16; // size of a revocation node
+
+    private:
+        struct Buffer {
+            alignas(8) uint8_t bytes[DATA_SIZE];
+        };
+
+        struct NodePacketPoolStats : public statistics::Group {
+            NodePacketPoolStats(statistics::Group* parent, const char* name);
+
+            statistics::Scalar acquires;
+            statistics::Scalar packetAllocs;
+            statistics::Scalar requestAllocs;
+            statistics::Scalar bufferAllocs;
+        } stats;
+
+        ObjectPool<Packet> packets;
+        ObjectPool<Buffer> buffers;
+        std::vector<RequestPtr> requests;
+
+    public:
+        NodePacketPool(statistics::Group* parent, const char* name);
+
+        // a packet of DATA_SIZE bytes, the address is only set if valid
+        PacketPtr acquire(MemCmd cmd, RequestorID requestor_id,
+                Addr paddr = MaxAddr);
+        void release(PacketPtr pkt);
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
@@ -0,0 +1,270 @@
+#include "arch/riscvcapstone/node_trace_replayer.hh"
+
+#include <algorithm>
+
+#include "arch/riscvcapstone/node_cmd.pb.h"
+#include "base/trace.hh"
+#include "debug/CapstoneNCache.hh"
+#include "sim/core.hh"
+#include "sim/cur_tick.hh"
+#include "sim/sim_exit.hh"
+#include "sim/system.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+NodeControllerTraceReplayer::ReplayStats::ReplayStats(
+        statistics::Group* parent) :
+    statistics::Group(parent),
+    ADD_STAT(issued, "Number of commands sent to the node controller"),
+    ADD_STAT(skipped, "Number of commands skipped because their nodes "
+            "were not allocated in the trace"),
+    ADD_STAT(mappingStalls, "Number of times a command waited for the "
+            "allocation of its node"),
+    ADD_STAT(latency, "Ticks from sending a command to its response"),
+    ADD_STAT(replayTicks, "Ticks taken to replay the whole trace")
+{
+    latency.init(16);
+}
+
+NodeControllerTraceReplayer::ReplayPort::ReplayPort(
+        NodeControllerTraceReplayer* owner) :
+    RequestPort(owner->name() + ".port", owner),
+    owner(owner) {
+}
+
+bool
+NodeControllerTraceReplayer::ReplayPort::recvTimingResp(PacketPtr pkt) {
+    owner->recvResp(pkt);
+    return true;
+}
+
+void
+NodeControllerTraceReplayer::ReplayPort::recvReqRetry() {
+    owner->recvRetry();
+}
+
+NodeControllerTraceReplayer::NodeControllerTraceReplayer(
+        const NodeControllerTraceReplayerParams& p) :
+    ClockedObject(p),
+    stats(this),
+    port(this),
+    system(p.system),
+    controller(p.node_controller),
+    trace(p.trace_file),
+    maxOutstanding(p.max_outstanding),
+    respectTicks(p.respect_ticks),
+    exitOnEnd(p.exit_on_end),
+    requestorId(0),
+    packetPool(this, "packetPool"),
+    traceDone(false),
+    tickOffset(0),
+    startTick(0),
+    outstanding(0),
+    retryPkt(nullptr),
+    issueEvent([this]{ tryIssue(); }, name() + ".issue") {
+    fatal_if(maxOutstanding == 0, "max_outstanding must not be 0");
+
+    ProtoMessage::NodeCmdHeader header_msg;
+    fatal_if(!trace.read(header_msg),
+            "Failed to read the header of node command trace %s\n",
+            p.trace_file);
+    fatal_if(header_msg.tick_freq() != sim_clock::Frequency,
+            "Node command trace was recorded with a different tick "
+            "frequency %d\n", header_msg.tick_freq());
+    DPRINTF(CapstoneNCache, "replaying node commands recorded by %s\n",
+            header_msg.obj_id());
+}
+
+Port&
+NodeControllerTraceReplayer::getPort(const std::string& if_name, PortID idx) {
+    if(if_name == "port") {
+        return port;
+    }
+    return ClockedObject::getPort(if_name, idx);
+}
+
+void
+NodeControllerTraceReplayer::init() {
+    ClockedObject::init();
+    fatal_if(!port.isConnected(), "%s: port is not connected\n", name());
+    requestorId = system->getRequestorId(this);
+}
+
+void
+NodeControllerTraceReplayer::startup() {
+    fatal_if(!system->isTimingMode(),
+            "%s only supports the timing memory mode\n", name());
+    startTick = curTick();
+    traceDone = !readNext();
+    if(!traceDone) {
+        tickOffset = curTick() - std::min(next.tick, curTick());
+    }
+    tryIssue();
+}
+
+bool
+NodeControllerTraceReplayer::readNext() {
+    ProtoMessage::NodeCmd cmd_msg;
+    if(!trace.read(cmd_msg)) {
+        return false;
+    }
+    next.tick = cmd_msg.tick();
+    next.type = (NodeControllerCommand::Type)cmd_msg.type();
+    next.nodeId = cmd_msg.has_node_id() ? cmd_msg.node_id() : NODE_ID_INVALID;
+    next.delta = cmd_msg.delta();
+    next.result = cmd_msg.has_result() ? cmd_msg.result() : NODE_ID_INVALID;
+    next.nodeIds.assign(cmd_msg.node_ids().begin(), cmd_msg.node_ids().end());
+    return true;
+}
+
+NodeID
+NodeControllerTraceReplayer::mapNode(NodeID recorded, bool* wait) const {
+    auto it = nodeMap.find(recorded);
+    if(it == nodeMap.end()) {
+        return NODE_ID_INVALID;
+    }
+    if(it->second == NODE_ID_INVALID) {
+        *wait = true;
+    }
+    return it->second;
+}
+
+NodeControllerCommandPtr
+NodeControllerTraceReplayer::buildCommand(bool* wait) {
+    *wait = false;
+    if(next.type == NodeControllerCommand::Type::REVOKE_BATCH) {
+        std::vector<NodeID> node_ids;
+        for(NodeID recorded : next.nodeIds) {
+            NodeID node_id = mapNode(recorded, wait);
+            if(*wait) {
+                return nullptr;
+            }
+            if(node_id != NODE_ID_INVALID) {
+                node_ids.push_back(node_id);
+            }
+        }
+        if(node_ids.empty()) {
+            return nullptr;
+        }
+        return controller->newCommand<NodeControllerRevokeBatch>(
+                std::move(node_ids));
+    }
+
+    // allocations of roots have no node to map
+    NodeID node_id = NODE_ID_INVALID;
+    if(next.nodeId != NODE_ID_INVALID) {
+        node_id = mapNode(next.nodeId, wait);
+        if(node_id == NODE_ID_INVALID) {
+            return nullptr;
+        }
+    }
+    switch(next.type) {
+        case NodeControllerCommand::Type::ALLOCATE:
+            return controller->newCommand<NodeControllerAllocate>(node_id);
+        case NodeControllerCommand::Type::QUERY:
+            return controller->newCommand<NodeControllerQuery>(node_id);
+        case NodeControllerCommand::Type::RC_UPDATE:
+            return controller->newCommand<NodeControllerRcUpdate>(node_id,
+                    next.delta);
+        case NodeControllerCommand::Type::REVOKE:
+            return controller->newCommand<NodeControllerRevoke>(node_id);
+        default:
+            panic("unknown command type %d in node command trace\n",
+                    next.type);
+    }
+}
+
+void
+NodeControllerTraceReplayer::tryIssue() {
+    while(!traceDone && retryPkt == nullptr && outstanding < maxOutstanding &&
+            drainState() != DrainState::Draining) {
+        Tick when = respectTicks ? tickOffset + next.tick : curTick();
+        if(when > curTick()) {
+            reschedule(issueEvent, when, true);
+            return;
+        }
+
+        bool wait;
+        NodeControllerCommandPtr cmd = buildCommand(&wait);
+        if(wait) {
+            // the response of the allocation calls this again
+            ++ stats.mappingStalls;
+            return;
+        }
+        if(cmd == nullptr) {
+            ++ stats.skipped;
+            traceDone = !readNext();
+            continue;
+        }
+
+        PacketPtr pkt = packetPool.acquire(MemCmd::ReadReq, requestorId);
+        pkt->setRaw<NodeControllerCommandPtr>(cmd);
+        inFlight[pkt] = InFlight{curTick(), next.type, next.result};
+        if(next.type == NodeControllerCommand::Type::ALLOCATE &&
+                next.result != NODE_ID_INVALID) {
+            nodeMap[next.result] = NODE_ID_INVALID;
+        }
+        ++ outstanding;
+        ++ stats.issued;
+        if(!port.sendTimingReq(pkt)) {
+            retryPkt = pkt;
+        }
+        traceDone = !readNext();
+    }
+    checkDone();
+}
+
+void
+NodeControllerTraceReplayer::recvRetry() {
+    assert(retryPkt != nullptr);
+    if(port.sendTimingReq(retryPkt)) {
+        retryPkt = nullptr;
+        tryIssue();
+    }
+}
+
+void
+NodeControllerTraceReplayer::recvResp(PacketPtr pkt) {
+    auto it = inFlight.find(pkt);
+    panic_if(it == inFlight.end(), "%s received an unknown response\n",
+            name());
+    stats.latency.sample(curTick() - it->second.issued);
+    if(it->second.type == NodeControllerCommand::Type::ALLOCATE &&
+            it->second.recordedResult != NODE_ID_INVALID) {
+        nodeMap[it->second.recordedResult] = pkt->getRaw<NodeID>();
+    }
+    inFlight.erase(it);
+    packetPool.release(pkt);
+    -- outstanding;
+
+    if(drainState() == DrainState::Draining && outstanding == 0) {
+        signalDrainDone();
+        return;
+    }
+    tryIssue();
+}
+
+void
+NodeControllerTraceReplayer::checkDone() {
+    if(!traceDone || outstanding != 0) {
+        return;
+    }
+    stats.replayTicks = curTick() - startTick;
+    if(exitOnEnd) {
+        exitSimLoop("node command trace replay complete");
+    }
+}
+
+DrainState
+NodeControllerTraceReplayer::drain() {
+    return outstanding == 0 ? DrainState::Drained : DrainState::Draining;
+}
+
+void
+NodeControllerTraceReplayer::drainResume() {
+    if(!traceDone) {
+        tryIssue();
+    }
+}
+
+} // end of namespace gem5::RiscvcapstoneISA
@@ -0,0 +1,122 @@
+#ifndef NODE_TRACE_REPLAYER_H
+#define NODE_TRACE_REPLAYER_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "arch/riscvcapstone/node_controller.hh"
+#include "arch/riscvcapstone/node_packet_pool.hh"
+#include "base/statistics.hh"
+#include "mem/port.hh"
+#include "params/NodeControllerTraceReplayer.hh"
+#include "proto/protoio.hh"
+#include "sim/clocked_object.hh"
+#include "sim/eventq.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * Replays a command trace recorded by a node controller (trace_file) into
+ * another node controller, in the place of the CPUs, so that node cache
+ * and controller designs can be evaluated without the workload.
+ *
+ * Commands are issued in the order of the trace, each no earlier than its
+ * recorded tick (relative to the start of the replay) unless
+ * respect_ticks is false, with at most max_outstanding commands in
+ * flight. Allocations may return different nodes than in the recorded
+ * run (e.g., with another allocation policy), so the recorded node IDs
+ * are mapped to the replayed ones, and a command waits for the
+ * allocation of its nodes. Commands on nodes that were not allocated in
+ * the trace (the recording did not start with an empty controller) are
+ * skipped.
+ * */
+class NodeControllerTraceReplayer : public ClockedObject {
+    private:
+        class ReplayPort : public RequestPort {
+            private:
+                NodeControllerTraceReplayer* owner;
+
+            protected:
+                bool recvTimingResp(PacketPtr pkt) override;
+                void recvReqRetry() override;
+
+            public:
+                ReplayPort(NodeControllerTraceReplayer* owner);
+        };
+
+        struct TraceElement {
+            Tick tick;
+            NodeControllerCommand::Type type;
+            NodeID nodeId;
+            int delta;
+            NodeID result;
+            std::vector<NodeID> nodeIds;
+        };
+
+        struct ReplayStats : public statistics::Group {
+            ReplayStats(statistics::Group* parent);
+
+            statistics::Scalar issued;
+            statistics::Scalar skipped;
+            statistics::Scalar mappingStalls;
+            statistics::Histogram latency;
+            statistics::Scalar replayTicks;
+        } stats;
+
+        ReplayPort port;
+        System* system;
+        NodeController* controller;
+        ProtoInputStream trace;
+        const unsigned int maxOutstanding;
+        const bool respectTicks;
+        const bool exitOnEnd;
+
+        RequestorID requestorId;
+        NodePacketPool packetPool;
+
+        TraceElement next;
+        bool traceDone;
+        Tick tickOffset;
+        Tick startTick;
+        unsigned int outstanding;
+        PacketPtr retryPkt;
+
+        // recorded node ID -> replayed node ID, NODE_ID_INVALID while
+        // the allocation is in flight
+        std::unordered_map<NodeID, NodeID> nodeMap;
+        struct InFlight {
+            Tick issued;
+            NodeControllerCommand::Type type;
+            NodeID recordedResult; // for allocations
+        };
+        std::unordered_map<PacketPtr, InFlight> inFlight;
+
+        EventFunctionWrapper issueEvent;
+
+        bool readNext();
+        // the replayed node of a recorded one, NODE_ID_INVALID if it is
+        // unknown or still being allocated (then wait is set)
+        NodeID mapNode(NodeID recorded, bool* wait) const;
+        // the command for the next element, nullptr if it has to wait
+        // (wait is set) or be skipped
+        NodeControllerCommandPtr buildCommand(bool* wait);
+        void tryIssue();
+        void recvResp(PacketPtr pkt);
+        void recvRetry();
+        void checkDone();
+
+    public:
+        NodeControllerTraceReplayer(const NodeControllerTraceReplayerParams& p);
+
+        Port& getPort(const std::string& if_name,
+                PortID idx = InvalidPortID) override;
+
+        void init() override;
+        void startup() override;
+        DrainState drain() override;
+        void drainResume() override;
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
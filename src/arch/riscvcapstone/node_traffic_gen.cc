@@ -0,0 +1,324 @@
+#include "arch/riscvcapstone/node_traffic_gen.hh"
+
+#include <algorithm>
+#include <random>
+
+#include "sim/cur_tick.hh"
+#include "sim/sim_exit.hh"
+#include "sim/system.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+NodeControllerTrafficGen::GenStats::GenStats(statistics::Group* parent) :
+    statistics::Group(parent),
+    ADD_STAT(allocs, "Number of allocations issued"),
+    ADD_STAT(derivedAllocs, "Number of allocations with a parent"),
+    ADD_STAT(queries, "Number of queries issued"),
+    ADD_STAT(rcUpdates, "Number of rc updates issued"),
+    ADD_STAT(revokes, "Number of revocations issued"),
+    ADD_STAT(revokedSubtreeSize, "Number of live nodes in each revoked "
+            "subtree"),
+    ADD_STAT(allocLatency, "Ticks from sending an allocation to its response"),
+    ADD_STAT(queryLatency, "Ticks from sending a query to its response"),
+    ADD_STAT(rcUpdateLatency, "Ticks from sending an rc update to its "
+            "response"),
+    ADD_STAT(revokeLatency, "Ticks from sending a revocation to its "
+            "response"),
+    ADD_STAT(liveNodes, "Average number of live nodes"),
+    ADD_STAT(issueStalls, "Number of issue slots lost to max_outstanding "
+            "or a refused request"),
+    ADD_STAT(completed, "Number of commands completed"),
+    ADD_STAT(genCycles, "Cycles taken to complete num_commands commands"),
+    ADD_STAT(throughput, "Commands completed per cycle",
+            completed / genCycles)
+{
+    revokedSubtreeSize.init(16);
+    allocLatency.init(16);
+    queryLatency.init(16);
+    rcUpdateLatency.init(16);
+    revokeLatency.init(16);
+}
+
+NodeControllerTrafficGen::GenPort::GenPort(NodeControllerTrafficGen* owner) :
+    RequestPort(owner->name() + ".port", owner),
+    owner(owner) {
+}
+
+bool
+NodeControllerTrafficGen::GenPort::recvTimingResp(PacketPtr pkt) {
+    owner->recvResp(pkt);
+    return true;
+}
+
+void
+NodeControllerTrafficGen::GenPort::recvReqRetry() {
+    owner->recvRetry();
+}
+
+NodeControllerTrafficGen::NodeControllerTrafficGen(
+        const NodeControllerTrafficGenParams& p) :
+    ClockedObject(p),
+    stats(this),
+    port(this),
+    system(p.system),
+    controller(p.node_controller),
+    rng(p.seed),
+    cmdInterval(p.cmd_interval),
+    maxOutstanding(p.max_outstanding),
+    numCommands(p.num_commands),
+    allocWeight(p.alloc_weight),
+    queryWeight(p.query_weight),
+    rcUpdateWeight(p.rc_update_weight),
+    lifetime(p.lifetime),
+    lifetimeDist(p.lifetime_dist),
+    deriveFraction(p.derive_fraction),
+    fanOut(p.fan_out),
+    maxDepth(p.max_depth),
+    maxLive(p.max_live),
+    exitOnEnd(p.exit_on_end),
+    requestorId(0),
+    packetPool(this, "packetPool"),
+    cmdCount(0),
+    outstanding(0),
+    retryPkt(nullptr),
+    startTick(0),
+    issueEvent([this]{ issue(); }, name() + ".issue") {
+    fatal_if(maxOutstanding == 0, "max_outstanding must not be 0");
+    fatal_if(allocWeight == 0, "alloc_weight must not be 0");
+    fatal_if(lifetime == 0, "lifetime must not be 0");
+    fatal_if(deriveFraction < 0 || deriveFraction > 1,
+            "derive_fraction must be between 0 and 1");
+}
+
+Port&
+NodeControllerTrafficGen::getPort(const std::string& if_name, PortID idx) {
+    if(if_name == "port") {
+        return port;
+    }
+    return ClockedObject::getPort(if_name, idx);
+}
+
+void
+NodeControllerTrafficGen::init() {
+    ClockedObject::init();
+    fatal_if(!port.isConnected(), "%s: port is not connected\n", name());
+    requestorId = system->getRequestorId(this);
+}
+
+void
+NodeControllerTrafficGen::startup() {
+    fatal_if(!system->isTimingMode(),
+            "%s only supports the timing memory mode\n", name());
+    startTick = curTick();
+    scheduleIssue(clockEdge());
+}
+
+bool
+NodeControllerTrafficGen::done() const {
+    return numCommands != 0 && cmdCount >= numCommands;
+}
+
+uint64_t
+NodeControllerTrafficGen::sampleLifetime() {
+    switch(lifetimeDist) {
+        case enums::fixed:
+            return lifetime;
+        case enums::uniform:
+            return rng.random<uint64_t>(1, 2 * lifetime - 1);
+        default: {
+            std::exponential_distribution<double> dist(1.0 / lifetime);
+            return std::max<uint64_t>(1, (uint64_t)dist(rng.gen));
+        }
+    }
+}
+
+NodeID
+NodeControllerTrafficGen::randomLiveNode() {
+    return tree.liveAt(rng.random<size_t>(0, tree.size() - 1));
+}
+
+// forgets the node and its subtree, and drops their references
+void
+NodeControllerTrafficGen::killSubtree(NodeID node_id) {
+    unsigned int size = tree.kill(node_id,
+            [this](NodeID id, unsigned int refs) {
+        releases.emplace_back(id, -(int)(refs + 1));
+    });
+    stats.revokedSubtreeSize.sample(size);
+}
+
+NodeControllerCommandPtr
+NodeControllerTrafficGen::generate(InFlight* info) {
+    info->parent = NODE_ID_INVALID;
+    info->parentSerial = 0;
+
+    if(!releases.empty()) {
+        auto release = releases.front();
+        releases.pop_front();
+        info->type = NodeControllerCommand::Type::RC_UPDATE;
+        ++ stats.rcUpdates;
+        return controller->newCommand<NodeControllerRcUpdate>(
+                release.first, release.second);
+    }
+
+    while(!expiries.empty() && std::get<0>(expiries.top()) <= cmdCount) {
+        NodeID node_id = std::get<1>(expiries.top());
+        uint64_t serial = std::get<2>(expiries.top());
+        expiries.pop();
+        if(tree.find(node_id, serial) == nullptr) {
+            // revoked with an ancestor already
+            continue;
+        }
+        killSubtree(node_id);
+        info->type = NodeControllerCommand::Type::REVOKE;
+        ++ stats.revokes;
+        return controller->newCommand<NodeControllerRevoke>(node_id);
+    }
+
+    unsigned int pick = rng.random<unsigned int>(0,
+            allocWeight + queryWeight + rcUpdateWeight - 1);
+    if(tree.empty() || (pick < allocWeight && tree.size() < maxLive)) {
+        NodeID parent_id = NODE_ID_INVALID;
+        if(!tree.empty() && rng.random<double>() < deriveFraction) {
+            NodeID candidate = randomLiveNode();
+            NodeGenTree::GenNode& parent = *tree.find(candidate);
+            if(parent.depth < maxDepth && parent.children < fanOut) {
+                parent_id = candidate;
+                info->parentSerial = parent.serial;
+                ++ parent.children;
+                ++ stats.derivedAllocs;
+            }
+        }
+        info->type = NodeControllerCommand::Type::ALLOCATE;
+        info->parent = parent_id;
+        ++ stats.allocs;
+        return controller->newCommand<NodeControllerAllocate>(parent_id);
+    }
+
+    NodeID node_id = randomLiveNode();
+    if(pick < allocWeight + queryWeight) {
+        info->type = NodeControllerCommand::Type::QUERY;
+        ++ stats.queries;
+        return controller->newCommand<NodeControllerQuery>(node_id);
+    }
+
+    // a capability copied or dropped
+    NodeGenTree::GenNode& node = *tree.find(node_id);
+    int delta = 1;
+    if(node.refs > 0 && rng.random<unsigned int>(0, 1) == 0) {
+        delta = -1;
+    }
+    node.refs += delta;
+    info->type = NodeControllerCommand::Type::RC_UPDATE;
+    ++ stats.rcUpdates;
+    return controller->newCommand<NodeControllerRcUpdate>(node_id, delta);
+}
+
+void
+NodeControllerTrafficGen::scheduleIssue(Tick when) {
+    if(!issueEvent.scheduled() && !done() &&
+            drainState() != DrainState::Draining) {
+        schedule(issueEvent, when);
+    }
+}
+
+void
+NodeControllerTrafficGen::issue() {
+    if(retryPkt != nullptr || outstanding >= maxOutstanding) {
+        // resumed by the next response or retry
+        ++ stats.issueStalls;
+        return;
+    }
+
+    InFlight info;
+    info.issued = curTick();
+    NodeControllerCommandPtr cmd = generate(&info);
+    ++ cmdCount;
+    stats.liveNodes = tree.size();
+
+    PacketPtr pkt = packetPool.acquire(MemCmd::ReadReq, requestorId);
+    pkt->setRaw<NodeControllerCommandPtr>(cmd);
+    inFlight[pkt] = info;
+    ++ outstanding;
+    if(!port.sendTimingReq(pkt)) {
+        retryPkt = pkt;
+    }
+
+    scheduleIssue(clockEdge(cmdInterval));
+}
+
+void
+NodeControllerTrafficGen::recvRetry() {
+    assert(retryPkt != nullptr);
+    if(port.sendTimingReq(retryPkt)) {
+        retryPkt = nullptr;
+        scheduleIssue(clockEdge());
+    }
+}
+
+void
+NodeControllerTrafficGen::recvResp(PacketPtr pkt) {
+    auto it = inFlight.find(pkt);
+    panic_if(it == inFlight.end(), "%s received an unknown response\n",
+            name());
+    const InFlight& info = it->second;
+    Tick latency = curTick() - info.issued;
+    switch(info.type) {
+        case NodeControllerCommand::Type::ALLOCATE: {
+            stats.allocLatency.sample(latency);
+            NodeID node_id = pkt->getRaw<NodeID>();
+            if(info.parent != NODE_ID_INVALID &&
+                    tree.find(info.parent, info.parentSerial) == nullptr) {
+                // the parent was revoked meanwhile, and the new node
+                // with it
+                releases.emplace_back(node_id, -1);
+                break;
+            }
+            uint64_t serial = tree.add(node_id, info.parent);
+            expiries.emplace(cmdCount + sampleLifetime(), node_id, serial);
+            break;
+        }
+        case NodeControllerCommand::Type::QUERY:
+            stats.queryLatency.sample(latency);
+            break;
+        case NodeControllerCommand::Type::RC_UPDATE:
+            stats.rcUpdateLatency.sample(latency);
+            break;
+        default:
+            stats.revokeLatency.sample(latency);
+    }
+    inFlight.erase(it);
+    packetPool.release(pkt);
+    -- outstanding;
+    ++ stats.completed;
+
+    if(outstanding == 0 && drainState() == DrainState::Draining) {
+        signalDrainDone();
+        return;
+    }
+    if(done()) {
+        if(outstanding == 0) {
+            stats.genCycles = ticksToCycles(curTick() - startTick);
+            if(exitOnEnd) {
+                exitSimLoop("node controller traffic generation complete");
+            }
+        }
+        return;
+    }
+    scheduleIssue(clockEdge());
+}
+
+DrainState
+NodeControllerTrafficGen::drain() {
+    if(issueEvent.scheduled()) {
+        deschedule(issueEvent);
+    }
+    return outstanding == 0 ? DrainState::Drained : DrainState::Draining;
+}
+
+void
+NodeControllerTrafficGen::drainResume() {
+    scheduleIssue(clockEdge());
+}
+
+} // end of namespace gem5::RiscvcapstoneISA
@@ -0,0 +1,146 @@
+#ifndef NODE_TRAFFIC_GEN_H
+#define NODE_TRAFFIC_GEN_H
+
+#include <deque>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arch/riscvcapstone/node_controller.hh"
+#include "arch/riscvcapstone/node_gen_tree.hh"
+#include "arch/riscvcapstone/node_packet_pool.hh"
+#include "base/random.hh"
+#include "base/statistics.hh"
+#include "enums/NodeGenLifetime.hh"
+#include "mem/port.hh"
+#include "params/NodeControllerTrafficGen.hh"
+#include "sim/clocked_object.hh"
+#include "sim/eventq.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * Synthetic workload for a node controller, in the place of the CPUs.
+ * Every cmd_interval cycles (as long as fewer than max_outstanding
+ * commands are in flight), the generator issues one command:
+ *
+ * - the rc updates that drop the references to revoked nodes, first;
+ * - a revocation of a node whose lifetime (counted in commands) is over,
+ *   which takes its whole subtree along;
+ * - otherwise an allocation, a query or an rc update on a random live
+ *   node, picked with the given weights. An allocation derives from a
+ *   live node with probability derive_fraction, within the fan_out and
+ *   max_depth limits, so derive_fraction, fan_out and max_depth shape
+ *   the subtrees revocations walk.
+ *
+ * Revoked nodes get their counts back to 0 through the rc updates, so
+ * they are freed and reused and the generator can run indefinitely. The
+ * random choices are seeded, so runs are repeatable.
+ * */
+class NodeControllerTrafficGen : public ClockedObject {
+    private:
+        class GenPort : public RequestPort {
+            private:
+                NodeControllerTrafficGen* owner;
+
+            protected:
+                bool recvTimingResp(PacketPtr pkt) override;
+                void recvReqRetry() override;
+
+            public:
+                GenPort(NodeControllerTrafficGen* owner);
+        };
+
+        struct GenStats : public statistics::Group {
+            GenStats(statistics::Group* parent);
+
+            statistics::Scalar allocs;
+            statistics::Scalar derivedAllocs;
+            statistics::Scalar queries;
+            statistics::Scalar rcUpdates;
+            statistics::Scalar revokes;
+            statistics::Histogram revokedSubtreeSize;
+            statistics::Histogram allocLatency;
+            statistics::Histogram queryLatency;
+            statistics::Histogram rcUpdateLatency;
+            statistics::Histogram revokeLatency;
+            statistics::Average liveNodes;
+            statistics::Scalar issueStalls;
+            statistics::Scalar completed;
+            statistics::Scalar genCycles;
+            statistics::Formula throughput;
+        } stats;
+
+        struct InFlight {
+            Tick issued;
+            NodeControllerCommand::Type type;
+            NodeID parent; // for allocations
+            uint64_t parentSerial;
+        };
+
+        // (command count, node, serial), earliest first
+        typedef std::tuple<uint64_t, NodeID, uint64_t> Expiry;
+
+        GenPort port;
+        System* system;
+        NodeController* controller;
+        Random rng;
+
+        const Cycles cmdInterval;
+        const unsigned int maxOutstanding;
+        const uint64_t numCommands;
+        const unsigned int allocWeight;
+        const unsigned int queryWeight;
+        const unsigned int rcUpdateWeight;
+        const uint64_t lifetime;
+        const enums::NodeGenLifetime lifetimeDist;
+        const double deriveFraction;
+        const unsigned int fanOut;
+        const unsigned int maxDepth;
+        const size_t maxLive;
+        const bool exitOnEnd;
+
+        RequestorID requestorId;
+        NodePacketPool packetPool;
+
+        NodeGenTree tree;
+        std::priority_queue<Expiry, std::vector<Expiry>,
+            std::greater<Expiry>> expiries;
+        std::deque<std::pair<NodeID, int>> releases;
+
+        uint64_t cmdCount; // commands generated
+        unsigned int outstanding;
+        std::unordered_map<PacketPtr, InFlight> inFlight;
+        PacketPtr retryPkt;
+        Tick startTick;
+
+        EventFunctionWrapper issueEvent;
+
+        uint64_t sampleLifetime();
+        NodeID randomLiveNode();
+        void killSubtree(NodeID node_id);
+        NodeControllerCommandPtr generate(InFlight* info);
+        void issue();
+        void scheduleIssue(Tick when);
+        void recvResp(PacketPtr pkt);
+        void recvRetry();
+        bool done() const;
+
+    public:
+        NodeControllerTrafficGen(const NodeControllerTrafficGenParams& p);
+
+        Port& getPort(const std::string& if_name,
+                PortID idx = InvalidPortID) override;
+
+        void init() override;
+        void startup() override;
+        DrainState drain() override;
+        void drainResume() override;
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
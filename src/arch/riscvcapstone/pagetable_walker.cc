@@ -73,13 +73,23 @@ Fault
 Walker::start(ThreadContext * _tc, BaseMMU::Translation *_translation,
               const RequestPtr &_req, BaseMMU::Mode _mode)
 {
-    // TODO: in timing mode, instead of blocking when there are other
-    // outstanding requests, see if this request can be coalesced with
-    // another one (i.e. either coalesce or start walk)
     WalkerState * newState = new WalkerState(this, _translation, _req);
     newState->initState(_tc, _mode, sys->isTimingMode());
+    newState->startTick = curTick();
+    stats.walks++;
     if (currStates.size()) {
         assert(newState->isTiming());
+        if (coalesceWalks) {
+            for (WalkerState *walk : currStates) {
+                if (!walk->squashed && walk->canCoalesce(*newState)) {
+                    DPRINTF(PageTableWalker, "Coalescing walk for %#x\n",
+                            _req->getVaddr());
+                    walk->coalesced.push_back(newState);
+                    stats.coalescedWalks++;
+                    return NoFault;
+                }
+            }
+        }
         DPRINTF(PageTableWalker, "Walks in progress: %d\n", currStates.size());
         currStates.push_back(newState);
         return NoFault;
@@ -208,6 +218,15 @@ Walker::startWalkWrapper()
         DPRINTF(PageTableWalker, "Squashing table walk for address %#x\n",
             currState->req->getVaddr());
 
+        // the walks coalesced with it still have to be done
+        if (!currState->coalesced.empty()) {
+            WalkerState *heir = currState->coalesced.front();
+            heir->coalesced.assign(currState->coalesced.begin() + 1,
+                                   currState->coalesced.end());
+            currState->coalesced.clear();
+            currStates.push_front(heir);
+        }
+
         // finish the translation which will delete the translation object
         currState->translation->finish(
             std::make_shared<UnimpFault>("Squashed Inst"),
@@ -261,6 +280,52 @@ Walker::WalkerState::startWalk()
     return fault;
 }
 
+Addr
+Walker::pwcKey(Addr rootPpn, int level, Addr vaddr)
+{
+    // the VPN bits translated by the levels above the next table
+    Addr shift = PageShift + LEVEL_BITS * level;
+    Addr prefix = bits(vaddr, VADDR_BITS - 1, shift);
+    return (rootPpn << 20) | (prefix << 2) | level;
+}
+
+bool
+Walker::pwcLookup(Addr key, Addr &ppn)
+{
+    auto it = pwc.find(key);
+    if (it == pwc.end())
+        return false;
+    pwcLru.splice(pwcLru.begin(), pwcLru, it->second.lruPos);
+    ppn = it->second.ppn;
+    return true;
+}
+
+void
+Walker::pwcInsert(Addr key, Addr ppn)
+{
+    if (pwcEntries == 0)
+        return;
+    auto it = pwc.find(key);
+    if (it != pwc.end()) {
+        it->second.ppn = ppn;
+        pwcLru.splice(pwcLru.begin(), pwcLru, it->second.lruPos);
+        return;
+    }
+    if (pwc.size() >= pwcEntries) {
+        pwc.erase(pwcLru.back());
+        pwcLru.pop_back();
+    }
+    pwcLru.push_front(key);
+    pwc[key] = PwcEntry{ppn, pwcLru.begin()};
+}
+
+void
+Walker::flushWalkCache()
+{
+    pwc.clear();
+    pwcLru.clear();
+}
+
 Fault
 Walker::WalkerState::startFunctional(Addr &addr, unsigned &logBytes)
 {
@@ -379,6 +444,11 @@ Walker::WalkerState::stepWalk(PacketPtr &write)
                     Addr idx = (entry.vaddr >> shift) & LEVEL_MASK;
                     nextRead = (pte.ppn << PageShift) + (idx * sizeof(pte));
                     nextState = Translate;
+                    if (!functional) {
+                        walker->pwcInsert(
+                            pwcKey(satp.ppn, level + 1, entry.vaddr),
+                            pte.ppn);
+                    }
                 }
             }
         }
@@ -423,6 +493,8 @@ Walker::WalkerState::stepWalk(PacketPtr &write)
 
         read = new Packet(request, MemCmd::ReadReq);
         read->allocate();
+        if (!functional)
+            walker->stats.pteReads++;
 
         DPRINTF(PageTableWalker,
                 "Loading level%d PTE from %#x\n", level, nextRead);
@@ -449,6 +521,22 @@ Walker::WalkerState::setupWalk(Addr vaddr)
     Addr topAddr = (satp.ppn << PageShift) + (idx * sizeof(PTESv39));
     level = 2;
 
+    // start from the deepest table in the page walk cache
+    if (!functional && walker->pwcEntries != 0) {
+        walker->stats.pwcLookups++;
+        for (int l = 1; l <= 2; l++) {
+            Addr ppn;
+            if (walker->pwcLookup(pwcKey(satp.ppn, l, vaddr), ppn)) {
+                walker->stats.pwcHits++;
+                level = l - 1;
+                Addr shift = PageShift + LEVEL_BITS * level;
+                idx = (vaddr >> shift) & LEVEL_MASK;
+                topAddr = (ppn << PageShift) + (idx * sizeof(PTESv39));
+                break;
+            }
+        }
+    }
+
     DPRINTF(PageTableWalker, "Performing table walk for address %#x\n", vaddr);
     DPRINTF(PageTableWalker, "Loading level%d PTE from %#x\n", level, topAddr);
 
@@ -463,6 +551,8 @@ Walker::WalkerState::setupWalk(Addr vaddr)
 
     read = new Packet(request, MemCmd::ReadReq);
     read->allocate();
+    if (!functional)
+        walker->stats.pteReads++;
 }
 
 bool
@@ -527,6 +617,13 @@ Walker::WalkerState::recvPacket(PacketPtr pkt)
             // There was a fault during the walk. Let the CPU know.
             translation->finish(timingFault, req, tc, mode);
         }
+        walker->stats.walkLatency.sample(curTick() - startTick);
+
+        for (WalkerState *follower : coalesced) {
+            follower->finishCoalesced(timingFault);
+            delete follower;
+        }
+        coalesced.clear();
         return true;
     }
 
@@ -596,6 +693,34 @@ Walker::WalkerState::squash()
     squashed = true;
 }
 
+bool
+Walker::WalkerState::canCoalesce(const WalkerState &other) const
+{
+    // the same translation, up to the page offset
+    return tc == other.tc && mode == other.mode &&
+        (RegVal)satp == (RegVal)other.satp &&
+        (RegVal)status == (RegVal)other.status && pmode == other.pmode &&
+        (sext<VADDR_BITS>(req->getVaddr()) >> PageShift) ==
+        (sext<VADDR_BITS>(other.req->getVaddr()) >> PageShift);
+}
+
+void
+Walker::WalkerState::finishCoalesced(Fault leaderFault)
+{
+    Fault fault = NoFault;
+    Addr vaddr = Addr(sext<VADDR_BITS>(req->getVaddr()));
+    if (translation->squashed()) {
+        fault = std::make_shared<UnimpFault>("Squashed Inst");
+    } else if (leaderFault != NoFault) {
+        // the walk of the same page faulted for this address as well
+        fault = walker->tlb->createPagefault(vaddr, mode);
+    } else {
+        req->setPaddr(walker->tlb->translateWithTLB(vaddr, satp.asid, mode));
+    }
+    walker->stats.walkLatency.sample(curTick() - startTick);
+    translation->finish(fault, req, tc, mode);
+}
+
 void
 Walker::WalkerState::retry()
 {
@@ -610,5 +735,25 @@ Walker::WalkerState::pageFault(bool present)
     return walker->tlb->createPagefault(entry.vaddr, mode);
 }
 
+Walker::WalkerStats::WalkerStats(statistics::Group *parent)
+  : statistics::Group(parent),
+    ADD_STAT(walks, statistics::units::Count::get(),
+             "page table walks requested"),
+    ADD_STAT(coalescedWalks, statistics::units::Count::get(),
+             "walks served by another walk of the same page"),
+    ADD_STAT(pteReads, statistics::units::Count::get(),
+             "PTEs read from memory"),
+    ADD_STAT(pwcLookups, statistics::units::Count::get(),
+             "page walk cache lookups"),
+    ADD_STAT(pwcHits, statistics::units::Count::get(),
+             "page walk cache hits"),
+    ADD_STAT(pwcHitRate, statistics::units::Ratio::get(),
+             "page walk cache hit rate", pwcHits / pwcLookups),
+    ADD_STAT(walkLatency, statistics::units::Tick::get(),
+             "ticks from a walk request to its translation (timing only)")
+{
+    walkLatency.init(16);
+}
+
 } // namespace RiscvcapstoneISA
 } // namespace gem5
@@ -39,6 +39,8 @@
 #ifndef __ARCH_RISCV_TABLE_WALKER_HH__
 #define __ARCH_RISCV_TABLE_WALKER_HH__
 
+#include <list>
+#include <unordered_map>
 #include <vector>
 
 #include "arch/generic/mmu.hh"
@@ -46,6 +48,7 @@
 #include "arch/riscvcapstone/pma_checker.hh"
 #include "arch/riscvcapstone/pmp.hh"
 #include "arch/riscvcapstone/tlb.hh"
+#include "base/statistics.hh"
 #include "base/types.hh"
 #include "mem/packet.hh"
 #include "params/RiscvPagetableWalker.hh"
@@ -115,6 +118,9 @@ namespace RiscvcapstoneISA
             bool retrying;
             bool started;
             bool squashed;
+            Tick startTick;
+            // walks to the same page waiting for this one
+            std::vector<WalkerState *> coalesced;
           public:
             WalkerState(Walker * _walker, BaseMMU::Translation *_translation,
                         const RequestPtr &_req, bool _isFunctional = false) :
@@ -122,7 +128,8 @@ namespace RiscvcapstoneISA
                 nextState(Ready), level(0), inflight(0),
                 translation(_translation),
                 functional(_isFunctional), timing(false),
-                retrying(false), started(false), squashed(false)
+                retrying(false), started(false), squashed(false),
+                startTick(0)
             {
             }
             void initState(ThreadContext * _tc, BaseMMU::Mode _mode,
@@ -136,6 +143,7 @@ namespace RiscvcapstoneISA
             bool isTiming();
             void retry();
             void squash();
+            bool canCoalesce(const WalkerState &other) const;
             std::string name() const {return walker->name();}
 
           private:
@@ -143,6 +151,7 @@ namespace RiscvcapstoneISA
             Fault stepWalk(PacketPtr &write);
             void sendPackets();
             void endWalk();
+            void finishCoalesced(Fault leaderFault);
             Fault pageFault(bool present);
         };
 
@@ -178,6 +187,41 @@ namespace RiscvcapstoneISA
         // The number of outstanding walks that can be squashed per cycle.
         unsigned numSquashable;
 
+        // Whether walks to a page already being walked wait for that walk
+        // instead of walking again.
+        bool coalesceWalks;
+
+        /**
+         * Page walk cache: the non-leaf PTEs of recent walks, by root
+         * table, level and VPN prefix, so that walks can start below the
+         * root. Fully associative with LRU replacement.
+         */
+        unsigned pwcEntries;
+        std::list<Addr> pwcLru; // most recently used first
+        struct PwcEntry
+        {
+            Addr ppn; // of the next level table
+            std::list<Addr>::iterator lruPos;
+        };
+        std::unordered_map<Addr, PwcEntry> pwc;
+
+        static Addr pwcKey(Addr rootPpn, int level, Addr vaddr);
+        bool pwcLookup(Addr key, Addr &ppn);
+        void pwcInsert(Addr key, Addr ppn);
+
+        struct WalkerStats : public statistics::Group
+        {
+            WalkerStats(statistics::Group *parent);
+
+            statistics::Scalar walks;
+            statistics::Scalar coalescedWalks;
+            statistics::Scalar pteReads;
+            statistics::Scalar pwcLookups;
+            statistics::Scalar pwcHits;
+            statistics::Formula pwcHitRate;
+            statistics::Histogram walkLatency;
+        } stats;
+
         // Wrapper for checking for squashes before starting a translation.
         void startWalkWrapper();
 
@@ -198,6 +242,9 @@ namespace RiscvcapstoneISA
             tlb = _tlb;
         }
 
+        // Drop the cached non-leaf PTEs (on SFENCE.VMA).
+        void flushWalkCache();
+
         using Params = RiscvPagetableWalkerParams;
 
         Walker(const Params &params) :
@@ -205,6 +252,9 @@ namespace RiscvcapstoneISA
             funcState(this, NULL, NULL, true), tlb(NULL), sys(params.system),
             requestorId(sys->getRequestorId(this)),
             numSquashable(params.num_squash_per_cycle),
+            coalesceWalks(params.coalesce_walks),
+            pwcEntries(params.pwc_entries),
+            stats(this),
             startWalkWrapperEvent([this]{ startWalkWrapper(); }, name())
         {
         }
@@ -51,6 +51,20 @@ PMAChecker::PMAChecker(const Params &params) :
 SimObject(params),
 uncacheable(params.uncacheable.begin(), params.uncacheable.end())
 {
+    buildUncacheableMap();
+}
+
+void
+PMAChecker::buildUncacheableMap()
+{
+    uncacheableMap.clear();
+    uncacheableOverlaps.clear();
+    for (auto const &uncacheable_range: uncacheable) {
+        if (uncacheableMap.insert(uncacheable_range, true) ==
+                uncacheableMap.end()) {
+            uncacheableOverlaps.push_back(uncacheable_range);
+        }
+    }
 }
 
 void
@@ -64,7 +78,10 @@ PMAChecker::check(const RequestPtr &req)
 bool
 PMAChecker::isUncacheable(const AddrRange &range)
 {
-    for (auto const &uncacheable_range: uncacheable) {
+    if (uncacheableMap.contains(range) != uncacheableMap.end()) {
+        return true;
+    }
+    for (auto const &uncacheable_range: uncacheableOverlaps) {
         if (range.isSubset(uncacheable_range)) {
             return true;
         }
@@ -89,6 +106,7 @@ void
 PMAChecker::takeOverFrom(PMAChecker *old)
 {
     uncacheable = old->uncacheable;
+    buildUncacheableMap();
 }
 
 } // namespace gem5
@@ -39,6 +39,7 @@
 #define __ARCH_RISCV_PMA_CHECKER_HH__
 
 #include "base/addr_range.hh"
+#include "base/addr_range_map.hh"
 #include "base/types.hh"
 #include "mem/packet.hh"
 #include "params/PMAChecker.hh"
@@ -79,6 +80,17 @@ class PMAChecker : public SimObject
     bool isUncacheable(PacketPtr pkt);
 
     void takeOverFrom(PMAChecker *old);
+
+  private:
+    /**
+     * The uncacheable ranges for lookups, with the last hit cached.
+     * Ranges that overlap ones already in the map are kept aside and
+     * searched linearly.
+     */
+    AddrRangeMap<bool, 1> uncacheableMap;
+    AddrRangeList uncacheableOverlaps;
+
+    void buildUncacheableMap();
 };
 
 } // namespace gem5
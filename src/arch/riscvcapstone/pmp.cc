@@ -28,6 +28,8 @@
 
 #include "arch/riscvcapstone/pmp.hh"
 
+#include <algorithm>
+
 #include "arch/generic/tlb.hh"
 #include "arch/riscvcapstone/faults.hh"
 #include "arch/riscvcapstone/isa.hh"
@@ -50,6 +52,7 @@ PMP::PMP(const Params &params) :
     numRules(0)
 {
     pmpTable.resize(pmpEntries);
+    pmpBuildRegions();
 }
 
 Fault
@@ -78,43 +81,30 @@ PMP::pmpCheck(const RequestPtr &req, BaseMMU::Mode mode,
 
     // match_index will be used to identify the pmp entry
     // which matched for the given address
-    int match_index = -1;
-
-    // all pmp entries need to be looked from the lowest to
-    // the highest number
-    for (int i = 0; i < pmpTable.size(); i++) {
-        AddrRange pmp_range = pmpTable[i].pmpAddr;
-        if (pmp_range.contains(req->getPaddr()) &&
-                pmp_range.contains(req->getPaddr() + req->getSize())) {
-            // according to specs address is only matched,
-            // when (addr) and (addr + request_size) are both
-            // within the pmp range
-            match_index = i;
-        }
-
-        if ((match_index > -1)
-            && (PMP_OFF != pmpGetAField(pmpTable[match_index].pmpCfg))) {
-            // check the RWX permissions from the pmp entry
-            uint8_t allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-
-            // i is the index of pmp table which matched
-            allowed_privs &= pmpTable[match_index].pmpCfg;
-
-            if ((mode == BaseMMU::Mode::Read) &&
-                                        (PMP_READ & allowed_privs)) {
-                return NoFault;
-            } else if ((mode == BaseMMU::Mode::Write) &&
-                                        (PMP_WRITE & allowed_privs)) {
-                return NoFault;
-            } else if ((mode == BaseMMU::Mode::Execute) &&
-                                        (PMP_EXEC & allowed_privs)) {
-                return NoFault;
+    int match_index = pmpMatch(req->getPaddr(), req->getSize(), mode);
+
+    if ((match_index > -1)
+        && (PMP_OFF != pmpGetAField(pmpTable[match_index].pmpCfg))) {
+        // check the RWX permissions from the pmp entry
+        uint8_t allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+
+        // match_index is the index of pmp table which matched
+        allowed_privs &= pmpTable[match_index].pmpCfg;
+
+        if ((mode == BaseMMU::Mode::Read) &&
+                                    (PMP_READ & allowed_privs)) {
+            return NoFault;
+        } else if ((mode == BaseMMU::Mode::Write) &&
+                                    (PMP_WRITE & allowed_privs)) {
+            return NoFault;
+        } else if ((mode == BaseMMU::Mode::Execute) &&
+                                    (PMP_EXEC & allowed_privs)) {
+            return NoFault;
+        } else {
+            if (req->hasVaddr()) {
+                return createAddrfault(req->getVaddr(), mode);
             } else {
-                if (req->hasVaddr()) {
-                    return createAddrfault(req->getVaddr(), mode);
-                } else {
-                    return createAddrfault(vaddr, mode);
-                }
+                return createAddrfault(vaddr, mode);
             }
         }
     }
@@ -126,6 +116,86 @@ PMP::pmpCheck(const RequestPtr &req, BaseMMU::Mode mode,
     }
 }
 
+int
+PMP::pmpMatch(Addr addr, Addr size, BaseMMU::Mode mode)
+{
+    // according to specs address is only matched,
+    // when (addr) and (addr + request_size) are both
+    // within the pmp range
+    auto covers = [&](const PmpRegion &region) {
+        return addr >= region.start && addr < region.end;
+    };
+    auto matches = [&](int index) {
+        const AddrRange &pmp_range = pmpTable[index].pmpAddr;
+        return pmp_range.contains(addr) && pmp_range.contains(addr + size);
+    };
+
+    int &last = lastRegion[mode];
+    if (last < 0 || !covers(pmpRegions[last])) {
+        auto it = std::upper_bound(pmpRegions.begin(), pmpRegions.end(),
+                addr, [](Addr a, const PmpRegion &region) {
+                    return a < region.start;
+                });
+        if (it == pmpRegions.begin() || !covers(*(it - 1))) {
+            return -1;
+        }
+        last = it - 1 - pmpRegions.begin();
+    }
+
+    // The entry of the region is the lowest numbered one covering addr,
+    // so it wins if it also covers the end of the access.
+    int index = pmpRegions[last].index;
+    if (matches(index))
+        return index;
+
+    // The access crosses the end of the range, a higher numbered entry
+    // may still cover all of it.
+    for (int i = index + 1; i < pmpTable.size(); i++) {
+        if (matches(i))
+            return i;
+    }
+    return -1;
+}
+
+void
+PMP::pmpBuildRegions()
+{
+    std::vector<Addr> bounds;
+    for (const PmpEntry &pmp_entry : pmpTable) {
+        const AddrRange &pmp_range = pmp_entry.pmpAddr;
+        if (pmp_range.valid() && pmp_range.size() != 0) {
+            bounds.push_back(pmp_range.start());
+            bounds.push_back(pmp_range.end());
+        }
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    // every range starts and ends at a bound, so the same entries cover
+    // all of the space between two bounds
+    pmpRegions.clear();
+    for (size_t b = 0; b + 1 < bounds.size(); b++) {
+        int index = -1;
+        for (int i = 0; i < pmpTable.size(); i++) {
+            if (pmpTable[i].pmpAddr.contains(bounds[b])) {
+                index = i;
+                break;
+            }
+        }
+        if (index < 0)
+            continue;
+        if (!pmpRegions.empty() && pmpRegions.back().index == index &&
+                pmpRegions.back().end == bounds[b]) {
+            pmpRegions.back().end = bounds[b + 1];
+        } else {
+            pmpRegions.push_back(PmpRegion{bounds[b], bounds[b + 1], index});
+        }
+    }
+
+    for (int &last : lastRegion)
+        last = -1;
+}
+
 Fault
 PMP::createAddrfault(Addr vaddr, BaseMMU::Mode mode)
 {
@@ -160,6 +230,7 @@ PMP::pmpUpdateCfg(uint32_t pmp_index, uint8_t this_cfg)
 
     pmpTable[pmp_index].pmpCfg = this_cfg;
     pmpUpdateRule(pmp_index);
+    pmpBuildRegions();
 
 }
 
@@ -225,6 +296,7 @@ PMP::pmpUpdateAddr(uint32_t pmp_index, Addr this_addr)
     for (int index = 0; index < pmpEntries; index++) {
         pmpUpdateRule(index);
     }
+    pmpBuildRegions();
 }
 
 bool
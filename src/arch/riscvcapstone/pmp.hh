@@ -105,6 +105,26 @@ class PMP : public SimObject
     /** a table of pmp entries */
     std::vector<PmpEntry> pmpTable;
 
+    /** a part of the address space where the same pmp entry matches */
+    struct PmpRegion
+    {
+        Addr start;
+        /** exclusive */
+        Addr end;
+        /** the lowest numbered entry whose range covers the region */
+        int index;
+    };
+
+    /**
+     * The address ranges of all entries, flattened into sorted,
+     * non-overlapping regions. Addresses out of the regions match no
+     * entry. Rebuilt whenever pmpaddr or pmpcfg is written.
+     */
+    std::vector<PmpRegion> pmpRegions;
+
+    /** the region of the last match, per access mode (-1 for none) */
+    int lastRegion[BaseMMU::Execute + 1];
+
   public:
     /**
      * pmpCheck checks if a particular memory access
@@ -172,6 +192,23 @@ class PMP : public SimObject
      */
     void pmpUpdateRule(uint32_t pmp_index);
 
+    /**
+     * pmpBuildRegions flattens the ranges of the pmp
+     * table into pmpRegions.
+     */
+    void pmpBuildRegions();
+
+    /**
+     * pmpMatch finds the pmp entry that matches an access,
+     * i.e., the lowest numbered one that covers both addr
+     * and addr + size.
+     * @param addr physical address of the access.
+     * @param size size of the access.
+     * @param mode mode of access(read, write, execute).
+     * @return index of the entry, -1 if none matches.
+     */
+    int pmpMatch(Addr addr, Addr size, BaseMMU::Mode mode);
+
     /**
      * pmpGetAField extracts the A field (address matching mode)
      * from an input pmpcfg register
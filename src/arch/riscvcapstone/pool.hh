@@ -0,0 +1,78 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * A free list of storage for objects of type T. Released objects are
+ * destroyed but their storage is kept and reused by later acquire() calls,
+ * so that steady-state simulation does not go through the heap allocator.
+ *
+ * Not thread-safe: each pool belongs to a single SimObject.
+ * */
+template<typename T>
+class ObjectPool {
+    private:
+        std::vector<void*> freeList;
+        size_t allocated; // storage blocks obtained from the heap
+        size_t inUse;
+
+    public:
+        ObjectPool() : allocated(0), inUse(0) {}
+
+        ObjectPool(const ObjectPool&) = delete;
+        ObjectPool& operator=(const ObjectPool&) = delete;
+
+        ~ObjectPool() {
+            for(void* p : freeList) {
+                ::operator delete(p);
+            }
+        }
+
+        template<typename... Args>
+        T*
+        acquire(Args&&... args) {
+            void* p;
+            if(freeList.empty()) {
+                p = ::operator new(sizeof(T));
+                ++ allocated;
+            } else{
+                p = freeList.back();
+                freeList.pop_back();
+            }
+            ++ inUse;
+            return new (p) T(std::forward<Args>(args)...);
+        }
+
+        void
+        release(T* obj) {
+            obj->~T();
+            freeList.push_back(obj);
+            -- inUse;
+        }
+
+        size_t
+        allocatedCount() const {
+            return allocated;
+        }
+
+        size_t
+        inUseCount() const {
+            return inUse;
+        }
+
+        // number of released objects whose storage can be reused
+        size_t
+        freeCount() const {
+            return freeList.size();
+        }
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include "arch/riscvcapstone/pool.hh"
+
+using namespace gem5::RiscvcapstoneISA;
+
+namespace {
+
+struct Counted {
+    static int live;
+    int value;
+    Counted(int value) : value(value) { ++live; }
+    ~Counted() { --live; }
+};
+
+int Counted::live = 0;
+
+} // anonymous namespace
+
+TEST(ObjectPoolTest, ReusesStorage)
+{
+    ObjectPool<Counted> pool;
+    Counted* a = pool.acquire(1);
+    EXPECT_EQ(a->value, 1);
+    EXPECT_EQ(Counted::live, 1);
+    EXPECT_EQ(pool.inUseCount(), 1);
+
+    pool.release(a);
+    EXPECT_EQ(Counted::live, 0);
+    EXPECT_EQ(pool.inUseCount(), 0);
+
+    Counted* b = pool.acquire(2);
+    EXPECT_EQ(b, a);
+    EXPECT_EQ(b->value, 2);
+    EXPECT_EQ(pool.allocatedCount(), 1);
+
+    Counted* c = pool.acquire(3);
+    EXPECT_NE(c, b);
+    EXPECT_EQ(pool.allocatedCount(), 2);
+    EXPECT_EQ(pool.inUseCount(), 2);
+
+    pool.release(b);
+    pool.release(c);
+    EXPECT_EQ(Counted::live, 0);
+}
@@ -0,0 +1,155 @@
+#ifndef PREDECODE_CACHE_H
+#define PREDECODE_CACHE_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "base/types.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * Blocks of consecutive decoded instructions, keyed by the physical
+ * address of their first instruction, so that a CPU can run through a
+ * block without fetching and decoding each instruction again.
+ *
+ * A block never spans two pages, which lets a store drop the blocks of
+ * the pages it writes to. Blocks may overlap (a jump into the middle of
+ * a block starts another one). When max_blocks is reached, everything is
+ * dropped at once.
+ *
+ * Pointers to blocks stay valid until the generation changes, which
+ * happens whenever a block is dropped.
+ * */
+template<typename T>
+class PredecodeCache {
+    public:
+        struct Entry {
+            Addr pc; // physical
+            T value;
+        };
+
+        struct Block {
+            Addr start; // physical address of the first instruction
+            Addr end; // physical address after the last instruction
+            bool closed; // nothing can be appended any more
+            std::vector<Entry> entries;
+        };
+
+    private:
+        std::unordered_map<Addr, Block> blocks;
+        // page -> starts of the blocks in it
+        std::unordered_map<Addr, std::vector<Addr>> pageBlocks;
+        size_t maxBlocks;
+        size_t maxBlockInsts;
+        Addr pageMask;
+        uint64_t gen;
+
+        Addr
+        pageOf(Addr addr) const {
+            return addr & pageMask;
+        }
+
+    public:
+        PredecodeCache(size_t max_blocks, size_t max_block_insts,
+                Addr page_size) :
+            maxBlocks(max_blocks), maxBlockInsts(max_block_insts),
+            pageMask(~(page_size - 1)), gen(0) {
+            assert(page_size != 0 && (page_size & (page_size - 1)) == 0);
+        }
+
+        bool
+        enabled() const {
+            return maxBlocks != 0;
+        }
+
+        uint64_t
+        generation() const {
+            return gen;
+        }
+
+        size_t
+        size() const {
+            return blocks.size();
+        }
+
+        // the block starting at pc, or nullptr
+        Block*
+        lookup(Addr pc) {
+            auto it = blocks.find(pc);
+            return it == blocks.end() ? nullptr : &it->second;
+        }
+
+        // starts an empty block at pc, which must not have one yet
+        Block*
+        open(Addr pc) {
+            assert(enabled() && blocks.find(pc) == blocks.end());
+            if(blocks.size() >= maxBlocks) {
+                clear();
+            }
+            Block& block = blocks[pc];
+            block.start = pc;
+            block.end = pc;
+            block.closed = false;
+            pageBlocks[pageOf(pc)].push_back(pc);
+            return &block;
+        }
+
+        /**
+         * Appends an instruction of the given size at the end of the
+         * block. The block is closed after it if last is set, the block
+         * is full or it reaches the end of the page. Returns whether the
+         * block is closed.
+         * */
+        bool
+        append(Block* block, Addr size, const T& value, bool last) {
+            assert(!block->closed);
+            block->entries.push_back(Entry{block->end, value});
+            block->end += size;
+            block->closed = last ||
+                block->entries.size() >= maxBlockInsts ||
+                pageOf(block->end) != pageOf(block->start);
+            return block->closed;
+        }
+
+        // drops the blocks of the pages [addr, addr + size) touches, and
+        // returns how many were dropped
+        size_t
+        invalidate(Addr addr, Addr size) {
+            if(pageBlocks.empty() || size == 0) {
+                return 0;
+            }
+            size_t dropped = 0;
+            Addr last = pageOf(addr + size - 1);
+            for(Addr page = pageOf(addr); ; page += ~pageMask + 1) {
+                auto it = pageBlocks.find(page);
+                if(it != pageBlocks.end()) {
+                    for(Addr start : it->second) {
+                        dropped += blocks.erase(start);
+                    }
+                    pageBlocks.erase(it);
+                }
+                if(page == last) {
+                    break;
+                }
+            }
+            if(dropped != 0) {
+                ++ gen;
+            }
+            return dropped;
+        }
+
+        void
+        clear() {
+            blocks.clear();
+            pageBlocks.clear();
+            ++ gen;
+        }
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include "arch/riscvcapstone/predecode_cache.hh"
+
+using namespace gem5::RiscvcapstoneISA;
+
+typedef PredecodeCache<int> IntPredecodeCache;
+
+TEST(PredecodeCacheTest, Disabled)
+{
+    IntPredecodeCache cache(0, 16, 0x1000);
+    EXPECT_FALSE(cache.enabled());
+}
+
+TEST(PredecodeCacheTest, RecordAndLookup)
+{
+    IntPredecodeCache cache(8, 16, 0x1000);
+    EXPECT_EQ(cache.lookup(0x1000), nullptr);
+
+    IntPredecodeCache::Block* block = cache.open(0x1000);
+    EXPECT_FALSE(cache.append(block, 4, 1, false));
+    EXPECT_FALSE(cache.append(block, 2, 2, false));
+    EXPECT_TRUE(cache.append(block, 4, 3, true));
+
+    IntPredecodeCache::Block* found = cache.lookup(0x1000);
+    ASSERT_EQ(found, block);
+    EXPECT_EQ(found->end, 0x100a);
+    ASSERT_EQ(found->entries.size(), 3);
+    EXPECT_EQ(found->entries[1].pc, 0x1004);
+    EXPECT_EQ(found->entries[1].value, 2);
+    EXPECT_EQ(found->entries[2].pc, 0x1006);
+
+    // only blocks are looked up, not the instructions in them
+    EXPECT_EQ(cache.lookup(0x1004), nullptr);
+}
+
+TEST(PredecodeCacheTest, ClosesAtLimits)
+{
+    IntPredecodeCache cache(8, 2, 0x1000);
+    IntPredecodeCache::Block* block = cache.open(0x1000);
+    EXPECT_FALSE(cache.append(block, 4, 1, false));
+    EXPECT_TRUE(cache.append(block, 4, 2, false));
+
+    // ends at the page boundary
+    block = cache.open(0x1ffc);
+    EXPECT_TRUE(cache.append(block, 4, 1, false));
+    EXPECT_EQ(block->end, 0x2000);
+}
+
+TEST(PredecodeCacheTest, StoreInvalidatesPage)
+{
+    IntPredecodeCache cache(8, 16, 0x1000);
+    cache.append(cache.open(0x1000), 4, 1, true);
+    cache.append(cache.open(0x1800), 4, 2, true);
+    cache.append(cache.open(0x2000), 4, 3, true);
+    uint64_t gen = cache.generation();
+
+    // not a code page
+    EXPECT_EQ(cache.invalidate(0x5000, 8), 0);
+    EXPECT_EQ(cache.generation(), gen);
+
+    EXPECT_EQ(cache.invalidate(0x1ff8, 8), 2);
+    EXPECT_NE(cache.generation(), gen);
+    EXPECT_EQ(cache.lookup(0x1000), nullptr);
+    EXPECT_EQ(cache.lookup(0x1800), nullptr);
+    EXPECT_NE(cache.lookup(0x2000), nullptr);
+
+    // across the page boundary
+    cache.append(cache.open(0x1000), 4, 1, true);
+    EXPECT_EQ(cache.invalidate(0x1ffc, 8), 2);
+    EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(PredecodeCacheTest, FlushesWhenFull)
+{
+    IntPredecodeCache cache(2, 16, 0x1000);
+    cache.append(cache.open(0x1000), 4, 1, true);
+    cache.append(cache.open(0x2000), 4, 2, true);
+    uint64_t gen = cache.generation();
+
+    cache.append(cache.open(0x3000), 4, 3, true);
+    EXPECT_NE(cache.generation(), gen);
+    EXPECT_EQ(cache.size(), 1);
+    EXPECT_EQ(cache.lookup(0x1000), nullptr);
+    EXPECT_NE(cache.lookup(0x3000), nullptr);
+}
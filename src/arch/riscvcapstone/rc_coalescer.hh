@@ -0,0 +1,87 @@
+#ifndef RC_COALESCER_H
+#define RC_COALESCER_H
+
+#include <vector>
+
+#include "arch/riscvcapstone/types.hh"
+#include "base/statistics.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * Collects the reference count updates of one instruction and merges the
+ * ones to the same node, e.g., the -1 and +1 of a move between two
+ * registers holding the same capability. Updates whose deltas cancel out
+ * are dropped altogether.
+ *
+ * Each rc update that does not reach the node controller saves a load and
+ * a store of the node.
+ * */
+class RcUpdateCoalescer {
+    private:
+        struct Entry {
+            NodeID nodeId;
+            int delta;
+        };
+
+        struct RcUpdateCoalescerStats : public statistics::Group {
+            RcUpdateCoalescerStats(statistics::Group* parent) :
+                statistics::Group(parent, "rcCoalescer"),
+                ADD_STAT(updates, "Number of rc updates before coalescing"),
+                ADD_STAT(commands, "Number of rc update commands issued"),
+                ADD_STAT(cancelled,
+                        "Number of nodes whose rc updates cancelled out"),
+                ADD_STAT(savedNodeAccesses,
+                        "Number of node loads and stores saved by coalescing",
+                        (updates - commands) * 2)
+            {}
+
+            statistics::Scalar updates;
+            statistics::Scalar commands;
+            statistics::Scalar cancelled;
+            statistics::Formula savedNodeAccesses;
+        } stats;
+
+        std::vector<Entry> entries; // in order of the first update
+
+    public:
+        RcUpdateCoalescer(statistics::Group* parent) : stats(parent) {
+            entries.reserve(32);
+        }
+
+        void
+        add(NodeID node_id, int delta) {
+            ++ stats.updates;
+            for(Entry& e : entries) {
+                if(e.nodeId == node_id) {
+                    e.delta += delta;
+                    return;
+                }
+            }
+            entries.push_back(Entry{node_id, delta});
+        }
+
+        bool
+        empty() const {
+            return entries.empty();
+        }
+
+        // calls issue(node_id, delta) for each node with a non-zero delta
+        template<typename F>
+        void
+        flush(F issue) {
+            for(const Entry& e : entries) {
+                if(e.delta == 0) {
+                    ++ stats.cancelled;
+                } else{
+                    ++ stats.commands;
+                    issue(e.nodeId, e.delta);
+                }
+            }
+            entries.clear();
+        }
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SPARSE_TABLE_H
+#define SPARSE_TABLE_H
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace gem5::RiscvcapstoneISA {
+
+/**
+ * A fixed-size table indexed by node ID whose storage is allocated lazily
+ * in chunks of (1 << ChunkBits) entries. A chunk is only allocated when
+ * one of its entries is first written, and entries of chunks that were
+ * never written read as the default value.
+ *
+ * Lookups are O(1): one index into the chunk directory and one into the
+ * chunk.
+ * */
+template<typename T, unsigned int ChunkBits = 12>
+class SparseTable {
+    public:
+        static const size_t CHUNK_SIZE = (size_t)1 << ChunkBits;
+
+    private:
+        std::vector<std::unique_ptr<T[]>> chunks;
+        size_t entryCount;
+        T defaultValue;
+        size_t chunksAllocated;
+
+        T*
+        allocChunk(size_t chunk_idx) {
+            std::unique_ptr<T[]> chunk(new T[CHUNK_SIZE]);
+            for(size_t i = 0; i < CHUNK_SIZE; i ++) {
+                chunk[i] = defaultValue;
+            }
+            chunks[chunk_idx] = std::move(chunk);
+            ++ chunksAllocated;
+            return chunks[chunk_idx].get();
+        }
+
+    public:
+        SparseTable(size_t entry_count, const T& default_value = T()) :
+            chunks((entry_count + CHUNK_SIZE - 1) >> ChunkBits),
+            entryCount(entry_count),
+            defaultValue(default_value),
+            chunksAllocated(0) {}
+
+        const T&
+        get(size_t idx) const {
+            assert(idx < entryCount);
+            const T* chunk = chunks[idx >> ChunkBits].get();
+            if(chunk == nullptr) {
+                return defaultValue;
+            }
+            return chunk[idx & (CHUNK_SIZE - 1)];
+        }
+
+        // returns a writable reference, allocating the chunk if necessary
+        T&
+        getMutable(size_t idx) {
+            assert(idx < entryCount);
+            T* chunk = chunks[idx >> ChunkBits].get();
+            if(chunk == nullptr) {
+                chunk = allocChunk(idx >> ChunkBits);
+            }
+            return chunk[idx & (CHUNK_SIZE - 1)];
+        }
+
+        void
+        set(size_t idx, const T& value) {
+            getMutable(idx) = value;
+        }
+
+        size_t
+        size() const {
+            return entryCount;
+        }
+
+        size_t
+        chunkCount() const {
+            return chunks.size();
+        }
+
+        // the entries of a chunk, or nullptr if it has not been allocated
+        const T*
+        chunk(size_t chunk_idx) const {
+            return chunks[chunk_idx].get();
+        }
+
+        size_t
+        allocatedChunkCount() const {
+            return chunksAllocated;
+        }
+
+        // drops all chunks so that every entry reads as the default value
+        void
+        clear() {
+            for(auto& chunk : chunks) {
+                chunk.reset();
+            }
+            chunksAllocated = 0;
+        }
+};
+
+} // end of namespace gem5::RiscvcapstoneISA
+
+#endif
@@ -0,0 +1,36 @@
+#include <gtest/gtest.h>
+
+#include "arch/riscvcapstone/sparse_table.hh"
+
+using namespace gem5::RiscvcapstoneISA;
+
+TEST(SparseTableTest, DefaultValue)
+{
+    SparseTable<int, 4> table(100, -1);
+    EXPECT_EQ(table.size(), 100);
+    EXPECT_EQ(table.chunkCount(), 7);
+    EXPECT_EQ(table.get(0), -1);
+    EXPECT_EQ(table.get(99), -1);
+    EXPECT_EQ(table.allocatedChunkCount(), 0);
+}
+
+TEST(SparseTableTest, LazyChunks)
+{
+    SparseTable<int, 4> table(100, -1);
+    table.set(17, 5);
+    EXPECT_EQ(table.get(17), 5);
+    // the rest of the chunk reads as the default value
+    EXPECT_EQ(table.get(16), -1);
+    EXPECT_EQ(table.get(31), -1);
+    EXPECT_EQ(table.allocatedChunkCount(), 1);
+    EXPECT_EQ(table.chunk(0), nullptr);
+    EXPECT_NE(table.chunk(1), nullptr);
+
+    table.getMutable(99) += 3;
+    EXPECT_EQ(table.get(99), 2);
+    EXPECT_EQ(table.allocatedChunkCount(), 2);
+
+    table.clear();
+    EXPECT_EQ(table.get(17), -1);
+    EXPECT_EQ(table.allocatedChunkCount(), 0);
+}
@@ -0,0 +1,536 @@
+#include "arch/riscvcapstone/spec_cap_tracker.hh"
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "arch/riscvcapstone/faults.hh"
+#include "arch/riscvcapstone/insts/standard.hh"
+#include "arch/riscvcapstone/insts/static_inst.hh"
+#include "arch/riscvcapstone/regs/int.hh"
+#include "base/cast.hh"
+#include "base/trace.hh"
+#include "cpu/thread_context.hh"
+#include "debug/CapstoneCapTrack.hh"
+#include "mem/packet_access.hh"
+#include "sim/system.hh"
+
+namespace gem5::RiscvcapstoneISA {
+
+CapstoneCapTracker::TrackerStats::TrackerStats(statistics::Group* parent) :
+    statistics::Group(parent),
+    ADD_STAT(checks, "Number of capability checks sent while the access "
+            "executes"),
+    ADD_STAT(lateChecks, "Number of capability checks only sent at commit"),
+    ADD_STAT(checkWaits, "Number of commits that waited for their "
+            "capability check"),
+    ADD_STAT(checkFaults, "Number of accesses faulting on a revoked "
+            "capability"),
+    ADD_STAT(rcUpdates, "Number of rc updates sent"),
+    ADD_STAT(rcBufferStalls, "Number of times commit waited for the rc "
+            "update buffer"),
+    ADD_STAT(ecallCommands, "Number of commands sent for malloc and free "
+            "ecalls"),
+    ADD_STAT(squashedChecks, "Number of capability checks dropped by "
+            "squashes")
+{
+}
+
+CapstoneCapTracker::TrackerPort::TrackerPort(CapstoneCapTracker* owner) :
+    RequestPort(owner->name() + ".port", owner),
+    owner(owner) {
+}
+
+bool
+CapstoneCapTracker::TrackerPort::recvTimingResp(PacketPtr pkt) {
+    owner->recvResp(pkt);
+    return true;
+}
+
+void
+CapstoneCapTracker::TrackerPort::recvReqRetry() {
+    owner->recvRetry();
+}
+
+CapstoneCapTracker::CapstoneCapTracker(const CapstoneCapTrackerParams& p) :
+    BaseCapTracker(p),
+    stats(this),
+    port(this),
+    system(p.system),
+    controller(p.node_controller),
+    rcUpdateBufferSize(p.rc_update_buffer_size),
+    requestorId(0),
+    packetPool(this, "packetPool"),
+    rcOutstanding(0) {
+}
+
+Port&
+CapstoneCapTracker::getPort(const std::string& if_name, PortID idx) {
+    if(if_name == "port") {
+        return port;
+    }
+    return BaseCapTracker::getPort(if_name, idx);
+}
+
+void
+CapstoneCapTracker::init() {
+    BaseCapTracker::init();
+    fatal_if(!port.isConnected(), "%s: port is not connected\n", name());
+    requestorId = system->getRequestorId(this);
+}
+
+DrainState
+CapstoneCapTracker::drain() {
+    return inFlight.empty() ? DrainState::Drained : DrainState::Draining;
+}
+
+// the CPU models hand over the instructions of the decoder, which only
+// makes RISC-V ones
+static const RiscvStaticInst*
+riscvInst(const StaticInstPtr& inst) {
+    return safe_cast<const RiscvStaticInst*>(inst.get());
+}
+
+// the node of the integer source through which the instruction accesses
+// addr, in the committed state
+NodeID
+CapstoneCapTracker::accessNode(ContextID ctx, const StaticInstPtr& inst,
+        Addr addr) {
+    if((riscvInst(inst)->intSrcMask() & controller->capTrackRegMask(ctx)) == 0)
+        return NODE_ID_INVALID;
+    int num_src = inst->numSrcRegs();
+    for(int i = 0; i < num_src; i ++) {
+        const RegId& src_id = inst->srcRegIdx(i);
+        if(src_id.classValue() != RegClassType::IntRegClass)
+            continue;
+        NodeID node_id = controller->queryCapTrack(
+                CapLoc::makeReg(ctx, src_id.index()));
+        if(node_id != NODE_ID_INVALID &&
+                controller->node2Obj.get(node_id).contains(addr)) {
+            return node_id;
+        }
+    }
+    return NODE_ID_INVALID;
+}
+
+PacketPtr
+CapstoneCapTracker::send(NodeControllerCommandPtr cmd, const InFlight& info) {
+    PacketPtr pkt = packetPool.acquire(MemCmd::ReadReq, requestorId);
+    pkt->setRaw<NodeControllerCommandPtr>(cmd);
+    inFlight[pkt] = info;
+
+    // commands reach the node controller in order
+    if(!retryPkts.empty() || !port.sendTimingReq(pkt)) {
+        retryPkts.push_back(pkt);
+    }
+    return pkt;
+}
+
+// replaces the check of the instruction, if any
+void
+CapstoneCapTracker::sendCheck(ContextID ctx, InstSeqNum seq_num,
+        NodeID node_id) {
+    DPRINTF(CapstoneCapTrack, "[sn:%llu] check node %u\n", seq_num, node_id);
+    InFlight info = InFlight();
+    info.type = InFlight::CHECK;
+    info.ctx = ctx;
+    info.seqNum = seq_num;
+    Check check = Check();
+    check.nodeId = node_id;
+    check.pkt = send(controller->newCommand<NodeControllerQuery>(node_id),
+            info);
+    threads[ctx].checks[seq_num] = check;
+}
+
+void
+CapstoneCapTracker::pushRcUpdate(NodeID node_id, int delta) {
+    InFlight info = InFlight();
+    info.type = InFlight::RC_UPDATE;
+    send(controller->newCommand<NodeControllerRcUpdate>(node_id, delta),
+            info);
+    ++ rcOutstanding;
+    ++ stats.rcUpdates;
+}
+
+void
+CapstoneCapTracker::access(ThreadContext* tc, InstSeqNum seq_num,
+        const StaticInstPtr& inst, Addr addr, unsigned size) {
+    ContextID ctx = tc->contextId();
+    ThreadState& ts = threads[ctx];
+    if(size == 0 || ts.checks.find(seq_num) != ts.checks.end()) {
+        return;
+    }
+    // older in-flight instructions may still change the node, which
+    // canCommit() catches
+    NodeID node_id = accessNode(ctx, inst, addr);
+    if(node_id == NODE_ID_INVALID) {
+        return;
+    }
+    ++ stats.checks;
+    sendCheck(ctx, seq_num, node_id);
+}
+
+bool
+CapstoneCapTracker::canCommit(ThreadContext* tc, InstSeqNum seq_num,
+        const StaticInstPtr& inst, Addr addr, unsigned size, Fault& fault) {
+    if(fault != NoFault && !inst->isSyscall()) {
+        return true;
+    }
+    if(rcOutstanding > rcUpdateBufferSize) {
+        ++ stats.rcBufferStalls;
+        return false;
+    }
+
+    ContextID ctx = tc->contextId();
+    ThreadState& ts = threads[ctx];
+    // the checks of instructions that faulted
+    ts.checks.erase(ts.checks.begin(), ts.checks.lower_bound(seq_num));
+
+    if(inst->isSyscall()) {
+        return ecallCanCommit(tc, seq_num);
+    }
+    if(!inst->isMemRef() || size == 0) {
+        return true;
+    }
+
+    // the node once the older instructions committed, which the check
+    // sent by access() may have got wrong
+    NodeID node_id = accessNode(ctx, inst, addr);
+    if(node_id == NODE_ID_INVALID) {
+        return true;
+    }
+
+    auto it = ts.checks.find(seq_num);
+    if(it == ts.checks.end() || it->second.nodeId != node_id) {
+        ++ stats.lateChecks;
+        sendCheck(ctx, seq_num, node_id);
+        it = ts.checks.find(seq_num);
+    }
+    Check& check = it->second;
+    if(!check.done) {
+        if(!check.waited) {
+            check.waited = true;
+            ++ stats.checkWaits;
+        }
+        return false;
+    }
+    if(!check.valid) {
+        ++ stats.checkFaults;
+        DPRINTF(CapstoneCapTrack, "[sn:%llu] cap check failed for %llx\n",
+                seq_num, addr);
+        fault = std::make_shared<AddressFault>(addr,
+                inst->isStore() ? ExceptionCode::STORE_ACCESS :
+                    ExceptionCode::LOAD_ACCESS);
+    }
+    return true;
+}
+
+// sends the command of a malloc or free ecall, and returns true once the
+// ecall can trap
+bool
+CapstoneCapTracker::ecallCanCommit(ThreadContext* tc, InstSeqNum seq_num) {
+    ContextID ctx = tc->contextId();
+    Ecall& ecall = threads[ctx].ecall;
+    Addr pc = tc->pcState().instAddr(); // the ecall is next to commit
+    if(ecall.active()) {
+        if(ecall.seqNum == seq_num || (ecall.squashed && ecall.pc == pc)) {
+            ecall.seqNum = seq_num;
+            ecall.squashed = false;
+            if(ecall.pkt != nullptr) {
+                return false;
+            }
+            ecall = Ecall();
+            return true;
+        }
+        if(ecall.pkt != nullptr) {
+            // squashed, the path changed meanwhile
+            return false;
+        }
+    }
+
+    ecall = Ecall();
+    ecall.seqNum = seq_num;
+    ecall.pc = pc;
+    NodeControllerCommandPtr cmd = nullptr;
+    switch(tc->readIntReg(SyscallNumReg)) {
+        case 3000: // malloc
+            ecall.malloc = true;
+            ecall.addr = tc->readIntReg(ReturnValueReg);
+            ecall.size = tc->readIntReg(ReturnValueReg + 1);
+            cmd = controller->newCommand<NodeControllerAllocate>(
+                    NODE_ID_INVALID);
+            break;
+        case 3001: { // free
+            NodeID node_id = controller->queryCapTrack(
+                    CapLoc::makeReg(ctx, ArgumentRegs[0]));
+            if(node_id == NODE_ID_INVALID) {
+                DPRINTF(CapstoneCapTrack, "warning: no node associated "
+                        "with the location to free\n");
+                break;
+            }
+            cmd = controller->newCommand<NodeControllerRevoke>(node_id);
+            break;
+        }
+        case 3003: { // batched free
+            std::vector<NodeID> node_ids =
+                FreeBatchStateMachine::collectNodes(controller,
+                        tc->readIntReg(ArgumentRegs[0]),
+                        tc->readIntReg(ArgumentRegs[1]));
+            if(!node_ids.empty()) {
+                cmd = controller->newCommand<NodeControllerRevokeBatch>(
+                        std::move(node_ids));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if(cmd == nullptr) {
+        ecall = Ecall();
+        return true;
+    }
+
+    ++ stats.ecallCommands;
+    InFlight info = InFlight();
+    info.type = InFlight::ECALL;
+    info.ctx = ctx;
+    info.seqNum = seq_num;
+    ecall.pkt = send(cmd, info);
+    return false;
+}
+
+void
+CapstoneCapTracker::commit(ThreadContext* tc, InstSeqNum seq_num,
+        const StaticInstPtr& inst, Addr addr, unsigned size) {
+    ContextID ctx = tc->contextId();
+    ThreadState& ts = threads[ctx];
+    ts.checks.erase(ts.checks.begin(), ts.checks.upper_bound(seq_num));
+
+    if(inst->isSyscall()) {
+        return;
+    }
+    if(inst->isLoad()) {
+        if(size != 0) {
+            trackLoad(ctx, inst, addr);
+        }
+    } else if(inst->isStore()) {
+        if(size != 0) {
+            trackStore(ctx, inst, addr, size);
+        }
+    } else{
+        trackRegs(tc, inst);
+    }
+}
+
+void
+CapstoneCapTracker::squash(ThreadContext* tc, InstSeqNum seq_num) {
+    ThreadState& ts = threads[tc->contextId()];
+    // the responses of the dropped checks are ignored
+    auto first = ts.checks.upper_bound(seq_num);
+    stats.squashedChecks += std::distance(first, ts.checks.end());
+    ts.checks.erase(first, ts.checks.end());
+    if(ts.ecall.active() && ts.ecall.seqNum > seq_num) {
+        ts.ecall.squashed = true;
+    }
+}
+
+void
+CapstoneCapTracker::clearMemCaps(Addr addr, Addr size) {
+    controller->removeCapTrackRange(addr, size, [this](NodeID node_id) {
+        DPRINTF(CapstoneCapTrack, "capability of node %u overwritten\n",
+                node_id);
+        pushRcUpdate(node_id, -1);
+    });
+}
+
+void
+CapstoneCapTracker::copyMemCaps(Addr dst, Addr src, Addr size) {
+    DPRINTF(CapstoneCapTrack, "bulk copy %llx -> %llx (%llu bytes)\n",
+            src, dst, size);
+    controller->copyCapTrackRange(dst, src, size,
+            [this](NodeID node_id, int delta) {
+        pushRcUpdate(node_id, delta);
+    });
+}
+
+void
+CapstoneCapTracker::cleanupDest(ContextID ctx, const StaticInstPtr& inst) {
+    if((riscvInst(inst)->intDestMask() & controller->capTrackRegMask(ctx)) == 0)
+        return;
+    int num_dest = inst->numDestRegs();
+    for(int i = 0; i < num_dest; i ++) {
+        const RegId& dest_id = inst->destRegIdx(i);
+        if(dest_id.classValue() != RegClassType::IntRegClass)
+            continue;
+        CapLoc loc = CapLoc::makeReg(ctx, dest_id.index());
+        NodeID node_id = controller->queryCapTrack(loc);
+        if(node_id == NODE_ID_INVALID)
+            continue;
+        controller->removeCapTrack(loc);
+        pushRcUpdate(node_id, -1);
+    }
+}
+
+void
+CapstoneCapTracker::trackLoad(ContextID ctx, const StaticInstPtr& inst,
+        Addr addr) {
+    cleanupDest(ctx, inst);
+
+    NodeID node_id = controller->queryCapTrack(CapLoc::makeMem(addr));
+    if(node_id != NODE_ID_INVALID) {
+        panic_if(inst->numDestRegs() != 1, "load instruction should have "
+                "exactly 1 destination register");
+        DPRINTF(CapstoneCapTrack, "load of node %u from %llx\n", node_id,
+                addr);
+        controller->addCapTrack(
+                CapLoc::makeReg(ctx, inst->destRegIdx(0).index()), node_id);
+        pushRcUpdate(node_id, 1);
+    }
+}
+
+void
+CapstoneCapTracker::trackStore(ContextID ctx, const StaticInstPtr& inst,
+        Addr addr, unsigned size) {
+    // including the capabilities the store only partially overlaps
+    controller->removeCapTrackRange(addr, size, [this](NodeID node_id) {
+        pushRcUpdate(node_id, -1);
+    });
+
+    panic_if(inst->numSrcRegs() != 2, "store instructions should have "
+            "exactly 2 source registers");
+    const RegId& reg_id = inst->srcRegIdx(1);
+    if(reg_id.classValue() == RegClassType::IntRegClass &&
+            size == CapTrackTable::CAP_SIZE) {
+        NodeID reg_node = controller->queryCapTrack(
+                CapLoc::makeReg(ctx, reg_id.index()));
+        if(reg_node != NODE_ID_INVALID) {
+            DPRINTF(CapstoneCapTrack, "store of node %u to %llx\n",
+                    reg_node, addr);
+            controller->addCapTrack(CapLoc::makeMem(addr), reg_node);
+            pushRcUpdate(reg_node, 1);
+        }
+    }
+}
+
+// a destination gets the capability of a source if its value points
+// into the object of the source
+void
+CapstoneCapTracker::trackRegs(ThreadContext* tc, const StaticInstPtr& inst) {
+    const RiscvStaticInst* rv_inst = riscvInst(inst);
+    if(rv_inst->capTrackClass() == RiscvStaticInst::CapTrackNoIntDest)
+        return;
+    ContextID ctx = tc->contextId();
+    uint64_t cap_regs = controller->capTrackRegMask(ctx);
+
+    std::vector<NodeID> source_nodes;
+    if(rv_inst->capTrackClass() == RiscvStaticInst::CapTrackMayPropagate &&
+            (rv_inst->intSrcMask() & cap_regs) != 0) {
+        int num_src = inst->numSrcRegs();
+        for(int i = 0; i < num_src; i ++) {
+            const RegId& src_id = inst->srcRegIdx(i);
+            if(src_id.classValue() != RegClassType::IntRegClass)
+                continue;
+            NodeID node_id = controller->queryCapTrack(
+                    CapLoc::makeReg(ctx, src_id.index()));
+            if(node_id != NODE_ID_INVALID)
+                source_nodes.push_back(node_id);
+        }
+    }
+    if(source_nodes.empty() && (rv_inst->intDestMask() & cap_regs) == 0)
+        return;
+
+    int num_dest = inst->numDestRegs();
+    for(int j = 0; j < num_dest; j ++) {
+        const RegId& dest_id = inst->destRegIdx(j);
+        if(dest_id.classValue() != RegClassType::IntRegClass)
+            continue;
+        RegIndex dest_idx = dest_id.index();
+        RegVal dest_val = tc->readIntReg(dest_idx);
+        NodeID src_node = NODE_ID_INVALID;
+        for(NodeID node_id : source_nodes) {
+            if(controller->node2Obj.get(node_id).contains((Addr)dest_val)) {
+                src_node = node_id;
+                break;
+            }
+        }
+        CapLoc dest_loc = CapLoc::makeReg(ctx, dest_idx);
+        NodeID dest_node = controller->queryCapTrack(dest_loc);
+        if(dest_node == src_node)
+            continue;
+        if(dest_node != NODE_ID_INVALID) {
+            controller->removeCapTrack(dest_loc);
+            pushRcUpdate(dest_node, -1);
+        }
+        if(src_node != NODE_ID_INVALID) {
+            controller->addCapTrack(dest_loc, src_node);
+            pushRcUpdate(src_node, 1);
+        }
+    }
+}
+
+void
+CapstoneCapTracker::recvResp(PacketPtr pkt) {
+    auto it = inFlight.find(pkt);
+    panic_if(it == inFlight.end(), "%s received an unknown response\n",
+            name());
+    InFlight info = it->second;
+    inFlight.erase(it);
+
+    switch(info.type) {
+        case InFlight::RC_UPDATE:
+            assert(rcOutstanding > 0);
+            -- rcOutstanding;
+            break;
+        case InFlight::CHECK: {
+            auto& checks = threads[info.ctx].checks;
+            auto check_it = checks.find(info.seqNum);
+            // otherwise the instruction was squashed, or the check
+            // replaced
+            if(check_it != checks.end() && check_it->second.pkt == pkt) {
+                Check& check = check_it->second;
+                check.pkt = nullptr;
+                check.done = true;
+                check.valid = pkt->getRaw<Node>().state != 0;
+            }
+            break;
+        }
+        case InFlight::ECALL: {
+            Ecall& ecall = threads[info.ctx].ecall;
+            assert(ecall.pkt == pkt);
+            if(ecall.malloc) {
+                NodeID node_id = pkt->getRaw<NodeID>();
+                DPRINTF(CapstoneCapTrack, "Associated node %llu with addr "
+                        "range (0x%llx, 0x%llx)\n", node_id,
+                        ecall.addr, (Addr)(ecall.addr + ecall.size));
+                controller->addCapTrack(
+                        CapLoc::makeReg(info.ctx, ReturnValueReg), node_id);
+                controller->node2Obj.set(node_id, SimpleAddrRange(
+                            ecall.addr, (Addr)(ecall.addr + ecall.size)));
+            }
+            ecall.pkt = nullptr;
+            ecall.done = true;
+            break;
+        }
+    }
+    packetPool.release(pkt);
+
+    if(inFlight.empty() && drainState() == DrainState::Draining) {
+        signalDrainDone();
+    }
+    if(wakeupCPU) {
+        wakeupCPU();
+    }
+}
+
+void
+CapstoneCapTracker::recvRetry() {
+    assert(!retryPkts.empty());
+    while(!retryPkts.empty()) {
+        if(!port.sendTimingReq(retryPkts.front())) {
+            return;
+        }
+        retryPkts.pop_front();
+    }
+}
+
+} // end of namespace gem5::RiscvcapstoneISA
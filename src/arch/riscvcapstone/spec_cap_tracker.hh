@@ -0,0 +1,165 @@
+#ifndef SPEC_CAP_TRACKER_H
+#define SPEC_CAP_TRACKER_H
+
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+#include "arch/riscvcapstone/node_controller.hh"
+#include "arch/riscvcapstone/node_packet_pool.hh"
+#include "base/statistics.hh"
+#include "cpu/cap_tracker.hh"
+#include "mem/port.hh"
+#include "params/CapstoneCapTracker.hh"
+
+namespace gem5 {
+
+class System;
+
+namespace RiscvcapstoneISA {
+
+/**
+ * Capstone capability tracking for the O3 and Minor CPUs, which execute
+ * speculatively and so cannot update the tracking table of the node
+ * controller as they go, unlike TimingSimpleNCacheCPU.
+ *
+ * The tracking table only changes when an instruction commits, from the
+ * architectural register values as the simple CPU does, so a squash has
+ * nothing to roll back. The rc updates retire in the background, up to
+ * rc_update_buffer_size of them.
+ *
+ * A memory access sends the capability check of its base register to
+ * the node controller while it executes, as node queries have no side
+ * effects. At commit, the check is redone against the committed state:
+ * the instruction waits for its check (sending it then if an older
+ * in-flight instruction changed the node meanwhile), and faults if the
+ * node is revoked. A squash only drops the checks of the squashed
+ * instructions.
+ *
+ * The malloc and free ecalls (3000, 3001 and 3003) send their commands
+ * when they reach commit, and trap once the commands complete. The
+ * syscalls that write to memory go through clearMemCaps() and
+ * copyMemCaps() as they run at commit.
+ * */
+class CapstoneCapTracker : public BaseCapTracker {
+    private:
+        class TrackerPort : public RequestPort {
+            private:
+                CapstoneCapTracker* owner;
+
+            protected:
+                bool recvTimingResp(PacketPtr pkt) override;
+                void recvReqRetry() override;
+
+            public:
+                TrackerPort(CapstoneCapTracker* owner);
+        };
+
+        struct TrackerStats : public statistics::Group {
+            TrackerStats(statistics::Group* parent);
+
+            statistics::Scalar checks;
+            statistics::Scalar lateChecks;
+            statistics::Scalar checkWaits;
+            statistics::Scalar checkFaults;
+            statistics::Scalar rcUpdates;
+            statistics::Scalar rcBufferStalls;
+            statistics::Scalar ecallCommands;
+            statistics::Scalar squashedChecks;
+        } stats;
+
+        struct Check {
+            NodeID nodeId;
+            PacketPtr pkt; // nullptr once done
+            bool done;
+            bool valid; // the node is not revoked
+            bool waited;
+        };
+
+        // the node controller command of a malloc or free ecall
+        struct Ecall {
+            InstSeqNum seqNum;
+            Addr pc;
+            PacketPtr pkt; // nullptr once done
+            bool done;
+            // the command cannot be taken back, so a squashed ecall is
+            // picked up again when it executes again
+            bool squashed;
+            bool malloc;
+            Addr addr; // of the allocated object
+            uint64_t size;
+
+            bool active() const { return pkt != nullptr || done; }
+        };
+
+        struct ThreadState {
+            std::map<InstSeqNum, Check> checks;
+            Ecall ecall = Ecall();
+        };
+
+        struct InFlight {
+            enum {
+                RC_UPDATE,
+                CHECK,
+                ECALL,
+            } type;
+            ContextID ctx;
+            InstSeqNum seqNum;
+        };
+
+        TrackerPort port;
+        System* system;
+        NodeController* controller;
+        const unsigned int rcUpdateBufferSize;
+
+        RequestorID requestorId;
+        NodePacketPool packetPool;
+
+        std::unordered_map<ContextID, ThreadState> threads;
+        std::unordered_map<PacketPtr, InFlight> inFlight;
+        std::deque<PacketPtr> retryPkts; // in order
+        unsigned int rcOutstanding;
+
+        NodeID accessNode(ContextID ctx, const StaticInstPtr& inst,
+                Addr addr);
+        PacketPtr send(NodeControllerCommandPtr cmd, const InFlight& info);
+        void sendCheck(ContextID ctx, InstSeqNum seq_num, NodeID node_id);
+        void pushRcUpdate(NodeID node_id, int delta);
+        bool ecallCanCommit(ThreadContext* tc, InstSeqNum seq_num);
+        void cleanupDest(ContextID ctx, const StaticInstPtr& inst);
+        void trackLoad(ContextID ctx, const StaticInstPtr& inst, Addr addr);
+        void trackStore(ContextID ctx, const StaticInstPtr& inst, Addr addr,
+                unsigned size);
+        void trackRegs(ThreadContext* tc, const StaticInstPtr& inst);
+        void recvResp(PacketPtr pkt);
+        void recvRetry();
+
+    public:
+        CapstoneCapTracker(const CapstoneCapTrackerParams& p);
+
+        Port& getPort(const std::string& if_name,
+                PortID idx = InvalidPortID) override;
+
+        void init() override;
+        DrainState drain() override;
+
+        void access(ThreadContext* tc, InstSeqNum seq_num,
+                const StaticInstPtr& inst, Addr addr,
+                unsigned size) override;
+        bool canCommit(ThreadContext* tc, InstSeqNum seq_num,
+                const StaticInstPtr& inst, Addr addr, unsigned size,
+                Fault& fault) override;
+        void commit(ThreadContext* tc, InstSeqNum seq_num,
+                const StaticInstPtr& inst, Addr addr,
+                unsigned size) override;
+        void squash(ThreadContext* tc, InstSeqNum seq_num) override;
+
+        // same as BaseSimpleCPUWithNodeController, for syscall emulation
+        void clearMemCaps(Addr addr, Addr size);
+        void copyMemCaps(Addr dst, Addr src, Addr size);
+};
+
+} // end of namespace RiscvcapstoneISA
+} // end of namespace gem5
+
+#endif
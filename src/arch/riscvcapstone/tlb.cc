@@ -31,6 +31,7 @@
 
 #include "arch/riscvcapstone/tlb.hh"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -71,16 +72,30 @@ buildKey(Addr vpn, uint16_t asid)
 }
 
 TLB::TLB(const Params &p) :
-    BaseTLB(p), size(p.size), tlb(size),
-    lruSeq(0), stats(this)
+    BaseTLB(p), size(p.size), assoc(p.assoc == 0 ? p.size : p.assoc),
+    numSets(0), tlb(size), inUse(0), lruSeq(0),
+    replacementPolicy(p.replacement_policy), replEntries(size),
+    asidPos(size), hitLatency(p.hit_latency),
+    stats(this)
 {
+    fatal_if(size == 0 || assoc > size || size % assoc != 0,
+             "TLB size (%d) must be a non-zero multiple of assoc (%d)",
+             size, assoc);
+    fatal_if(nextLevel() == this, "A TLB cannot be its own next level");
+    numSets = size / assoc;
+    sets.resize(numSets);
+
+    // Entries are instantiated set by set, as tree-based policies expect.
     for (size_t x = 0; x < size; x++) {
         tlb[x].trieHandle = NULL;
-        freeList.push_back(&tlb[x]);
+        replEntries[x].setPosition(x / assoc, x % assoc);
+        replEntries[x].replacementData = replacementPolicy->instantiateEntry();
+        sets[x / assoc].push_back(&replEntries[x]);
     }
 
     walker = p.walker;
-    walker->setTLB(this);
+    if (walker)
+        walker->setTLB(this);
 }
 
 Walker *
@@ -89,19 +104,26 @@ TLB::getWalker()
     return walker;
 }
 
-void
-TLB::evictLRU()
+size_t
+TLB::setOf(Addr vpn, unsigned logBytes) const
 {
-    // Find the entry with the lowest (and hence least recently updated)
-    // sequence number.
+    return (vpn >> logBytes) % numSets;
+}
 
-    size_t lru = 0;
-    for (size_t i = 1; i < size; i++) {
-        if (tlb[i].lruSeq < tlb[lru].lruSeq)
-            lru = i;
+size_t
+TLB::freeEntry(size_t set)
+{
+    size_t base = set * assoc;
+    for (size_t way = 0; way < assoc; way++) {
+        if (!tlb[base + way].trieHandle)
+            return base + way;
     }
 
-    remove(lru);
+    ReplaceableEntry *victim = replacementPolicy->getVictim(sets[set]);
+    size_t idx = base + victim->getWay();
+    stats.evictions++;
+    remove(idx);
+    return idx;
 }
 
 TlbEntry *
@@ -110,8 +132,11 @@ TLB::lookup(Addr vpn, uint16_t asid, BaseMMU::Mode mode, bool hidden)
     TlbEntry *entry = trie.lookup(buildKey(vpn, asid));
 
     if (!hidden) {
-        if (entry)
+        if (entry) {
             entry->lruSeq = nextSeq();
+            replacementPolicy->touch(
+                replEntries[entry - tlb.data()].replacementData);
+        }
 
         if (mode == BaseMMU::Write)
             stats.writeAccesses++;
@@ -144,6 +169,10 @@ TLB::insert(Addr vpn, const TlbEntry &entry)
     DPRINTF(TLB, "insert(vpn=%#x, asid=%#x): ppn=%#x pte=%#x size=%#x\n",
         vpn, entry.asid, entry.paddr, entry.pte, entry.size());
 
+    // Keep the next level inclusive of the fills from page walks.
+    if (TLB *next_level = nextLevelTLB())
+        next_level->insert(vpn, entry);
+
     // If somebody beat us to it, just use that existing entry.
     TlbEntry *newEntry = lookup(vpn, entry.asid, BaseMMU::Read, true);
     if (newEntry) {
@@ -153,11 +182,8 @@ TLB::insert(Addr vpn, const TlbEntry &entry)
         return newEntry;
     }
 
-    if (freeList.empty())
-        evictLRU();
-
-    newEntry = freeList.front();
-    freeList.pop_front();
+    size_t idx = freeEntry(setOf(vpn, entry.logBytes));
+    newEntry = &tlb[idx];
 
     Addr key = buildKey(vpn, entry.asid);
     *newEntry = entry;
@@ -165,6 +191,11 @@ TLB::insert(Addr vpn, const TlbEntry &entry)
     newEntry->vaddr = vpn;
     newEntry->trieHandle =
     trie.insert(key, TlbEntryTrie::MaxBits - entry.logBytes, newEntry);
+    replacementPolicy->reset(replEntries[idx].replacementData);
+
+    EntryList &entries = asidEntries[entry.asid];
+    asidPos[idx] = entries.insert(entries.end(), idx);
+    inUse++;
     return newEntry;
 }
 
@@ -173,6 +204,13 @@ TLB::demapPage(Addr vpn, uint64_t asid)
 {
     asid &= 0xFFFF;
 
+    if (TLB *next_level = nextLevelTLB())
+        next_level->demapPage(vpn, asid);
+
+    // A fence of a single page only covers its leaf PTE.
+    if (vpn == 0 && walker)
+        walker->flushWalkCache();
+
     if (vpn == 0 && asid == 0)
         flushAll();
     else {
@@ -182,14 +220,24 @@ TLB::demapPage(Addr vpn, uint64_t asid)
             if (newEntry)
                 remove(newEntry - tlb.data());
         }
+        else if (vpn != 0) {
+            // the page in every ASID
+            std::vector<size_t> matches;
+            for (auto &asid_entries : asidEntries) {
+                TlbEntry *entry =
+                    lookup(vpn, asid_entries.first, BaseMMU::Read, true);
+                if (entry)
+                    matches.push_back(entry - tlb.data());
+            }
+            for (size_t idx : matches)
+                remove(idx);
+        }
         else {
-            for (size_t i = 0; i < size; i++) {
-                if (tlb[i].trieHandle) {
-                    Addr mask = ~(tlb[i].size() - 1);
-                    if ((vpn == 0 || (vpn & mask) == tlb[i].vaddr) &&
-                        (asid == 0 || tlb[i].asid == asid))
-                        remove(i);
-                }
+            auto it = asidEntries.find(asid);
+            if (it != asidEntries.end()) {
+                EntryList entries = it->second;
+                for (size_t idx : entries)
+                    remove(idx);
             }
         }
     }
@@ -199,10 +247,10 @@ void
 TLB::flushAll()
 {
     DPRINTF(TLB, "flushAll()\n");
-    for (size_t i = 0; i < size; i++) {
-        if (tlb[i].trieHandle)
-            remove(i);
-    }
+    if (walker)
+        walker->flushWalkCache();
+    while (!asidEntries.empty())
+        remove(asidEntries.begin()->second.front());
 }
 
 void
@@ -215,7 +263,14 @@ TLB::remove(size_t idx)
     assert(tlb[idx].trieHandle);
     trie.remove(tlb[idx].trieHandle);
     tlb[idx].trieHandle = NULL;
-    freeList.push_back(&tlb[idx]);
+    replacementPolicy->invalidate(replEntries[idx].replacementData);
+
+    auto it = asidEntries.find(tlb[idx].asid);
+    assert(it != asidEntries.end());
+    it->second.erase(asidPos[idx]);
+    if (it->second.empty())
+        asidEntries.erase(it);
+    inUse--;
 }
 
 Fault
@@ -284,6 +339,29 @@ TLB::doTranslate(const RequestPtr &req, ThreadContext *tc,
     SATP satp = tc->readMiscReg(MISCREG_SATP);
 
     TlbEntry *e = lookup(vaddr, satp.asid, mode, false);
+    TLB *next_level = nextLevelTLB();
+    if (!e && next_level) {
+        TlbEntry *next = next_level->lookup(vaddr, satp.asid, mode, false);
+        if (next) {
+            stats.nextLevelHits++;
+            e = insert(next->vaddr, *next);
+            if (translation != nullptr && next_level->hitLatency != 0) {
+                // translate again, from this TLB, once the next level
+                // has responded
+                delayed = true;
+                schedule(new EventFunctionWrapper(
+                    [this, req, tc, translation, mode]{
+                        bool delayed;
+                        Fault fault = translate(req, tc, translation, mode,
+                                                delayed);
+                        if (!delayed)
+                            translation->finish(fault, req, tc, mode);
+                    }, name() + ".nextLevelHit", true),
+                    curTick() + next_level->hitLatency);
+                return NoFault;
+            }
+        }
+    }
     if (!e) {
         Fault fault = walker->start(tc, translation, req, mode);
         if (translation != nullptr || fault != NoFault) {
@@ -456,7 +534,7 @@ void
 TLB::serialize(CheckpointOut &cp) const
 {
     // Only store the entries in use.
-    uint32_t _size = size - freeList.size();
+    uint32_t _size = inUse;
     SERIALIZE_SCALAR(_size);
     SERIALIZE_SCALAR(lruSeq);
 
@@ -479,15 +557,22 @@ TLB::unserialize(CheckpointIn &cp)
 
     UNSERIALIZE_SCALAR(lruSeq);
 
-    for (uint32_t x = 0; x < _size; x++) {
-        TlbEntry *newEntry = freeList.front();
-        freeList.pop_front();
-
-        newEntry->unserializeSection(cp, csprintf("Entry%d", x));
-        Addr key = buildKey(newEntry->vaddr, newEntry->asid);
-        newEntry->trieHandle = trie.insert(key,
-            TlbEntryTrie::MaxBits - newEntry->logBytes, newEntry);
+    // Refill in the order of use, so that the replacement policy starts
+    // from the same recency order.
+    std::vector<TlbEntry> entries(_size);
+    for (uint32_t x = 0; x < _size; x++)
+        entries[x].unserializeSection(cp, csprintf("Entry%d", x));
+    std::sort(entries.begin(), entries.end(),
+              [](const TlbEntry &a, const TlbEntry &b) {
+                  return a.lruSeq < b.lruSeq;
+              });
+
+    uint64_t seq = lruSeq;
+    for (const TlbEntry &entry : entries) {
+        TlbEntry *newEntry = insert(entry.vaddr, entry);
+        newEntry->lruSeq = entry.lruSeq;
     }
+    lruSeq = seq;
 }
 
 TLB::TlbStats::TlbStats(statistics::Group *parent)
@@ -498,6 +583,10 @@ TLB::TlbStats::TlbStats(statistics::Group *parent)
     ADD_STAT(writeHits, statistics::units::Count::get(), "write hits"),
     ADD_STAT(writeMisses, statistics::units::Count::get(), "write misses"),
     ADD_STAT(writeAccesses, statistics::units::Count::get(), "write accesses"),
+    ADD_STAT(evictions, statistics::units::Count::get(),
+             "valid entries replaced by fills"),
+    ADD_STAT(nextLevelHits, statistics::units::Count::get(),
+             "misses that hit in the next level TLB"),
     ADD_STAT(hits, statistics::units::Count::get(),
              "Total TLB (read and write) hits", readHits + writeHits),
     ADD_STAT(misses, statistics::units::Count::get(),
@@ -511,7 +600,7 @@ TLB::TlbStats::TlbStats(statistics::Group *parent)
 Port *
 TLB::getTableWalkerPort()
 {
-    return &walker->getPort("port");
+    return walker ? &walker->getPort("port") : nullptr;
 }
 
 } // namespace gem5
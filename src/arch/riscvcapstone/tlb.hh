@@ -33,6 +33,8 @@
 #define __ARCH_RISCV_TLB_HH__
 
 #include <list>
+#include <unordered_map>
+#include <vector>
 
 #include "arch/generic/tlb.hh"
 #include "arch/riscvcapstone/isa.hh"
@@ -41,6 +43,7 @@
 #include "arch/riscvcapstone/regs/misc.hh"
 #include "arch/riscvcapstone/utility.hh"
 #include "base/statistics.hh"
+#include "mem/cache/replacement_policies/base.hh"
 #include "mem/request.hh"
 #include "params/RiscvTLB.hh"
 #include "sim/sim_object.hh"
@@ -56,17 +59,41 @@ namespace RiscvcapstoneISA {
 
 class Walker;
 
+/**
+ * Entries are organized in sets of assoc ways (a single set when the TLB
+ * is fully associative). An entry is placed in the set selected by its
+ * page number (at its own page size) and replaced within the set by the
+ * replacement policy, so fills cost O(assoc) rather than O(size). Lookups
+ * go through the trie regardless of the organization.
+ *
+ * Misses may be looked up in a second-level TLB (next_level), possibly
+ * shared by several TLBs, before walking the page table. Its hits are
+ * copied into this TLB and, in timing mode, take its hit_latency.
+ */
 class TLB : public BaseTLB
 {
-    typedef std::list<TlbEntry *> EntryList;
+    typedef std::list<size_t> EntryList;
 
   protected:
     size_t size;
-    std::vector<TlbEntry> tlb;  // our TLB
+    size_t assoc;
+    size_t numSets;
+    std::vector<TlbEntry> tlb;  // our TLB, set by set
     TlbEntryTrie trie;          // for quick access
-    EntryList freeList;         // free entries
+    size_t inUse;               // number of valid entries
     uint64_t lruSeq;
 
+    replacement_policy::Base *replacementPolicy;
+    // replacement data and position of each entry
+    std::vector<ReplaceableEntry> replEntries;
+    std::vector<ReplacementCandidates> sets;
+
+    // valid entries of each ASID, for flushes
+    std::unordered_map<uint16_t, EntryList> asidEntries;
+    std::vector<EntryList::iterator> asidPos;
+
+    const Tick hitLatency;
+
     Walker *walker;
 
     struct TlbStats : public statistics::Group
@@ -79,6 +106,8 @@ class TLB : public BaseTLB
         statistics::Scalar writeHits;
         statistics::Scalar writeMisses;
         statistics::Scalar writeAccesses;
+        statistics::Scalar evictions;
+        statistics::Scalar nextLevelHits;
 
         statistics::Formula hits;
         statistics::Formula misses;
@@ -134,9 +163,12 @@ class TLB : public BaseTLB
   private:
     uint64_t nextSeq() { return ++lruSeq; }
 
+    TLB *nextLevelTLB() const { return static_cast<TLB *>(nextLevel()); }
+
     TlbEntry *lookup(Addr vpn, uint16_t asid, BaseMMU::Mode mode, bool hidden);
 
-    void evictLRU();
+    size_t setOf(Addr vpn, unsigned logBytes) const;
+    size_t freeEntry(size_t set);
     void remove(size_t idx);
 
     Fault translate(const RequestPtr &req, ThreadContext *tc,
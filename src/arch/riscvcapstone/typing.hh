@@ -4,6 +4,9 @@
 #include "sim/port.hh"
 #include "cpu/simple/base.hh"
 #include "params/BaseSimpleCPU.hh"
+#include "arch/riscvcapstone/insts/standard.hh"
+#include "arch/riscvcapstone/node_packet_pool.hh"
+#include "arch/riscvcapstone/pool.hh"
 
 
 namespace gem5::RiscvcapstoneISA {
@@ -12,9 +15,28 @@ class NodeController;
 
 class BaseSimpleCPUWithNodeController : public BaseSimpleCPU {
     public:
-        BaseSimpleCPUWithNodeController(const BaseSimpleCPUParams& p): BaseSimpleCPU(p) {}
+        BaseSimpleCPUWithNodeController(const BaseSimpleCPUParams& p):
+            BaseSimpleCPU(p), ncachePacketPool(this, "ncachePacketPool"),
+            storeSize(0) {}
         virtual Port& getNodePort() = 0;
         virtual NodeController* getNodeController() = 0;
+
+        // drops the capabilities in memory overlapping [addr, addr + size)
+        // and decrements their reference counts, e.g., for syscall writes
+        virtual void clearMemCaps(Addr addr, Addr size) = 0;
+        // moves the capabilities of a bulk memory copy
+        virtual void copyMemCaps(Addr dst, Addr src, Addr size) = 0;
+
+        // storage for the state machines of node cache instructions
+        ObjectPool<MallocStateMachine> mallocStateMachinePool;
+        ObjectPool<FreeStateMachine> freeStateMachinePool;
+        ObjectPool<FreeBatchStateMachine> freeBatchStateMachinePool;
+        // packets carrying commands to the node controller
+        NodePacketPool ncachePacketPool;
+
+    protected:
+        // size of the last store, set by writeMem
+        unsigned int storeSize;
 };
 
 }
@@ -0,0 +1,8 @@
+from m5.params import *
+from m5.SimObject import SimObject
+
+class BaseCapTracker(SimObject):
+    type = 'BaseCapTracker'
+    abstract = True
+    cxx_header = 'cpu/cap_tracker.hh'
+    cxx_class = 'gem5::BaseCapTracker'
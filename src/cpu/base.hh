@@ -67,6 +67,7 @@
 namespace gem5
 {
 
+class BaseCapTracker;
 class BaseCPU;
 struct BaseCPUParams;
 class CheckerCPU;
@@ -186,6 +187,12 @@ class BaseCPU : public ClockedObject
      */
     virtual Port &getInstPort() = 0;
 
+    /**
+     * The capability tracker of the CPU model, if it has one, e.g., for
+     * syscall emulation to report the memory it writes.
+     */
+    virtual BaseCapTracker *getCapTracker() { return nullptr; }
+
     /** Reads this CPU's ID. */
     int cpuId() const { return _cpuId; }
 
@@ -0,0 +1,77 @@
+#ifndef __CPU_CAP_TRACKER_HH__
+#define __CPU_CAP_TRACKER_HH__
+
+#include <functional>
+
+#include "base/types.hh"
+#include "cpu/inst_seq.hh"
+#include "cpu/static_inst_fwd.hh"
+#include "params/BaseCapTracker.hh"
+#include "sim/faults.hh"
+#include "sim/sim_object.hh"
+
+namespace gem5
+{
+
+class ThreadContext;
+
+/**
+ * Hooks through which a CPU model that executes speculatively (O3,
+ * Minor) lets an ISA track the capabilities in registers and memory,
+ * e.g., Capstone's revocation nodes. The CPU reports the instructions
+ * as they send their memory accesses, commit and get squashed, and asks
+ * before each commit whether the instruction may commit or has to fault
+ * instead. The tracker gets the instructions of the ISA's decoder and
+ * is the one to look into them.
+ *
+ * Sequence numbers are per thread and increase in program order.
+ */
+class BaseCapTracker : public SimObject
+{
+  protected:
+    std::function<void()> wakeupCPU;
+
+  public:
+    PARAMS(BaseCapTracker);
+
+    BaseCapTracker(const Params &p) : SimObject(p) {}
+
+    /**
+     * Sets how to wake the CPU up when an instruction that had to wait
+     * in canCommit() may be able to commit.
+     */
+    void setWakeup(std::function<void()> wakeup) { wakeupCPU = wakeup; }
+
+    /**
+     * The instruction sent its memory access to [addr, addr + size),
+     * possibly speculatively.
+     */
+    virtual void access(ThreadContext *tc, InstSeqNum seq_num,
+                        const StaticInstPtr &inst, Addr addr,
+                        unsigned size) = 0;
+
+    /**
+     * The instruction is next to commit, or to trap if fault is set,
+     * with its memory access (if any, size is 0 otherwise). Returns false
+     * if it has to wait, and may set fault if the instruction must trap
+     * instead of committing.
+     */
+    virtual bool canCommit(ThreadContext *tc, InstSeqNum seq_num,
+                           const StaticInstPtr &inst, Addr addr,
+                           unsigned size, Fault &fault) = 0;
+
+    /**
+     * The instruction committed without a fault, its results are in the
+     * thread context.
+     */
+    virtual void commit(ThreadContext *tc, InstSeqNum seq_num,
+                        const StaticInstPtr &inst, Addr addr,
+                        unsigned size) = 0;
+
+    /** The instructions younger than seq_num are squashed. */
+    virtual void squash(ThreadContext *tc, InstSeqNum seq_num) = 0;
+};
+
+} // namespace gem5
+
+#endif // __CPU_CAP_TRACKER_HH__
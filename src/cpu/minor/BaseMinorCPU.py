@@ -287,6 +287,9 @@ class BaseMinorCPU(BaseCPU):
     branchPred = Param.BranchPredictor(TournamentBP(
         numThreads = Parent.numThreads), "Branch Predictor")
 
+    cap_tracker = Param.BaseCapTracker(NULL,
+        "Tracks the capabilities in registers and memory for the ISA")
+
     def addCheckerCpu(self):
         print("Checker not yet supported by MinorCPU")
         exit(1)
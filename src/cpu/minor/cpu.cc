@@ -49,6 +49,7 @@ namespace gem5
 
 MinorCPU::MinorCPU(const BaseMinorCPUParams &params) :
     BaseCPU(params),
+    capTracker(params.cap_tracker),
     threadPolicy(params.threadPolicy),
     stats(this)
 {
@@ -79,6 +80,12 @@ MinorCPU::MinorCPU(const BaseMinorCPUParams &params) :
     pipeline = new minor::Pipeline(*this, params);
     activityRecorder = pipeline->getActivityRecorder();
 
+    if (capTracker) {
+        capTracker->setWakeup([this] {
+            wakeupOnEvent(minor::Pipeline::ExecuteStageId);
+        });
+    }
+
     fetchEventWrapper = NULL;
 }
 
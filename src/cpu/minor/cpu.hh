@@ -47,6 +47,7 @@
 #include "base/compiler.hh"
 #include "base/random.hh"
 #include "cpu/base.hh"
+#include "cpu/cap_tracker.hh"
 #include "cpu/minor/activity.hh"
 #include "cpu/minor/stats.hh"
 #include "cpu/simple_thread.hh"
@@ -100,6 +101,10 @@ class MinorCPU : public BaseCPU
      *  threads[threadId]->getTC() */
     std::vector<minor::MinorThread *> threads;
 
+    /** Capability tracker of the ISA, NULL if not used.  Execute reports
+     *  the instructions it issues, commits and discards to it */
+    BaseCapTracker *capTracker;
+
   public:
     /** Provide a non-protected base class for Minor's Ports as derived
      *  classes are created by Fetch1 and Execute */
@@ -130,6 +135,9 @@ class MinorCPU : public BaseCPU
 
     ~MinorCPU();
 
+    /** Return the capability tracker, if any. */
+    BaseCapTracker *getCapTracker() override { return capTracker; }
+
   public:
     /** Starting, waking and initialisation */
     void init() override;
@@ -293,6 +293,11 @@ Execute::tryToBranch(MinorDynInstPtr inst, Fault fault, BranchData &branch)
         reason = BranchData::NoBranch;
     }
 
+    /* A faulting instruction doesn't commit, so neither do its
+     *  capability tracking updates */
+    if (fault != NoFault && inst->isInst() && cpu.capTracker)
+        cpu.capTracker->squash(thread, inst->id.execSeqNum - 1);
+
     updateBranchData(inst->id.threadId, reason, inst, *target, branch);
 }
 
@@ -305,9 +310,17 @@ Execute::updateBranchData(
 {
     if (reason != BranchData::NoBranch) {
         /* Bump up the stream sequence number on a real branch*/
-        if (BranchData::isStreamChange(reason))
+        if (BranchData::isStreamChange(reason)) {
             executeInfo[tid].streamSeqNum++;
 
+            /* Everything after inst (everything in flight for a bubble)
+             *  will be discarded */
+            if (cpu.capTracker) {
+                cpu.capTracker->squash(cpu.getContext(tid),
+                    (inst->isBubble() ? 0 : inst->id.execSeqNum));
+            }
+        }
+
         /* Branches (even mis-predictions) don't change the predictionSeqNum,
          *  just the streamSeqNum */
         branch = BranchData(reason, tid,
@@ -322,6 +335,28 @@ Execute::updateBranchData(
     }
 }
 
+bool
+Execute::memResponseCanCommit(MinorDynInstPtr inst,
+    LSQ::LSQRequestPtr response)
+{
+    ThreadContext *thread = cpu.getContext(inst->id.threadId);
+    PacketPtr packet = response->packet;
+    Fault fault = inst->translationFault;
+
+    if (!cpu.capTracker->canCommit(thread, inst->id.execSeqNum,
+        inst->staticInst,
+        (packet ? response->request->getVaddr() : 0),
+        (packet ? response->request->getSize() : 0), fault))
+    {
+        return false;
+    }
+
+    /* A failed capability check is taken by handleMemResponse like a
+     *  fault from the TLB */
+    inst->translationFault = fault;
+    return true;
+}
+
 void
 Execute::handleMemResponse(MinorDynInstPtr inst,
     LSQ::LSQRequestPtr response, BranchData &branch, Fault &fault)
@@ -400,6 +435,12 @@ Execute::handleMemResponse(MinorDynInstPtr inst,
             "writes or faults at this point\n");
     }
 
+    if (fault == NoFault && cpu.capTracker) {
+        cpu.capTracker->commit(thread, inst->id.execSeqNum, inst->staticInst,
+            (packet ? response->request->getVaddr() : 0),
+            (packet ? response->request->getSize() : 0));
+    }
+
     lsq.popResponse(response);
 
     if (inst->traceData) {
@@ -970,6 +1011,14 @@ Execute::commitInst(MinorDynInstPtr inst, bool early_memory_issue,
         /* This instruction can suspend, need to be able to communicate
          * backwards, so no other branches may evaluate this cycle*/
         completed_inst = false;
+    } else if (inst->isInst() && cpu.capTracker &&
+        !cpu.capTracker->canCommit(thread, inst->id.execSeqNum,
+            inst->staticInst, 0, 0, fault))
+    {
+        DPRINTF(MinorExecute, "Can't commit inst: %s yet as it waits for"
+            " the capability tracker\n", *inst);
+
+        completed_inst = false;
     } else {
         ExecContext context(cpu, *cpu.threads[thread_id], *this, inst);
 
@@ -997,6 +1046,9 @@ Execute::commitInst(MinorDynInstPtr inst, bool early_memory_issue,
             DPRINTF(MinorExecute, "Fault in execute of inst: %s fault: %s\n",
                 *inst, fault->name());
             fault->invoke(thread, inst->staticInst);
+        } else if (cpu.capTracker) {
+            cpu.capTracker->commit(thread, inst->id.execSeqNum,
+                inst->staticInst, 0, 0);
         }
 
         doInstCommitAccounting(inst);
@@ -1135,6 +1187,12 @@ Execute::commit(ThreadID thread_id, bool only_commit_microops, bool discard,
             /* Branch as there was a change in PC */
             updateBranchData(thread_id, BranchData::UnpredictedBranch,
                 MinorDynInst::bubble(), thread->pcState(), branch);
+        } else if (mem_response && cpu.capTracker && !discard &&
+            inst->id.streamSeqNum == ex_info.streamSeqNum &&
+            !memResponseCanCommit(inst, mem_response))
+        {
+            DPRINTF(MinorExecute, "Can't commit mem response: %s yet as it"
+                " waits for the capability tracker\n", *inst);
         } else if (mem_response &&
             num_mem_refs_committed < memoryCommitLimit)
         {
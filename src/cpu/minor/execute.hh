@@ -231,6 +231,12 @@ class Execute : public Named
     void updateBranchData(ThreadID tid, BranchData::Reason reason,
         MinorDynInstPtr inst, const PCStateBase &target, BranchData &branch);
 
+    /** Ask the capability tracker whether the mem ref with the given
+     *  response can commit.  A failed capability check becomes the
+     *  inst's translationFault */
+    bool memResponseCanCommit(MinorDynInstPtr inst,
+        LSQ::LSQRequestPtr response);
+
     /** Handle extracting mem ref responses from the memory queues and
      *  completing the associated instructions.
      *  Fault is an output and will contain any fault caused (and already
@@ -1656,6 +1656,12 @@ LSQ::pushRequest(MinorDynInstPtr inst, bool isLoad, uint8_t *data,
             [] (ThreadContext *tc, PacketPtr pkt) { return Cycles(1); });
     }
 
+    /* Capability checks can go out alongside the access */
+    if (cpu.capTracker) {
+        cpu.capTracker->access(cpu.getContext(inst->id.threadId),
+            inst->id.execSeqNum, inst->staticInst, addr, size);
+    }
+
     requests.push(request);
     inst->inLSQ = true;
     request->startAddrTranslation();
@@ -169,4 +169,6 @@ class BaseO3CPU(BaseCPU):
     branchPred = Param.BranchPredictor(TournamentBP(numThreads =
                                                        Parent.numThreads),
                                        "Branch Predictor")
+    cap_tracker = Param.BaseCapTracker(NULL,
+        "Tracks the capabilities in registers and memory for the ISA")
     needsTSO = Param.Bool(False, "Enable TSO Memory model")
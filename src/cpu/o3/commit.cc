@@ -547,6 +547,9 @@ Commit::squashAll(ThreadID tid)
     rob->squash(squashed_inst, tid);
     changedROBNumEntries[tid] = true;
 
+    if (cpu->capTracker)
+        cpu->capTracker->squash(cpu->tcBase(tid), squashed_inst);
+
     // Send back the sequence number of the squashed instruction.
     toIEW->commitInfo[tid].doneSeqNum = squashed_inst;
 
@@ -862,6 +865,9 @@ Commit::commit()
             rob->squash(squashed_inst, tid);
             changedROBNumEntries[tid] = true;
 
+            if (cpu->capTracker)
+                cpu->capTracker->squash(cpu->tcBase(tid), squashed_inst);
+
             toIEW->commitInfo[tid].doneSeqNum = squashed_inst;
 
             toIEW->commitInfo[tid].squash = true;
@@ -1210,6 +1216,29 @@ Commit::commitHead(const DynInstPtr &head_inst, unsigned inst_num)
         // then there is no need to raise a new fault
     }
 
+    // The capability tracker may hold the instruction back or turn it
+    // into a fault. Syscalls go through it as well, once they are ready
+    // to trap, as they may have capabilities to allocate or revoke.
+    if (cpu->capTracker && !head_inst->notAnInst() &&
+        (inst_fault == NoFault || (head_inst->isSyscall() &&
+            !iewStage->hasStoresToWB(tid) && inst_num == 0))) {
+        bool has_addr = head_inst->effAddrValid();
+        Fault cap_fault = inst_fault;
+        if (!cpu->capTracker->canCommit(cpu->tcBase(tid), head_inst->seqNum,
+                head_inst->staticInst, has_addr ? head_inst->effAddr : 0,
+                has_addr ? head_inst->effSize : 0, cap_fault)) {
+            DPRINTF(Commit, "[tid:%i] [sn:%llu] "
+                    "Waiting for the capability tracker.\n",
+                    tid, head_inst->seqNum);
+            return false;
+        }
+        if (cap_fault != inst_fault) {
+            // Keep the fault in case the trap has to wait for stores.
+            inst_fault = cap_fault;
+            head_inst->getFault() = cap_fault;
+        }
+    }
+
     // Stores mark themselves as completed.
     if (!head_inst->isStore() && inst_fault == NoFault) {
         head_inst->setCompleted();
@@ -1304,6 +1333,15 @@ Commit::commitHead(const DynInstPtr &head_inst, unsigned inst_num)
                                  head_inst->renamedDestIdx(i));
     }
 
+    // The committed register values are visible through the thread
+    // context from here on.
+    if (cpu->capTracker && !head_inst->notAnInst()) {
+        bool has_addr = head_inst->effAddrValid();
+        cpu->capTracker->commit(cpu->tcBase(tid), head_inst->seqNum,
+                head_inst->staticInst, has_addr ? head_inst->effAddr : 0,
+                has_addr ? head_inst->effSize : 0);
+    }
+
     // hardware transactional memory
     // the HTM UID is purely for correctness and debugging purposes
     if (head_inst->isHtmStart())
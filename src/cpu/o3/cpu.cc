@@ -112,6 +112,7 @@ CPU::CPU(const BaseO3CPUParams &params)
                   params.activity),
 
       globalSeqNum(1),
+      capTracker(params.cap_tracker),
       system(params.system),
       lastRunningCycle(curCycle()),
       cpuStats(this)
@@ -138,6 +139,10 @@ CPU::CPU(const BaseO3CPUParams &params)
         checker = NULL;
     }
 
+    if (capTracker) {
+        capTracker->setWakeup([this] { wakeCPU(); });
+    }
+
     if (!FullSystem) {
         thread.resize(numThreads);
         tids.resize(numThreads);
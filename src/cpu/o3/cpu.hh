@@ -66,6 +66,7 @@
 #include "cpu/o3/thread_state.hh"
 #include "cpu/activity.hh"
 #include "cpu/base.hh"
+#include "cpu/cap_tracker.hh"
 #include "cpu/simple_thread.hh"
 #include "cpu/timebuf.hh"
 #include "params/BaseO3CPU.hh"
@@ -524,6 +525,11 @@ class CPU : public BaseCPU
      */
     gem5::Checker<DynInstPtr> *checker;
 
+    /** Pointer to the capability tracker of the ISA, NULL if it is not
+     * being used.
+     */
+    BaseCapTracker *capTracker;
+
     /** Pointer to the system. */
     System *system;
 
@@ -571,6 +577,9 @@ class CPU : public BaseCPU
         return iew.ldstQueue.getDataPort();
     }
 
+    /** Get the capability tracker, if any. */
+    BaseCapTracker *getCapTracker() override { return capTracker; }
+
     struct CPUStats : public statistics::Group
     {
         CPUStats(CPU *cpu);
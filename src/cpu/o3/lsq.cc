@@ -829,6 +829,12 @@ LSQ::pushRequest(const DynInstPtr& inst, bool isLoad, uint8_t *data,
         // a strictly ordered load
         inst->getFault() = NoFault;
 
+        // The capability check of the access can go out along with it.
+        if (cpu->capTracker && !htm_cmd && !tlbi_cmd) {
+            cpu->capTracker->access(cpu->tcBase(tid), inst->seqNum,
+                                    inst->staticInst, addr, size);
+        }
+
         request->initiateTranslation();
     }
 
@@ -5,11 +5,38 @@
 
 #define SYSCALL_NOTIFYMALLOC 3000
 #define SYSCALL_NOTIFYFREE 3001
+#define SYSCALL_NOTIFYFREE_BATCH 3003
+
+// number of frees to revoke at once (0 to revoke each free on its own)
+#ifndef FREE_BATCH_SIZE
+#define FREE_BATCH_SIZE 0
+#endif
 
 void* __real_malloc(size_t size);
 void __real_free(void* ptr);
 
+#if FREE_BATCH_SIZE > 0
+static void* free_batch[FREE_BATCH_SIZE];
+static size_t free_batch_count;
+
+// revokes the pending frees, must run before their memory can be reused
+static void flush_free_batch(void) {
+    if(free_batch_count) {
+        syscall(SYSCALL_NOTIFYFREE_BATCH, free_batch, free_batch_count);
+        free_batch_count = 0;
+    }
+}
+
+__attribute__((destructor))
+static void flush_free_batch_at_exit(void) {
+    flush_free_batch();
+}
+#endif
+
 void* __wrap_malloc(size_t size) {
+#if FREE_BATCH_SIZE > 0
+    flush_free_batch();
+#endif
     void* obj = __real_malloc(size);
     if(obj) {
         return (void*)syscall(SYSCALL_NOTIFYMALLOC, obj, size);
@@ -17,11 +44,25 @@ void* __wrap_malloc(size_t size) {
     return NULL;
 }
 
+// The pointer is revoked after __real_free, as free itself writes through
+// it (e.g., to link the chunk into a bin), which would fault on a revoked
+// capability. Until then, the memory can be handed out again while the
+// capability is live. Without batching, nothing runs in between. With
+// batching, the window lasts until flush_free_batch: __wrap_malloc flushes
+// first, but allocations that do not go through it (calloc, realloc, or
+// malloc calls inside libc) may reuse the memory meanwhile.
 void __wrap_free(void* ptr) {
     __real_free(ptr);
     if(ptr) {
+#if FREE_BATCH_SIZE > 0
+        // the stored pointer keeps the capability for the batched revoke
+        free_batch[free_batch_count ++] = ptr;
+        if(free_batch_count == FREE_BATCH_SIZE) {
+            flush_free_batch();
+        }
+#else
         syscall(SYSCALL_NOTIFYFREE, ptr);
+#endif
     }
 }
 
-